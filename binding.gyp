@@ -1,4 +1,7 @@
 {
+  "variables": {
+    "build_benchmarks%": 0
+  },
   "targets": [
     {
       "target_name": "tcp_sniffer_native",
@@ -13,7 +16,7 @@
       "cflags_cc!": ["-fno-exceptions"],
       "conditions": [
         ["OS=='linux'", {
-          "sources": ["native/capture.cpp", "native/packet.cpp", "native/reassembly.cpp", "native/http_parser.cpp"],
+          "sources": ["native/capture.cpp", "native/tpacket.cpp", "native/packet.cpp", "native/reassembly.cpp", "native/connection_table.cpp", "native/timer_wheel.cpp", "native/http_scan.cpp", "native/utf8.cpp", "native/timestamp.cpp", "native/header_block.cpp", "native/http_parser.cpp", "native/stream_parser.cpp", "native/message_queue.cpp", "native/message_codec.cpp", "native/ndjson_codec.cpp", "native/stdout_writer.cpp", "native/stats.cpp", "native/log.cpp", "native/load_shedder.cpp"],
           "libraries": ["-lpcap"],
           "cflags_cc": ["-std=c++17"]
         }],
@@ -23,5 +26,30 @@
         }]
       ]
     }
+  ],
+  "conditions": [
+    ["build_benchmarks==1 and OS=='linux'", {
+      "targets": [
+        {
+          "target_name": "http_scan_bench",
+          "type": "executable",
+          "sources": ["native/bench/http_scan_bench.cpp", "native/http_scan.cpp", "native/utf8.cpp", "native/timestamp.cpp", "native/header_block.cpp", "native/http_parser.cpp", "native/ndjson_codec.cpp"],
+          "include_dirs": ["native"],
+          "cflags!": ["-fno-exceptions"],
+          "cflags_cc!": ["-fno-exceptions"],
+          "cflags_cc": ["-std=c++17"]
+        },
+        {
+          "target_name": "pipeline_bench",
+          "type": "executable",
+          "sources": ["native/bench/pipeline_bench.cpp", "native/capture.cpp", "native/tpacket.cpp", "native/packet.cpp", "native/reassembly.cpp", "native/connection_table.cpp", "native/timer_wheel.cpp", "native/http_scan.cpp", "native/utf8.cpp", "native/timestamp.cpp", "native/header_block.cpp", "native/http_parser.cpp", "native/stream_parser.cpp", "native/stats.cpp", "native/log.cpp", "native/load_shedder.cpp"],
+          "include_dirs": ["native"],
+          "libraries": ["-lpcap"],
+          "cflags!": ["-fno-exceptions"],
+          "cflags_cc!": ["-fno-exceptions"],
+          "cflags_cc": ["-std=c++17"]
+        }
+      ]
+    }]
   ]
 }
@@ -1,6 +1,6 @@
 /**
  * TCP Sniffer — N-API addon (Stream A).
- * Exposes start(config) and stop() to TypeScript.
+ * Exposes start(config, onBatch?, onEnd?), stop() and getStats() to TypeScript.
  * On Linux: uses CaptureEngine. On other OS: stub returns error.
  */
 
@@ -13,6 +13,19 @@
 #include "capture.hpp"
 #include "reassembly.hpp"
 #include "http_parser.hpp"
+#include "http_scan.hpp"
+#include "load_shedder.hpp"
+#include "log.hpp"
+#include "message_queue.hpp"
+#include "message_codec.hpp"
+#include "ndjson_codec.hpp"
+#include "stats.hpp"
+#include "stdout_writer.hpp"
+#include "timestamp.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #endif
 
 namespace {
@@ -26,9 +39,23 @@ std::string g_error_message;
 #else
 
 tcp_sniffer::CaptureEngine* g_engine = nullptr;
-tcp_sniffer::Reassembler* g_reassembler = nullptr;
-std::unordered_map<std::string, tcp_sniffer::HttpStreamParser*> g_http_parsers;
+// One reassembly shard per capture worker; shard i is only touched by worker i's thread.
+std::vector<tcp_sniffer::Reassembler*> g_reassemblers;
 Napi::ThreadSafeFunction* g_message_tsf = nullptr;
+// Batches messages from all shards toward g_message_tsf.
+tcp_sniffer::MessageQueue* g_message_queue = nullptr;
+uint64_t g_messages_dropped = 0;  // from the last stopped queue
+bool g_binary_messages = false;     // messageEncoding: 'binary'
+bool g_correlate_exchanges = false;  // correlateExchanges: batches hold exchange records
+// nativeStdout: batches are written to stdout as NDJSON here, before (or instead of) going to JS.
+tcp_sniffer::StdoutWriter* g_stdout_writer = nullptr;
+bool g_messages_to_js = true;  // false when nativeStdout is the only output
+// pcapFile: JS onEnd, called after the file's last batch.
+Napi::FunctionReference* g_end_callback = nullptr;
+// Capture time of each message's completing segment to its hand-off toward JS (flusher thread).
+tcp_sniffer::Histogram g_capture_to_delivery_us;
+// loadShedding (live capture only): read by every shard, sampled on its own thread.
+tcp_sniffer::LoadShedder* g_load_shedder = nullptr;
 
 #endif
 
@@ -49,6 +76,14 @@ bool get_number(Napi::Env env, const Napi::Object& obj, const char* key, double*
   return true;
 }
 
+bool get_bool(Napi::Env env, const Napi::Object& obj, const char* key, bool* out) {
+  if (!obj.Has(key)) return false;
+  Napi::Value v = obj.Get(key);
+  if (!v.IsBoolean()) return false;
+  *out = v.As<Napi::Boolean>().Value();
+  return true;
+}
+
 bool get_uint32(Napi::Env env, const Napi::Object& obj, const char* key, uint32_t* out) {
   double d;
   if (!get_number(env, obj, key, &d)) return false;
@@ -69,46 +104,270 @@ bool get_ports(Napi::Env env, const Napi::Object& obj, std::vector<uint16_t>* ou
 }
 
 #ifndef TCP_SNIFFER_STUB_ONLY
-struct MessagePayload {
-  std::string receiver_ip;
-  uint16_t receiver_port{0};
-  std::string dest_ip;
-  uint16_t dest_port{0};
-  bool is_request{true};
-  std::string method;
-  std::string path;
-  int status_code{0};
-  std::unordered_map<std::string, std::string> headers;
-  std::string body;
-  bool body_truncated{false};
-  std::string body_encoding;
-  std::string timestamp;
-};
-
-void message_tsf_callback(Napi::Env env, Napi::Function js_callback, MessagePayload* payload) {
-  if (!payload || js_callback.IsEmpty()) return;
+/** Lowercased string elements of an array property; false when absent or not an array. */
+bool get_lower_strings(Napi::Env env, const Napi::Object& obj, const char* key, std::vector<std::string>* out) {
+  if (!obj.Has(key) || !obj.Get(key).IsArray()) return false;
+  Napi::Array arr = obj.Get(key).As<Napi::Array>();
+  out->clear();
+  for (uint32_t i = 0; i < arr.Length(); i++) {
+    Napi::Value v = arr[i];
+    if (v.IsString()) out->push_back(tcp_sniffer::lower_ascii(v.As<Napi::String>().Utf8Value()));
+  }
+  return true;
+}
+
+/**
+ * Body bytes to keep for a captureBody mode (contract §1): "full" keeps max_body_size,
+ * "head:N" at most N of those, "none" nothing.
+ */
+bool parse_capture_body(const std::string& mode, size_t max_body_size, size_t* out) {
+  if (mode == "full") {
+    *out = max_body_size;
+  } else if (mode == "none") {
+    *out = 0;
+  } else if (mode.compare(0, 5, "head:") == 0) {
+    size_t n = static_cast<size_t>(std::strtoull(mode.c_str() + 5, nullptr, 10));
+    *out = n < max_body_size ? n : max_body_size;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+Napi::Object message_to_object(Napi::Env env, const tcp_sniffer::HttpMessageData& m) {
   Napi::Object msg = Napi::Object::New(env);
   Napi::Object receiver = Napi::Object::New(env);
-  receiver.Set("ip", payload->receiver_ip);
-  receiver.Set("port", static_cast<uint32_t>(payload->receiver_port));
+  receiver.Set("ip", m.receiver_ip);
+  receiver.Set("port", static_cast<uint32_t>(m.receiver_port));
   msg.Set("receiver", receiver);
   Napi::Object destination = Napi::Object::New(env);
-  destination.Set("ip", payload->dest_ip);
-  destination.Set("port", static_cast<uint32_t>(payload->dest_port));
+  destination.Set("ip", m.dest_ip);
+  destination.Set("port", static_cast<uint32_t>(m.dest_port));
   msg.Set("destination", destination);
-  msg.Set("direction", Napi::String::New(env, payload->is_request ? "request" : "response"));
-  if (!payload->method.empty()) msg.Set("method", payload->method);
-  if (!payload->path.empty()) msg.Set("path", payload->path);
-  if (payload->status_code != 0) msg.Set("statusCode", static_cast<int32_t>(payload->status_code));
+  msg.Set("direction", Napi::String::New(env, m.is_request ? "request" : "response"));
+  if (!m.method.empty()) msg.Set("method", m.method);
+  if (!m.path.empty()) msg.Set("path", m.path);
+  if (m.status_code != 0) msg.Set("statusCode", static_cast<int32_t>(m.status_code));
   Napi::Object headers = Napi::Object::New(env);
-  for (const auto& [k, v] : payload->headers) headers.Set(k, v);
+  for (const auto [k, v] : m.headers) {
+    headers.Set(Napi::String::New(env, k.data(), k.size()), Napi::String::New(env, v.data(), v.size()));
+  }
   msg.Set("headers", headers);
-  msg.Set("timestamp", payload->timestamp);
-  if (!payload->body.empty()) msg.Set("body", payload->body);
-  if (payload->body_truncated) msg.Set("bodyTruncated", true);
-  if (!payload->body_encoding.empty()) msg.Set("bodyEncoding", payload->body_encoding);
-  js_callback.Call({msg});
-  delete payload;
+  msg.Set("timestamp", tcp_sniffer::format_iso_timestamp(m.first_byte_us));
+  msg.Set("timestampUs", Napi::Number::New(env, static_cast<double>(m.first_byte_us)));
+  if (!m.body.empty()) msg.Set("body", m.body);
+  if (m.body_length != 0) msg.Set("bodyLength", Napi::Number::New(env, static_cast<double>(m.body_length)));
+  if (m.body_truncated) msg.Set("bodyTruncated", true);
+  if (!m.body_encoding.empty()) msg.Set("bodyEncoding", m.body_encoding);
+  if (m.incomplete) msg.Set("incomplete", true);
+  return msg;
+}
+
+/**
+ * Exchange record (contract §2.2): a response carrying its request, or either one
+ * alone. Capture times are µs since the epoch.
+ */
+Napi::Object exchange_to_object(Napi::Env env, const tcp_sniffer::HttpMessageData& m) {
+  const tcp_sniffer::HttpMessageData* request = m.is_request ? &m : m.request.get();
+  const tcp_sniffer::HttpMessageData* response = m.is_request ? nullptr : &m;
+  Napi::Object ex = Napi::Object::New(env);
+  Napi::Object receiver = Napi::Object::New(env);
+  receiver.Set("ip", m.receiver_ip);
+  receiver.Set("port", static_cast<uint32_t>(m.receiver_port));
+  ex.Set("receiver", receiver);
+  Napi::Object destination = Napi::Object::New(env);
+  destination.Set("ip", m.dest_ip);
+  destination.Set("port", static_cast<uint32_t>(m.dest_port));
+  ex.Set("destination", destination);
+  Napi::Object timing = Napi::Object::New(env);
+  if (request != nullptr) {
+    ex.Set("request", message_to_object(env, *request));
+    timing.Set("requestStartUs", Napi::Number::New(env, static_cast<double>(request->first_byte_us)));
+    timing.Set("requestEndUs", Napi::Number::New(env, static_cast<double>(request->complete_us)));
+  }
+  if (response != nullptr) {
+    ex.Set("response", message_to_object(env, *response));
+    timing.Set("responseStartUs", Napi::Number::New(env, static_cast<double>(response->first_byte_us)));
+    timing.Set("responseEndUs", Napi::Number::New(env, static_cast<double>(response->complete_us)));
+  }
+  if (request != nullptr && response != nullptr) {
+    double latency = static_cast<double>(response->first_byte_us) - static_cast<double>(request->complete_us);
+    timing.Set("latencyUs", Napi::Number::New(env, latency));
+  }
+  ex.Set("timing", timing);
+  return ex;
+}
+
+/** Runs on the JS thread: one call per batch, with an array of messages (or exchanges). */
+void batch_tsf_callback(Napi::Env env, Napi::Function js_callback, tcp_sniffer::MessageBatch* batch) {
+  if (batch == nullptr) return;
+  if (!js_callback.IsEmpty()) {  // empty when the TSF is tearing down
+    Napi::Array arr = Napi::Array::New(env, batch->size());
+    for (size_t i = 0; i < batch->size(); ++i) {
+      const tcp_sniffer::HttpMessageData& m = (*batch)[i];
+      arr.Set(static_cast<uint32_t>(i), g_correlate_exchanges ? exchange_to_object(env, m) : message_to_object(env, m));
+    }
+    js_callback.Call({arr});
+  }
+  delete batch;
+  if (g_message_queue != nullptr) g_message_queue->batch_done();
+}
+
+/** Runs on the JS thread: one ArrayBuffer per batch (messageEncoding: 'binary'). */
+void binary_batch_tsf_callback(Napi::Env env, Napi::Function js_callback, std::vector<uint8_t>* encoded) {
+  if (encoded == nullptr) return;
+  if (!js_callback.IsEmpty()) {
+    Napi::ArrayBuffer buf = Napi::ArrayBuffer::New(env, encoded->size());
+    std::memcpy(buf.Data(), encoded->data(), encoded->size());
+    js_callback.Call({buf});
+  }
+  delete encoded;
+  if (g_message_queue != nullptr) g_message_queue->batch_done();
+}
+
+/**
+ * Flusher thread sink: write it to stdout (nativeStdout), then hand the batch to JS
+ * (encoding it here, off the JS thread, in binary mode).
+ */
+void deliver_batch(tcp_sniffer::MessageBatch* batch) {
+  uint64_t now_us = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+  for (const tcp_sniffer::HttpMessageData& m : *batch) {
+    if (m.complete_us != 0 && now_us >= m.complete_us) g_capture_to_delivery_us.record(now_us - m.complete_us);
+  }
+  if (g_stdout_writer != nullptr) {
+    std::string lines;
+    tcp_sniffer::encode_ndjson_batch(*batch, g_correlate_exchanges, lines);
+    // Blocks while the pipe is backed up; the queue then fills and applies backpressurePolicy.
+    g_stdout_writer->write(std::move(lines), batch->size());
+  }
+  bool to_js = g_message_tsf != nullptr && g_messages_to_js;
+  napi_status status = napi_closing;
+  if (to_js && g_binary_messages) {
+    auto* encoded = new std::vector<uint8_t>();
+    tcp_sniffer::encode_message_batch(*batch, *encoded);
+    delete batch;
+    status = g_message_tsf->BlockingCall(encoded, binary_batch_tsf_callback);
+    if (status != napi_ok) delete encoded;
+  } else if (to_js) {
+    status = g_message_tsf->BlockingCall(batch, batch_tsf_callback);
+    if (status != napi_ok) delete batch;
+  } else {
+    delete batch;
+  }
+  if (status != napi_ok && g_message_queue != nullptr) g_message_queue->batch_done();
+}
+
+/** Message callback shared by all shards (called from capture worker threads). */
+void on_http_message(tcp_sniffer::HttpMessageData&& m) {
+  if (g_message_queue != nullptr) g_message_queue->push(std::move(m));
+}
+
+/** Flush queued messages toward JS and record the drop count. Call after capture stopped. */
+void stop_message_queue() {
+  if (g_message_queue == nullptr) return;
+  g_message_queue->stop();
+  g_messages_dropped = g_message_queue->dropped();
+  delete g_message_queue;
+  g_message_queue = nullptr;
+}
+
+/** Write out what the stopped queue handed over and join the writer. */
+void stop_stdout_writer() {
+  if (g_stdout_writer == nullptr) return;
+  g_stdout_writer->stop();
+  delete g_stdout_writer;
+  g_stdout_writer = nullptr;
+}
+
+void delete_reassemblers() {
+  // Requests still waiting for a response are delivered on their own.
+  for (tcp_sniffer::Reassembler* r : g_reassemblers) r->flush_exchanges();
+  for (tcp_sniffer::Reassembler* r : g_reassemblers) delete r;
+  g_reassemblers.clear();
+}
+
+/** Latency histogram for getStats(): count, sum, max, percentiles and the non-empty buckets. */
+Napi::Object histogram_to_object(Napi::Env env, const tcp_sniffer::HistogramSnapshot& h) {
+  Napi::Object o = Napi::Object::New(env);
+  o.Set("count", Napi::Number::New(env, static_cast<double>(h.count)));
+  o.Set("sum", Napi::Number::New(env, static_cast<double>(h.sum)));
+  o.Set("max", Napi::Number::New(env, static_cast<double>(h.max)));
+  o.Set("p50", Napi::Number::New(env, static_cast<double>(h.percentile(0.5))));
+  o.Set("p90", Napi::Number::New(env, static_cast<double>(h.percentile(0.9))));
+  o.Set("p99", Napi::Number::New(env, static_cast<double>(h.percentile(0.99))));
+  o.Set("p999", Napi::Number::New(env, static_cast<double>(h.percentile(0.999))));
+  // [upperBound, count] pairs, ascending, for exporters that build their own buckets.
+  Napi::Array buckets = Napi::Array::New(env);
+  uint32_t n = 0;
+  for (size_t i = 0; i < tcp_sniffer::Histogram::kBuckets; ++i) {
+    if (h.buckets[i] == 0) continue;
+    Napi::Array pair = Napi::Array::New(env, 2);
+    pair.Set(0u, Napi::Number::New(env, static_cast<double>(tcp_sniffer::Histogram::bucket_upper_bound(i))));
+    pair.Set(1u, Napi::Number::New(env, static_cast<double>(h.buckets[i])));
+    buckets.Set(n++, pair);
+  }
+  o.Set("buckets", buckets);
+  return o;
+}
+
+/**
+ * Lag signals for g_load_shedder, on its thread. Busy is the growth of each shard's
+ * push_segment time over the wall time since the previous sample.
+ */
+tcp_sniffer::LoadSampler make_load_sampler() {
+  return [prev_ns = std::vector<uint64_t>(g_reassemblers.size()), prev_at = std::chrono::steady_clock::now()]() mutable {
+    tcp_sniffer::LoadSignals s;
+    if (g_message_queue != nullptr) {
+      size_t queued = 0, in_flight = 0;
+      g_message_queue->depth(&queued, &in_flight);
+      s.queue_fill = static_cast<double>(queued) / static_cast<double>(g_message_queue->capacity());
+    }
+    if (g_engine != nullptr) s.ring_fill = g_engine->ring_fill();
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - prev_at).count());
+    prev_at = now;
+    for (size_t i = 0; i < g_reassemblers.size() && i < prev_ns.size(); ++i) {
+      uint64_t ns = g_reassemblers[i]->stats().segment_ns.sum();
+      if (elapsed_ns > 0) s.busy = std::max(s.busy, std::min(1.0, static_cast<double>(ns - prev_ns[i]) / elapsed_ns));
+      prev_ns[i] = ns;
+    }
+    return s;
+  };
+}
+
+void delete_load_shedder() {
+  delete g_load_shedder;
+  g_load_shedder = nullptr;
+}
+
+void delete_end_callback() {
+  delete g_end_callback;
+  g_end_callback = nullptr;
+}
+
+/** Runs on the JS thread, queued on the batch TSF behind the file's last batch. */
+void end_tsf_callback(Napi::Env env, Napi::Function js_callback) {
+  if (g_end_callback == nullptr || js_callback.IsEmpty()) return;
+  Napi::FunctionReference* on_end = g_end_callback;
+  g_end_callback = nullptr;
+  on_end->Call(std::initializer_list<napi_value>{});
+  delete on_end;
+}
+
+/**
+ * Capture file exhausted, on the last worker thread: every other worker has returned,
+ * so all shards can be closed and flushed here. The queue flushes and joins its
+ * flusher, then onEnd is queued behind the batches it delivered.
+ */
+void on_capture_complete() {
+  for (tcp_sniffer::Reassembler* r : g_reassemblers) {
+    r->close_all();  // connections the file ends inside, without FIN or RST
+    r->flush_exchanges();
+  }
+  if (g_message_queue != nullptr) g_message_queue->stop();
+  if (g_message_tsf != nullptr) g_message_tsf->BlockingCall(end_tsf_callback);
 }
 #endif
 
@@ -132,6 +391,7 @@ Napi::Value Start(const Napi::CallbackInfo& info) {
 
   tcp_sniffer::CaptureConfig cfg;
   get_string(env, config, "interface", &cfg.interface_name);
+  get_string(env, config, "pcapFile", &cfg.pcap_file);
   if (!get_ports(env, config, &cfg.ports)) {
     Napi::TypeError::New(env, "config.ports (non-empty array) is required").ThrowAsJavaScriptException();
     return env.Null();
@@ -144,73 +404,137 @@ Napi::Value Start(const Napi::CallbackInfo& info) {
   if (get_uint32(env, config, "maxConcurrentConnections", &mcc)) cfg.max_concurrent_connections = mcc;
   uint32_t cit = 300000;
   if (get_uint32(env, config, "connectionIdleTimeoutMs", &cit)) cfg.connection_idle_timeout_ms = cit;
+  uint32_t wt = 1;
+  if (get_uint32(env, config, "workerThreads", &wt) && wt > 0) cfg.worker_threads = wt;
+  std::string backend;
+  if (get_string(env, config, "captureBackend", &backend) && backend == "tpacket") {
+    cfg.backend = tcp_sniffer::CaptureBackend::kTpacket;
+  }
+  uint32_t rbs = 1048576;
+  if (get_uint32(env, config, "ringBlockSize", &rbs) && rbs > 0) cfg.ring_block_size = rbs;
+  uint32_t rbc = 8;
+  if (get_uint32(env, config, "ringBlockCount", &rbc) && rbc > 0) cfg.ring_block_count = rbc;
+  uint32_t rbt = 10;
+  if (get_uint32(env, config, "ringBlockTimeoutMs", &rbt)) cfg.ring_block_timeout_ms = rbt;
+  uint32_t snap = 65535;
+  if (get_uint32(env, config, "snaplen", &snap) && snap > 0) cfg.snaplen = snap;
+  get_bool(env, config, "kernelPrefilter", &cfg.kernel_prefilter);
+
+  tcp_sniffer::MessageQueueConfig qcfg;
+  uint32_t mbsz = 256;
+  if (get_uint32(env, config, "messageBatchSize", &mbsz) && mbsz > 0) qcfg.batch_size = mbsz;
+  uint32_t mbl = 10;
+  if (get_uint32(env, config, "messageBatchLatencyMs", &mbl)) qcfg.batch_latency_ms = mbl;
+  uint32_t mqc = 8192;
+  if (get_uint32(env, config, "messageQueueCapacity", &mqc) && mqc > 0) qcfg.capacity = mqc;
+  std::string policy;
+  if (get_string(env, config, "backpressurePolicy", &policy) && policy == "block") {
+    qcfg.policy = tcp_sniffer::BackpressurePolicy::kBlock;
+  }
+  // A file has no live traffic to protect: read it only as fast as messages are consumed.
+  if (!cfg.pcap_file.empty()) qcfg.policy = tcp_sniffer::BackpressurePolicy::kBlock;
+  std::string encoding;
+  bool binary_messages = get_string(env, config, "messageEncoding", &encoding) && encoding == "binary";
+  bool correlate = false;
+  get_bool(env, config, "correlateExchanges", &correlate);
+  bool load_shedding = false;
+  get_bool(env, config, "loadShedding", &load_shedding);
+  bool native_stdout = false;
+  get_bool(env, config, "nativeStdout", &native_stdout);
+  bool messages_to_js = true;
+  get_bool(env, config, "messagesToJs", &messages_to_js);
 
   if (g_engine == nullptr) g_engine = new tcp_sniffer::CaptureEngine();
 
   tcp_sniffer::ReassemblyConfig rcfg;
   rcfg.capture_ports = cfg.ports;
-  rcfg.max_concurrent_connections = cfg.max_concurrent_connections;
+  // The connection cap is split evenly across shards.
+  rcfg.max_concurrent_connections =
+      (cfg.max_concurrent_connections + cfg.worker_threads - 1) / cfg.worker_threads;
   rcfg.connection_idle_timeout_ms = cfg.connection_idle_timeout_ms;
+  uint32_t ooo = 262144;
+  if (get_uint32(env, config, "maxOutOfOrderBytes", &ooo)) rcfg.max_out_of_order_bytes = ooo;
+  std::string gap_policy;
+  if (get_string(env, config, "gapPolicy", &gap_policy) && gap_policy == "wait") {
+    rcfg.gap_policy = tcp_sniffer::GapPolicy::kWait;
+  }
+  uint32_t gto = 1000;
+  if (get_uint32(env, config, "gapTimeoutMs", &gto)) rcfg.gap_timeout_ms = gto;
+  rcfg.capture_clock = !cfg.pcap_file.empty();  // a file replays faster than it was recorded
+  stop_message_queue();
+  stop_stdout_writer();
+  g_binary_messages = binary_messages;
+  g_correlate_exchanges = correlate;
+  g_messages_to_js = messages_to_js;
   if (g_message_tsf != nullptr) {
     g_message_tsf->Release();
     delete g_message_tsf;
     g_message_tsf = nullptr;
   }
   if (info.Length() >= 2 && info[1].IsFunction()) {
+    // Unbounded TSF queue: the message queue's in-flight limit bounds it.
     g_message_tsf = new Napi::ThreadSafeFunction(
         Napi::ThreadSafeFunction::New(env, info[1].As<Napi::Function>(), "onMessage", 0, 1));
   }
+  if (native_stdout) {
+    g_stdout_writer = new tcp_sniffer::StdoutWriter();
+    g_stdout_writer->start();
+  }
+  if (g_message_tsf != nullptr || g_stdout_writer != nullptr) {
+    g_message_queue = new tcp_sniffer::MessageQueue(qcfg, deliver_batch);
+    g_message_queue->start();
+  }
+  g_messages_dropped = 0;
+  g_capture_to_delivery_us.reset();  // the previous queue's flusher has been joined
+  delete_end_callback();
+  if (!cfg.pcap_file.empty() && info.Length() >= 3 && info[2].IsFunction()) {
+    g_end_callback = new Napi::FunctionReference(Napi::Persistent(info[2].As<Napi::Function>()));
+  }
 
-  if (g_reassembler != nullptr) {
-    for (auto& p : g_http_parsers) delete p.second;
-    g_http_parsers.clear();
-    delete g_reassembler;
-  }
-  g_reassembler = new tcp_sniffer::Reassembler(rcfg);
-  size_t max_conn = rcfg.max_concurrent_connections;
-  size_t max_body = cfg.max_body_size;
-  g_reassembler->set_stream_chunk_callback([max_body](const tcp_sniffer::StreamChunk& chunk) {
-    std::string key = chunk.connection_id + (chunk.client_to_server ? ":req" : ":res");
-    auto it = g_http_parsers.find(key);
-    if (it == g_http_parsers.end()) {
-      tcp_sniffer::HttpStreamParser* p = new tcp_sniffer::HttpStreamParser(max_body);
-      p->set_connection_metadata(chunk.receiver_ip, chunk.receiver_port, chunk.dest_ip, chunk.dest_port);
-      p->set_message_callback([](const tcp_sniffer::HttpMessageData& m) {
-        if (g_message_tsf == nullptr) return;
-        MessagePayload* payload = new MessagePayload;
-        payload->receiver_ip = m.receiver_ip;
-        payload->receiver_port = m.receiver_port;
-        payload->dest_ip = m.dest_ip;
-        payload->dest_port = m.dest_port;
-        payload->is_request = m.is_request;
-        payload->method = m.method;
-        payload->path = m.path;
-        payload->status_code = m.status_code;
-        payload->headers = m.headers;
-        payload->body = m.body;
-        payload->body_truncated = m.body_truncated;
-        payload->body_encoding = m.body_encoding;
-        payload->timestamp = m.timestamp;
-        g_message_tsf->BlockingCall(payload, message_tsf_callback);
-      });
-      g_http_parsers[key] = p;
-      it = g_http_parsers.find(key);
-    }
-    if (!chunk.data.empty())
-      it->second->feed(chunk.data.data(), chunk.data.size());
-  });
-  tcp_sniffer::SegmentCallback on_seg = [max_conn](const tcp_sniffer::TcpSegment& seg) {
-    if (g_reassembler == nullptr) return;
-    g_reassembler->push_segment(seg);
-    if (g_reassembler->connection_count() > max_conn / 2) {
-      g_reassembler->evict_idle(g_reassembler->now_ms());
+  rcfg.max_body_size = cfg.max_body_size;
+  std::string capture_body;
+  if (get_string(env, config, "captureBody", &capture_body)) {
+    parse_capture_body(capture_body, cfg.max_body_size, &rcfg.max_body_size);
+  }
+  if (config.Has("captureBodyByPort") && config.Get("captureBodyByPort").IsObject()) {
+    Napi::Object by_port = config.Get("captureBodyByPort").As<Napi::Object>();
+    Napi::Array ports = by_port.GetPropertyNames();
+    for (uint32_t i = 0; i < ports.Length(); i++) {
+      std::string port = ports.Get(i).As<Napi::String>().Utf8Value();
+      std::string mode;
+      size_t limit = 0;
+      if (get_string(env, by_port, port.c_str(), &mode) && parse_capture_body(mode, cfg.max_body_size, &limit)) {
+        rcfg.max_body_size_by_port.emplace_back(static_cast<uint16_t>(std::strtoul(port.c_str(), nullptr, 10)), limit);
+      }
     }
+  }
+  // Filtered while headers are tokenized, so dropped and redacted values never reach JS.
+  get_lower_strings(env, config, "includeHeaders", &rcfg.header_filter.include);
+  get_lower_strings(env, config, "redactHeaders", &rcfg.header_filter.redact);
+  rcfg.sample_rate = cfg.sample_rate;
+  rcfg.correlate_exchanges = correlate;
+  delete_reassemblers();
+  delete_load_shedder();
+  // A capture file is read as fast as the pipeline runs, so it always looks overloaded.
+  if (load_shedding && cfg.pcap_file.empty()) g_load_shedder = new tcp_sniffer::LoadShedder();
+  rcfg.load_shedder = g_load_shedder;
+  for (size_t i = 0; i < cfg.worker_threads; ++i) {
+    auto* r = new tcp_sniffer::Reassembler(rcfg);
+    // Both per-direction parsers live in the shard's connection table.
+    r->set_message_callback(on_http_message);
+    g_reassemblers.push_back(r);
+  }
+  // Idle and cap eviction run incrementally inside push_segment.
+  tcp_sniffer::SegmentCallback on_seg = [](size_t worker, const tcp_sniffer::TcpSegment& seg) {
+    if (worker >= g_reassemblers.size()) return;
+    g_reassemblers[worker]->push_segment(seg);
   };
-  bool ok = g_engine->start(cfg, on_seg, [](const std::string&, const std::string&) {});
+  bool ok = g_engine->start(cfg, on_seg, [](const std::string&, const std::string&) {}, on_capture_complete);
   if (!ok) {
     Napi::Error::New(env, g_engine->last_error_message()).ThrowAsJavaScriptException();
     return env.Null();
   }
+  if (g_load_shedder != nullptr) g_load_shedder->start(make_load_sampler());
   return Napi::Boolean::New(env, true);
 #endif
 }
@@ -222,6 +546,13 @@ Napi::Value Stop(const Napi::CallbackInfo& info) {
   return env.Undefined();
 #else
   Napi::Object result = Napi::Object::New(env);
+  // This thread is the batch consumer, so lift the in-flight limit before joining
+  // capture threads that may be blocked on a full queue. The flusher may itself be
+  // waiting on a stalled stdout reader: stop waiting for it (after a bounded flush).
+  if (g_stdout_writer != nullptr) g_stdout_writer->begin_drain();
+  if (g_message_queue != nullptr) g_message_queue->begin_drain();
+  // The sampler reads the capture workers, so it stops first.
+  if (g_load_shedder != nullptr) g_load_shedder->stop();
   if (g_engine != nullptr) {
     g_engine->stop();
     if (g_engine->has_last_stats()) {
@@ -230,12 +561,14 @@ Napi::Value Stop(const Napi::CallbackInfo& info) {
       result.Set("packetsIfDropped", Napi::Number::New(env, static_cast<double>(g_engine->last_ps_ifdrop())));
     }
   }
-  if (g_reassembler != nullptr) {
-    delete g_reassembler;
-    g_reassembler = nullptr;
-  }
-  for (auto& p : g_http_parsers) delete p.second;
-  g_http_parsers.clear();
+  delete_reassemblers();
+  delete_load_shedder();
+  stop_message_queue();
+  stop_stdout_writer();
+  // Native log records still in the ring come out before stop() returns to JS.
+  tcp_sniffer::Logger::instance().flush();
+  result.Set("messagesDropped", Napi::Number::New(env, static_cast<double>(g_messages_dropped)));
+  delete_end_callback();
   if (g_message_tsf != nullptr) {
     g_message_tsf->Release();
     delete g_message_tsf;
@@ -245,6 +578,100 @@ Napi::Value Stop(const Napi::CallbackInfo& info) {
 #endif
 }
 
+/**
+ * Live counters and histograms (contract §3), summed over shards. Cheap enough to poll:
+ * relaxed loads plus one lock of the message queue.
+ */
+Napi::Value GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+#ifdef TCP_SNIFFER_STUB_ONLY
+  return env.Undefined();
+#else
+  Napi::Object o = Napi::Object::New(env);
+  auto set = [&](const char* key, uint64_t v) { o.Set(key, Napi::Number::New(env, static_cast<double>(v))); };
+  uint64_t decoded = 0, rejected = 0;
+  if (g_engine != nullptr) g_engine->packet_counts(&decoded, &rejected);
+  set("packetsDecoded", decoded);
+  set("packetsRejected", rejected);
+
+  uint64_t segments = 0, bytes = 0, ooo_bytes = 0, ooo_drops = 0, gaps = 0, gaps_skipped = 0, gap_bytes = 0;
+  uint64_t evictions_idle = 0, evictions_cap = 0, closes_fin = 0, closes_rst = 0, messages = 0, connections = 0;
+  uint64_t shed = 0, ignored = 0, segments_ignored = 0, headers_too_large = 0;
+  tcp_sniffer::HistogramSnapshot segment_ns, capture_to_parse;
+  for (const tcp_sniffer::Reassembler* r : g_reassemblers) {
+    const tcp_sniffer::ReassemblyStats& s = r->stats();
+    segments += s.segments.get();
+    bytes += s.bytes_reassembled.get();
+    ooo_bytes += s.out_of_order_bytes.get();
+    ooo_drops += s.out_of_order_drops.get();
+    gaps += s.gaps.get();
+    gaps_skipped += s.gaps_skipped.get();
+    gap_bytes += s.gap_bytes_skipped.get();
+    evictions_idle += s.evictions_idle.get();
+    evictions_cap += s.evictions_cap.get();
+    closes_fin += s.closes_fin.get();
+    closes_rst += s.closes_rst.get();
+    messages += s.messages_parsed.get();
+    connections += s.connections.get();
+    shed += s.segments_shed.get();
+    ignored += s.connections_ignored.get();
+    segments_ignored += s.segments_ignored.get();
+    headers_too_large += s.headers_too_large.get();
+    segment_ns.merge(s.segment_ns);
+    capture_to_parse.merge(s.capture_to_parse_us);
+  }
+  set("segments", segments);
+  set("bytesReassembled", bytes);
+  set("outOfOrderBytes", ooo_bytes);
+  set("outOfOrderDrops", ooo_drops);
+  set("gaps", gaps);
+  set("gapsSkipped", gaps_skipped);
+  set("gapBytesSkipped", gap_bytes);
+  set("evictionsIdle", evictions_idle);
+  set("evictionsCap", evictions_cap);
+  set("closesFin", closes_fin);
+  set("closesRst", closes_rst);
+  set("connections", connections);
+  set("messagesParsed", messages);
+  set("segmentsShed", shed);
+  set("connectionsIgnored", ignored);
+  set("segmentsIgnored", segments_ignored);
+  set("headersTooLarge", headers_too_large);
+
+  size_t queued = 0, in_flight = 0;
+  uint64_t dropped = g_messages_dropped;
+  if (g_message_queue != nullptr) {
+    g_message_queue->depth(&queued, &in_flight);
+    dropped = g_message_queue->dropped();
+  }
+  set("queueDepth", queued);
+  set("batchesInFlight", in_flight);
+  set("messagesDropped", dropped);
+  if (g_stdout_writer != nullptr) {
+    set("stdoutBytes", g_stdout_writer->bytes_written());
+    set("stdoutWrites", g_stdout_writer->writes());
+    set("stdoutDropped", g_stdout_writer->messages_dropped());
+  }
+
+  tcp_sniffer::HistogramSnapshot capture_to_delivery;
+  capture_to_delivery.merge(g_capture_to_delivery_us);
+  o.Set("segmentNs", histogram_to_object(env, segment_ns));
+  o.Set("captureToParseUs", histogram_to_object(env, capture_to_parse));
+  o.Set("captureToDeliveryUs", histogram_to_object(env, capture_to_delivery));
+  if (g_load_shedder != nullptr) {
+    tcp_sniffer::LoadSignals signals = g_load_shedder->signals();
+    Napi::Object shedding = Napi::Object::New(env);
+    shedding.Set("level", tcp_sniffer::shed_level_name(g_load_shedder->level()));
+    shedding.Set("transitions", Napi::Number::New(env, static_cast<double>(g_load_shedder->transitions())));
+    shedding.Set("queueFill", Napi::Number::New(env, signals.queue_fill));
+    shedding.Set("ringFill", Napi::Number::New(env, signals.ring_fill));
+    shedding.Set("busy", Napi::Number::New(env, signals.busy));
+    o.Set("loadShedding", shedding);
+  }
+  return o;
+#endif
+}
+
 Napi::Value IsRunning(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
 #ifdef TCP_SNIFFER_STUB_ONLY
@@ -275,6 +702,7 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports.Set("start", Napi::Function::New(env, addon::Start));
   exports.Set("stop", Napi::Function::New(env, addon::Stop));
   exports.Set("isRunning", Napi::Function::New(env, addon::IsRunning));
+  exports.Set("getStats", Napi::Function::New(env, addon::GetStats));
   exports.Set("getLastError", Napi::Function::New(env, addon::GetLastError));
   return exports;
 }
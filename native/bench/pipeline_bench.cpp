@@ -0,0 +1,423 @@
+/**
+ * TCP Sniffer — capture pipeline benchmark.
+ * Replays a .pcap/.pcapng file (pcap_open_offline) or a synthetic workload through
+ * PacketDecoder → Reassembler → HttpStreamParser, the chain CaptureEngine drives, and
+ * reports per-stage ns/packet, packets/s, messages/s and heap allocations per message.
+ * First checks that sampled flows spread over every pcapFile worker (flow_share).
+ * Build with `npm run bench:pipeline`. See docs/specs/CPP_ENGINE.md.
+ *
+ *   pipeline_bench [--pcap FILE] [--workload pipelined|chunked|ooo|all]
+ *                  [--connections N] [--rounds N] [--iterations N] [--rate PPS]
+ */
+
+#include "capture.hpp"
+#include "http_parser.hpp"
+#include "packet.hpp"
+#include "reassembly.hpp"
+#include <pcap.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace tcp_sniffer;
+
+namespace {
+
+// Every operator new in the process goes through the replacements below.
+size_t g_allocations = 0;
+volatile size_t g_sink;
+
+struct Packet {
+  uint64_t ts_us;
+  std::vector<uint8_t> bytes;
+};
+
+/** A workload: frames plus, for synthetic ones, each direction's byte stream (for the parse-only stage). */
+struct Workload {
+  std::string name;
+  LinkType link{LinkType::kEthernet};
+  std::vector<Packet> packets;
+  std::vector<std::string> streams;
+};
+
+struct Options {
+  std::string pcap_path;
+  std::string workload{"all"};
+  size_t connections{64};
+  size_t rounds{200};
+  size_t iterations{5};
+  double rate_pps{0};  // 0 = full speed
+};
+
+constexpr uint16_t kServerPort = 8080;
+constexpr size_t kMss = 1448;
+
+void put16(uint8_t* p, uint16_t v) {
+  p[0] = static_cast<uint8_t>(v >> 8);
+  p[1] = static_cast<uint8_t>(v);
+}
+
+void put32(uint8_t* p, uint32_t v) {
+  put16(p, static_cast<uint16_t>(v >> 16));
+  put16(p + 2, static_cast<uint16_t>(v));
+}
+
+/** Ethernet + IPv4 + TCP frame carrying payload (PSH|ACK unless flags say otherwise). */
+std::vector<uint8_t> frame(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport, uint32_t seq,
+                           const char* payload, size_t len, uint8_t flags = 0x18) {
+  std::vector<uint8_t> p(14 + 20 + 20 + len);
+  put16(p.data() + 12, 0x0800);
+  uint8_t* ip = p.data() + 14;
+  ip[0] = 0x45;
+  put16(ip + 2, static_cast<uint16_t>(40 + len));
+  ip[8] = 64;
+  ip[9] = 6;
+  put32(ip + 12, src);
+  put32(ip + 16, dst);
+  uint8_t* tcp = ip + 20;
+  put16(tcp, sport);
+  put16(tcp + 2, dport);
+  put32(tcp + 4, seq);
+  tcp[12] = 0x50;
+  tcp[13] = flags;
+  std::memcpy(tcp + 20, payload, len);
+  return p;
+}
+
+/** One connection's two directions, cut into MSS-sized segments. */
+struct Flow {
+  uint32_t client;
+  uint16_t client_port;
+  uint32_t client_seq{1000};
+  uint32_t server_seq{5000};
+};
+
+void emit(Workload& w, const Flow& f, bool from_client, uint32_t seq, const std::string& data, size_t off,
+          size_t len, uint64_t ts) {
+  uint32_t server = 0x0a000001;
+  w.packets.push_back(
+      {ts, from_client ? frame(f.client, f.client_port, server, kServerPort, seq, data.data() + off, len)
+                       : frame(server, kServerPort, f.client, f.client_port, seq, data.data() + off, len)});
+}
+
+/** Segments of data in order, or with neighbouring pairs swapped and a few retransmits. */
+void send(Workload& w, Flow& f, bool from_client, const std::string& data, bool reorder, std::mt19937& rng,
+          uint64_t& ts) {
+  uint32_t& seq = from_client ? f.client_seq : f.server_seq;
+  std::vector<std::pair<size_t, size_t>> segs;
+  for (size_t off = 0; off < data.size(); off += kMss) segs.push_back({off, std::min(kMss, data.size() - off)});
+  if (reorder) {
+    for (size_t i = 0; i + 1 < segs.size(); i += 2) std::swap(segs[i], segs[i + 1]);
+  }
+  for (const auto& [off, len] : segs) {
+    emit(w, f, from_client, seq + static_cast<uint32_t>(off), data, off, len, ts++);
+    if (reorder && rng() % 20 == 0) emit(w, f, from_client, seq + static_cast<uint32_t>(off), data, off, len, ts++);
+  }
+  seq += static_cast<uint32_t>(data.size());
+}
+
+std::string request(size_t i, size_t body) {
+  std::string r = (body ? "POST" : "GET");
+  r += " /api/v1/items/" + std::to_string(i) + " HTTP/1.1\r\nHost: bench.internal\r\n"
+       "User-Agent: pipeline-bench/1.0\r\nAccept: application/json\r\n";
+  if (body) r += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body) + "\r\n";
+  r += "\r\n";
+  return r + std::string(body, 'q');
+}
+
+std::string response(size_t body, bool chunked) {
+  std::string r = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nServer: bench\r\n";
+  if (!chunked) return r + "Content-Length: " + std::to_string(body) + "\r\n\r\n" + std::string(body, 'r');
+  r += "Transfer-Encoding: chunked\r\n\r\n";
+  const size_t piece = 512;
+  for (size_t done = 0; done < body; done += piece) {
+    size_t n = std::min(piece, body - done);
+    char size[16];
+    std::snprintf(size, sizeof(size), "%zx\r\n", n);
+    r += size + std::string(n, 'c') + "\r\n";
+  }
+  return r + "0\r\n\r\n";
+}
+
+/**
+ * pipelined: 8 GETs per client segment, 8 small responses per server segment.
+ * chunked: one GET, then a 16 KiB chunked response spread over MSS segments.
+ * ooo: POSTs with 6 KiB bodies, segment pairs swapped and ~5% retransmitted.
+ */
+Workload synthetic(const std::string& kind, const Options& opt) {
+  Workload w;
+  w.name = kind;
+  std::mt19937 rng(42);
+  std::vector<Flow> flows;
+  for (size_t c = 0; c < opt.connections; ++c) {
+    flows.push_back({0x0a010000u + static_cast<uint32_t>(c), static_cast<uint16_t>(40000 + c)});
+  }
+  w.streams.resize(2 * flows.size());
+  uint64_t ts = 1700000000000000ull;
+  // Handshake first, so a reordered first segment is not taken for the start of the stream.
+  for (const Flow& f : flows) {
+    w.packets.push_back({ts++, frame(f.client, f.client_port, 0x0a000001, kServerPort, f.client_seq - 1, "", 0, 0x02)});
+    w.packets.push_back({ts++, frame(0x0a000001, kServerPort, f.client, f.client_port, f.server_seq - 1, "", 0, 0x12)});
+  }
+  for (size_t round = 0; round < opt.rounds; ++round) {
+    for (size_t c = 0; c < flows.size(); ++c) {
+      std::string req;
+      std::string res;
+      if (kind == "pipelined") {
+        for (size_t i = 0; i < 8; ++i) {
+          req += request(round * 8 + i, 0);
+          res += response(64, false);
+        }
+      } else if (kind == "chunked") {
+        req = request(round, 0);
+        res = response(16384, true);
+      } else {
+        req = request(round, 6144);
+        res = response(256, false);
+      }
+      send(w, flows[c], true, req, kind == "ooo", rng, ts);
+      send(w, flows[c], false, res, kind == "ooo", rng, ts);
+      w.streams[2 * c] += req;
+      w.streams[2 * c + 1] += res;
+    }
+  }
+  return w;
+}
+
+bool load_pcap(const std::string& path, Workload* w) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+  pcap_t* p = pcap_open_offline(path.c_str(), errbuf);  // pcapng too (libpcap >= 1.1)
+  if (p == nullptr) {
+    std::fprintf(stderr, "pcap_open_offline: %s\n", errbuf);
+    return false;
+  }
+  if (!link_type_for_dlt(pcap_datalink(p), &w->link)) {
+    std::fprintf(stderr, "unsupported datalink %d\n", pcap_datalink(p));
+    pcap_close(p);
+    return false;
+  }
+  w->name = path;
+  pcap_pkthdr* h;
+  const u_char* data;
+  while (pcap_next_ex(p, &h, &data) == 1) {
+    uint64_t ts = static_cast<uint64_t>(h->ts.tv_sec) * 1000000u + static_cast<uint64_t>(h->ts.tv_usec);
+    w->packets.push_back({ts, std::vector<uint8_t>(data, data + h->caplen)});
+  }
+  pcap_close(p);
+  return true;
+}
+
+double elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Reassembly config for the workload: the synthetic server port, or every port seen in the capture. */
+ReassemblyConfig reassembly_config(const std::vector<TcpSegment>& segments, bool synthetic) {
+  ReassemblyConfig rc;
+  rc.max_concurrent_connections = 100000;
+  if (synthetic) {
+    rc.capture_ports = {kServerPort};
+    return rc;
+  }
+  // The lower port of each segment is taken as the server side.
+  for (const TcpSegment& s : segments) {
+    uint16_t port = std::min(s.tuple.src_port, s.tuple.dst_port);
+    if (std::find(rc.capture_ports.begin(), rc.capture_ports.end(), port) == rc.capture_ports.end()) {
+      rc.capture_ports.push_back(port);
+    }
+  }
+  return rc;
+}
+
+void run(const Workload& w, const Options& opt) {
+  size_t bytes = 0;
+  for (const Packet& p : w.packets) bytes += p.bytes.size();
+  std::printf("%s: %zu packets, %.1f MiB\n", w.name.c_str(), w.packets.size(), bytes / 1048576.0);
+  if (w.packets.empty()) return;
+
+  // Stage 1: link/IP/TCP decode, with the decoder chosen once for the link type and
+  // the next frame prefetched, as the TPACKET ring walk does.
+  std::vector<TcpSegment> segments(w.packets.size());
+  size_t decoded = 0;
+  double decode_ns = 1e300;
+  for (size_t it = 0; it < opt.iterations; ++it) {
+    auto start = std::chrono::steady_clock::now();
+    decoded = with_packet_decoder(w.link, [&](auto decoder) {
+      size_t n = 0;
+      for (size_t i = 0; i < w.packets.size(); ++i) {
+        const Packet& p = w.packets[i];
+        if (i + 1 < w.packets.size()) __builtin_prefetch(w.packets[i + 1].bytes.data());
+        if (decltype(decoder)::decode(p.bytes.data(), p.bytes.size(), segments[n])) segments[n++].ts_us = p.ts_us;
+      }
+      return n;
+    });
+    decode_ns = std::min(decode_ns, elapsed_ns(start));
+  }
+  segments.resize(decoded);
+
+  // Stage 2: reassembly and HTTP parsing of the decoded segments, a fresh reassembler
+  // per iteration. With --rate, segments are paced and only time inside push_segment counts.
+  ReassemblyConfig rc = reassembly_config(segments, !w.streams.empty());
+  double pipeline_ns = 1e300;
+  size_t messages = 0;
+  size_t allocations = 0;
+  for (size_t it = 0; it < opt.iterations; ++it) {
+    Reassembler r(rc);
+    size_t count = 0;
+    r.set_message_callback([&](HttpMessageData&& m) {
+      count++;
+      g_sink = m.body.size();
+    });
+    size_t allocs_before = g_allocations;
+    double busy = 0;
+    if (opt.rate_pps > 0) {
+      auto interval = std::chrono::duration<double>(1.0 / opt.rate_pps);
+      auto next = std::chrono::steady_clock::now();
+      for (const TcpSegment& s : segments) {
+        std::this_thread::sleep_until(next);
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+        auto start = std::chrono::steady_clock::now();
+        r.push_segment(s);
+        busy += elapsed_ns(start);
+      }
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      for (const TcpSegment& s : segments) r.push_segment(s);
+      busy = elapsed_ns(start);
+    }
+    r.flush_exchanges();
+    if (busy < pipeline_ns) {
+      pipeline_ns = busy;
+      messages = count;
+      allocations = g_allocations - allocs_before;
+    }
+    if (opt.rate_pps > 0) break;  // one paced pass is enough
+  }
+
+  // Stage 3 (synthetic only): the parsers alone over the same byte streams, fed in MSS pieces.
+  double parse_ns = 0;
+  size_t parsed = 0;
+  if (!w.streams.empty()) {
+    parse_ns = 1e300;
+    for (size_t it = 0; it < opt.iterations; ++it) {
+      HttpStreamParser parser;
+      size_t count = 0;
+      parser.set_message_callback([&](HttpMessageData&&) { count++; });
+      auto start = std::chrono::steady_clock::now();
+      for (const std::string& s : w.streams) {
+        parser.reset();
+        const uint8_t* d = reinterpret_cast<const uint8_t*>(s.data());
+        for (size_t off = 0; off < s.size(); off += kMss) parser.feed(d + off, std::min(kMss, s.size() - off), 1);
+      }
+      parse_ns = std::min(parse_ns, elapsed_ns(start));
+      parsed = count;
+    }
+  }
+
+  double n = static_cast<double>(w.packets.size());
+  double total_s = (decode_ns + pipeline_ns) / 1e9;
+  std::printf("  decode            %8.1f ns/packet  (%zu TCP of %zu)\n", decode_ns / n, decoded, w.packets.size());
+  std::printf("  reassemble+parse  %8.1f ns/packet%s\n", pipeline_ns / n, opt.rate_pps > 0 ? "  (busy time, paced)" : "");
+  if (parsed > 0) std::printf("  parse only        %8.1f ns/message (%zu messages)\n", parse_ns / parsed, parsed);
+  std::printf("  throughput        %8.0f packets/s  %8.0f messages/s\n", n / total_s, messages / total_s);
+  std::printf("  messages          %zu, %.2f allocations/message\n", messages,
+              messages ? static_cast<double>(allocations) / messages : 0.0);
+}
+
+/**
+ * pcapFile workers split flows with flow_share; with sampling on, the flows kept
+ * (by flow_hash's high bits) must still spread over every worker. Each share must get
+ * at least half of an even split of 200k random sampled tuples.
+ */
+bool check_flow_shares() {
+  std::mt19937 rng(42);
+  for (double rate : {0.1, 0.25, 0.5, 1.0}) {
+    uint32_t threshold = sample_threshold(rate);
+    for (size_t shares : {2, 4, 8}) {
+      std::vector<size_t> counts(shares);
+      size_t kept = 0;
+      while (kept < 200000) {
+        FourTuple t;
+        t.src_ip.family = t.dst_ip.family = 4;
+        uint32_t src = rng(), dst = rng();
+        std::memcpy(t.src_ip.bytes, &src, 4);
+        std::memcpy(t.dst_ip.bytes, &dst, 4);
+        t.src_port = static_cast<uint16_t>(rng());
+        t.dst_port = kServerPort;
+        if (threshold < 65536 && (flow_hash(t) >> 16) >= threshold) continue;
+        counts[flow_share(t, shares)]++;
+        kept++;
+      }
+      for (size_t i = 0; i < shares; ++i) {
+        if (counts[i] < kept / shares / 2) {
+          std::fprintf(stderr, "flow_share: sampleRate %.2f, %zu shares: share %zu got %zu of %zu flows\n", rate,
+                       shares, i, counts[i], kept);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool parse_args(int argc, char** argv, Options* opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (v == nullptr) return false;
+    if (a == "--pcap") opt->pcap_path = v;
+    else if (a == "--workload") opt->workload = v;
+    else if (a == "--connections") opt->connections = std::strtoull(v, nullptr, 10);
+    else if (a == "--rounds") opt->rounds = std::strtoull(v, nullptr, 10);
+    else if (a == "--iterations") opt->iterations = std::max<size_t>(1, std::strtoull(v, nullptr, 10));
+    else if (a == "--rate") opt->rate_pps = std::strtod(v, nullptr);
+    else return false;
+    ++i;
+  }
+  return true;
+}
+
+}  // namespace
+
+void* operator new(size_t n) {
+  g_allocations++;
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parse_args(argc, argv, &opt)) {
+    std::fprintf(stderr,
+                 "usage: %s [--pcap FILE] [--workload pipelined|chunked|ooo|all] [--connections N]"
+                 " [--rounds N] [--iterations N] [--rate PPS]\n",
+                 argv[0]);
+    return 2;
+  }
+  if (!check_flow_shares()) return 1;
+  if (!opt.pcap_path.empty()) {
+    Workload w;
+    if (!load_pcap(opt.pcap_path, &w)) return 1;
+    run(w, opt);
+    return 0;
+  }
+  for (const char* kind : {"pipelined", "chunked", "ooo"}) {
+    if (opt.workload == "all" || opt.workload == kind) run(synthetic(kind, opt), opt);
+  }
+  return 0;
+}
@@ -4,7 +4,13 @@
  */
 
 #include "capture.hpp"
+#include "log.hpp"
 #include <pcap.h>
+#include <linux/if_packet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <cstring>
 #include <thread>
@@ -13,27 +19,92 @@ namespace tcp_sniffer {
 
 namespace {
 
-void packet_handler(u_char* user, const struct pcap_pkthdr* h, const u_char* bytes) {
-  auto* engine = reinterpret_cast<CaptureEngine*>(user);
-  (void)engine;  // used when we pass engine as user
+/** Fanout group ids are per network namespace; derive one per process and start(). */
+int next_fanout_group() {
+  static std::atomic<unsigned> counter{0};
+  return static_cast<int>((static_cast<unsigned>(getpid()) + counter++) & 0xffff);
+}
+
+/** Ethernet only: also match frames with one VLAN tag left in place (libpcap's "vlan" shifts the offsets). */
+std::string with_vlan(const std::string& filter) {
+  return "(" + filter + ") or (vlan and (" + filter + "))";
+}
+
+}  // namespace
+
+bool link_type_for_dlt(int dlt, LinkType* out) {
+  switch (dlt) {
+    case DLT_EN10MB:
+      *out = LinkType::kEthernet;
+      return true;
+    case DLT_LINUX_SLL:
+      *out = LinkType::kLinuxSll;
+      return true;
+#ifdef DLT_LINUX_SLL2
+    case DLT_LINUX_SLL2:
+      *out = LinkType::kLinuxSll2;
+      return true;
+#endif
+    case DLT_RAW:
+#ifdef DLT_IPV4
+    case DLT_IPV4:
+    case DLT_IPV6:
+#endif
+      *out = LinkType::kRaw;
+      return true;
+    default:
+      return false;
+  }
+}
+
+template <typename Decoder>
+void CaptureEngine::packet_handler(unsigned char* user, const pcap_pkthdr* h, const unsigned char* bytes) {
+  // Segment lives on the stack and its payload views the pcap buffer: no per-packet allocation.
   TcpSegment seg;
-  if (decode_packet(bytes, h->caplen, seg)) {
-    // Callback will be invoked from run_loop via dispatch; we need engine to get callback.
-    // pcap_loop is single-threaded per handle, so we can store callback in engine and call it here.
-    // We pass engine as user and need to call its segment callback. So we need a wrapper that
-    // has the callback. Easiest: pass a pointer to a struct { CaptureEngine* engine } and
-    // engine->on_segment(seg). But on_segment_ is private. So either make a public dispatch
-    // or use a static/capture. Actually we pass (this) as user and in the handler we cast to
-    // CaptureEngine* and call a public method like dispatch_segment(seg). Add that.
-    CaptureEngine* eng = reinterpret_cast<CaptureEngine*>(user);
-    eng->dispatch_segment(seg);
+  Worker* worker = reinterpret_cast<Worker*>(user);
+  if (Decoder::decode(bytes, h->caplen, seg)) {
+    if (worker->shares > 1 && flow_share(seg.tuple, worker->shares) != worker->index) return;
+    worker->decoded.add();
+    seg.ts_us = static_cast<uint64_t>(h->ts.tv_sec) * 1000000u + static_cast<uint64_t>(h->ts.tv_usec);
+    worker->engine->dispatch_segment(worker->index, seg);
+  } else if (worker->index == 0 || worker->shares == 1) {  // file workers all see every packet
+    worker->rejected.add();
   }
 }
 
-}  // namespace
+void CaptureEngine::ring_handler(void* user, const uint8_t* data, size_t caplen, uint32_t ts_sec,
+                                 uint32_t ts_nsec) {
+  TcpSegment seg;
+  Worker* worker = static_cast<Worker*>(user);
+  // Ring sockets are SOCK_DGRAM: every frame starts at its IP header (open_ring_worker).
+  if (PacketDecoder<LinkType::kRaw>::decode(data, caplen, seg)) {
+    worker->decoded.add();
+    seg.ts_us = static_cast<uint64_t>(ts_sec) * 1000000u + ts_nsec / 1000u;
+    worker->engine->dispatch_segment(worker->index, seg);
+  } else {
+    worker->rejected.add();
+  }
+}
+
+void CaptureEngine::dispatch_segment(size_t worker, const TcpSegment& seg) {
+  if (on_segment_) on_segment_(worker, seg);
+}
 
-void CaptureEngine::dispatch_segment(const TcpSegment& seg) {
-  if (on_segment_) on_segment_(seg);
+void CaptureEngine::packet_counts(uint64_t* decoded, uint64_t* rejected) const {
+  *decoded = 0;
+  *rejected = 0;
+  for (const auto& w : workers_) {
+    *decoded += w->decoded.get();
+    *rejected += w->rejected.get();
+  }
+}
+
+double CaptureEngine::ring_fill() const {
+  double fill = 0;
+  for (const auto& w : workers_) {
+    if (w->ring) fill = std::max(fill, w->ring->fill());
+  }
+  return fill;
 }
 
 CaptureEngine::CaptureEngine() = default;
@@ -42,119 +113,303 @@ CaptureEngine::~CaptureEngine() {
   stop();
 }
 
-std::string CaptureEngine::build_bpf_filter(const std::vector<uint16_t>& ports) const {
-  if (ports.empty()) return "tcp";
-  std::string filter = "tcp port " + std::to_string(ports[0]);
+std::string CaptureEngine::build_bpf_filter(const CaptureConfig& config) const {
+  const std::vector<uint16_t>& ports = config.ports;
+  if (ports.empty() && !config.kernel_prefilter) return "tcp";
+  std::string filter = ports.empty() ? "tcp" : "tcp port " + std::to_string(ports[0]);
   for (size_t i = 1; i < ports.size(); ++i) {
     filter += " or tcp port " + std::to_string(ports[i]);
   }
-  return filter;
+  if (!config.kernel_prefilter) return filter;
+
+  // IPv4 only: IPv6 may carry extension headers, so its packets pass and are judged in
+  // userspace. Payload = IP total length - IP header - TCP header.
+  std::string ipv4 =
+      "(tcp[tcpflags] & (tcp-syn|tcp-fin|tcp-rst) != 0"
+      " or ip[2:2] - ((ip[0] & 0xf) << 2) - ((tcp[12] & 0xf0) >> 2) != 0)";
+  uint32_t threshold = sample_threshold(config.sample_rate);
+  if (threshold < 65536) {
+    // flow_hash() over the header fields; BPF arithmetic is 32-bit, as is the multiply.
+    ipv4 += " and ((ip[12:4] ^ ip[16:4] ^ tcp[0:2] ^ tcp[2:2]) * 2654435761) >> 16 < " + std::to_string(threshold);
+  }
+  return "(" + filter + ") and (ip6 or (ip and " + ipv4 + "))";
 }
 
 void CaptureEngine::report_error(const std::string& code, const std::string& message) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
   last_error_code_ = code;
   last_error_message_ = message;
   if (on_error_) on_error_(code, message);
 }
 
+bool CaptureEngine::open_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                                int fanout_arg) {
+  if (!config_.pcap_file.empty()) return open_file_worker(worker, filter);
+  if (config_.backend == CaptureBackend::kTpacket) return open_ring_worker(worker, iface, filter, fanout_arg);
+  return open_pcap_worker(worker, iface, filter, fanout_arg);
+}
+
+bool CaptureEngine::open_pcap_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                                     int fanout_arg) {
+  char errbuf[PCAP_ERRBUF_SIZE];
+  worker.handle = pcap_create(iface.c_str(), errbuf);
+  if (worker.handle == nullptr) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_create: ") + errbuf);
+    return false;
+  }
+  // Sized kernel buffer and a short (or immediate) read timeout instead of
+  // pcap_open_live's defaults of a ~2 MiB buffer and 1 s batching delay.
+  pcap_set_snaplen(worker.handle, static_cast<int>(config_.snaplen));
+  pcap_set_promisc(worker.handle, 1);
+  pcap_set_buffer_size(worker.handle, static_cast<int>(config_.ring_block_size * config_.ring_block_count));
+  if (config_.ring_block_timeout_ms == 0) {
+    pcap_set_immediate_mode(worker.handle, 1);
+  } else {
+    pcap_set_timeout(worker.handle, static_cast<int>(config_.ring_block_timeout_ms));
+  }
+  int status = pcap_activate(worker.handle);
+  if (status < 0) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_activate: ") + pcap_geterr(worker.handle));
+    close_worker(worker);
+    return false;
+  }
+
+  // Decode the interface's own framing ("any" is Linux cooked capture); fall back to
+  // asking for Ethernet only when there is no decoder for it.
+  int dlt = pcap_datalink(worker.handle);
+  if (!link_type_for_dlt(dlt, &worker.link)) {
+    if (pcap_set_datalink(worker.handle, DLT_EN10MB) != 0) {
+      const char* name = pcap_datalink_val_to_name(dlt);
+      report_error("CAPTURE_OPEN_FAILED", std::string("unsupported datalink type ") + (name ? name : std::to_string(dlt)));
+      close_worker(worker);
+      return false;
+    }
+    worker.link = LinkType::kEthernet;
+  }
+
+  if (!set_pcap_filter(worker, filter)) return false;
+
+  // Join the fanout group: the kernel hashes each packet's flow (symmetrically, so
+  // both directions agree) and delivers it to exactly one socket in the group.
+  if (fanout_arg != 0 &&
+      setsockopt(pcap_fileno(worker.handle), SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) != 0) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("setsockopt(PACKET_FANOUT): ") + std::strerror(errno));
+    close_worker(worker);
+    return false;
+  }
+  return true;
+}
+
+/** Compile filter for the handle's datalink and install it; closes the worker on failure. */
+bool CaptureEngine::set_pcap_filter(Worker& worker, const std::string& filter) {
+  std::string link_filter = worker.link == LinkType::kEthernet ? with_vlan(filter) : filter;
+  worker.program = new bpf_program{};
+  if (pcap_compile(worker.handle, worker.program, link_filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_compile: ") + pcap_geterr(worker.handle));
+    delete worker.program;
+    worker.program = nullptr;
+    close_worker(worker);
+    return false;
+  }
+  if (pcap_setfilter(worker.handle, worker.program) != 0) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_setfilter: ") + pcap_geterr(worker.handle));
+    close_worker(worker);
+    return false;
+  }
+  return true;
+}
+
+bool CaptureEngine::open_file_worker(Worker& worker, const std::string& filter) {
+  // Every worker reads the whole file (from the page cache after the first) and keeps
+  // its share of flows, so shards stay per-thread as with fanout. Decoding is cheap
+  // next to reassembly and parsing, which are split.
+  char errbuf[PCAP_ERRBUF_SIZE];
+  worker.handle = pcap_open_offline(config_.pcap_file.c_str(), errbuf);  // pcap or pcapng
+  if (worker.handle == nullptr) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_open_offline: ") + errbuf);
+    return false;
+  }
+  int dlt = pcap_datalink(worker.handle);
+  if (!link_type_for_dlt(dlt, &worker.link)) {
+    const char* name = pcap_datalink_val_to_name(dlt);
+    report_error("CAPTURE_OPEN_FAILED", std::string("unsupported datalink type ") + (name ? name : std::to_string(dlt)));
+    close_worker(worker);
+    return false;
+  }
+  worker.shares = config_.worker_threads;
+  return set_pcap_filter(worker, filter);
+}
+
+bool CaptureEngine::open_ring_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                                     int fanout_arg) {
+  // libpcap is only used to compile the filter; the ring socket runs it in the kernel.
+  // SOCK_DGRAM frames have no link header whatever the device, so the filter and the
+  // decoder are those of raw IP.
+  worker.link = LinkType::kRaw;
+  pcap* dead = pcap_open_dead(DLT_RAW, static_cast<int>(config_.snaplen));
+  if (dead == nullptr) {
+    report_error("CAPTURE_OPEN_FAILED", "pcap_open_dead failed");
+    return false;
+  }
+  worker.program = new bpf_program{};
+  if (pcap_compile(dead, worker.program, filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_compile: ") + pcap_geterr(dead));
+    delete worker.program;
+    worker.program = nullptr;
+    pcap_close(dead);
+    return false;
+  }
+  pcap_close(dead);
+
+  TpacketConfig rc;
+  rc.block_size = config_.ring_block_size;
+  rc.block_count = config_.ring_block_count;
+  rc.block_timeout_ms = config_.ring_block_timeout_ms;
+  rc.snaplen = config_.snaplen;
+  worker.ring = std::make_unique<TpacketRing>();
+  std::string error;
+  if (!worker.ring->open(iface, rc, worker.program, fanout_arg, &error)) {
+    report_error("CAPTURE_OPEN_FAILED", error);
+    close_worker(worker);
+    return false;
+  }
+  return true;
+}
+
+void CaptureEngine::close_worker(Worker& worker) {
+  if (worker.program != nullptr) {
+    pcap_freecode(worker.program);
+    delete worker.program;
+    worker.program = nullptr;
+  }
+  if (worker.handle != nullptr) {
+    pcap_close(worker.handle);
+    worker.handle = nullptr;
+  }
+  worker.ring.reset();
+}
+
+void CaptureEngine::close_all_workers() {
+  for (auto& w : workers_) close_worker(*w);
+  workers_.clear();
+}
+
 bool CaptureEngine::start(const CaptureConfig& config,
                           SegmentCallback on_segment,
-                          ErrorCallback on_error) {
+                          ErrorCallback on_error,
+                          CompleteCallback on_complete) {
   if (running_) {
     report_error("UNRECOVERABLE", "capture already running");
     return false;
   }
   config_ = config;
+  if (config_.worker_threads == 0) config_.worker_threads = 1;
   on_segment_ = std::move(on_segment);
   on_error_ = std::move(on_error);
+  on_complete_ = std::move(on_complete);
   last_error_code_.clear();
   last_error_message_.clear();
+  last_stats_valid_ = false;
 
-  char errbuf[PCAP_ERRBUF_SIZE];
-  std::string iface = config_.interface_name.empty() ? "any" : config_.interface_name;
-  pcap_handle_ = pcap_open_live(iface.c_str(), 65535, 1, 1000, errbuf);
-  if (pcap_handle_ == nullptr) {
-    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_open_live: ") + errbuf);
-    return false;
+  bool offline = !config_.pcap_file.empty();
+  std::string iface = offline ? config_.pcap_file : config_.interface_name.empty() ? "any" : config_.interface_name;
+  std::string filter_str = build_bpf_filter(config_);
+  int fanout_arg = 0;
+  if (config_.worker_threads > 1 && !offline) {
+    fanout_arg = next_fanout_group() | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
   }
 
-  if (pcap_set_datalink(pcap_handle_, DLT_EN10MB) != 0) {
-    pcap_close(pcap_handle_);
-    pcap_handle_ = nullptr;
-    report_error("CAPTURE_OPEN_FAILED", "pcap_set_datalink(EN10MB) failed");
-    return false;
-  }
-
-  std::string filter_str = build_bpf_filter(config_.ports);
-  bpf_program_ = new bpf_program{};
-  if (pcap_compile(pcap_handle_, bpf_program_, filter_str.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
-    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_compile: ") + pcap_geterr(pcap_handle_));
-    pcap_close(pcap_handle_);
-    pcap_handle_ = nullptr;
-    delete bpf_program_;
-    bpf_program_ = nullptr;
-    return false;
-  }
-  if (pcap_setfilter(pcap_handle_, bpf_program_) != 0) {
-    report_error("CAPTURE_OPEN_FAILED", std::string("pcap_setfilter: ") + pcap_geterr(pcap_handle_));
-    pcap_freecode(bpf_program_);
-    delete bpf_program_;
-    pcap_close(pcap_handle_);
-    pcap_handle_ = nullptr;
-    bpf_program_ = nullptr;
-    return false;
+  for (size_t i = 0; i < config_.worker_threads; ++i) {
+    auto worker = std::make_unique<Worker>();
+    worker->engine = this;
+    worker->index = i;
+    if (!open_worker(*worker, iface, filter_str, fanout_arg)) {
+      close_all_workers();
+      return false;
+    }
+    workers_.push_back(std::move(worker));
   }
 
   // A5: startup log (structured: interface, ports)
-  fprintf(stderr, "{\"timestamp\":\"startup\",\"level\":\"info\",\"message\":\"capture started\",\"interface\":\"%s\",\"ports\":[",
-          iface.c_str());
+  std::string ports;
   for (size_t i = 0; i < config_.ports.size(); i++) {
-    fprintf(stderr, "%u", static_cast<unsigned>(config_.ports[i]));
-    if (i + 1 < config_.ports.size()) fprintf(stderr, ",");
+    if (i > 0) ports += ',';
+    ports += std::to_string(config_.ports[i]);
+  }
+  Logger& log = Logger::instance();
+  if (log.admit(LogEvent::kCaptureStarted)) {
+    log.write(LogEvent::kCaptureStarted, "\"interface\":\"%s\",\"workers\":%zu,\"backend\":\"%s\",\"ports\":[%s]",
+              json_escape(iface).c_str(), workers_.size(),
+              offline ? "file" : config_.backend == CaptureBackend::kTpacket ? "tpacket" : "pcap", ports.c_str());
   }
-  fprintf(stderr, "]}\n");
 
   running_ = true;
   stop_requested_ = false;
-  capture_thread_ = std::thread(&CaptureEngine::run_loop, this);
+  active_workers_ = workers_.size();
+  for (auto& w : workers_) {
+    w->thread = std::thread(&CaptureEngine::run_loop, this, w.get());
+  }
   return true;
 }
 
 void CaptureEngine::stop() {
-  if (!running_ && pcap_handle_ == nullptr) return;
+  if (!running_ && workers_.empty()) return;
   stop_requested_ = true;
-  if (pcap_handle_ != nullptr) {
-    pcap_breakloop(pcap_handle_);
+  for (auto& w : workers_) {
+    if (w->handle != nullptr) pcap_breakloop(w->handle);
   }
-  if (capture_thread_.joinable()) {
-    capture_thread_.join();
+  for (auto& w : workers_) {
+    if (w->thread.joinable()) w->thread.join();
   }
   running_ = false;
-  if (pcap_handle_ != nullptr) {
-    struct pcap_stat ps;
-    if (pcap_stats(pcap_handle_, &ps) == 0) {
-      last_ps_recv_ = ps.ps_recv;
-      last_ps_drop_ = ps.ps_drop;
-      last_ps_ifdrop_ = ps.ps_ifdrop;
-      last_stats_valid_ = true;
+
+  unsigned int recv = 0, drop = 0, ifdrop = 0;
+  bool any_stats = false;
+  for (auto& w : workers_) {
+    unsigned int ring_recv = 0, ring_drop = 0;
+    if (w->ring != nullptr && w->ring->stats(&ring_recv, &ring_drop)) {
+      recv += ring_recv;
+      drop += ring_drop;
+      any_stats = true;
+      continue;
     }
-    if (bpf_program_ != nullptr) {
-      pcap_freecode(bpf_program_);
-      delete bpf_program_;
-      bpf_program_ = nullptr;
+    struct pcap_stat ps;
+    if (w->handle != nullptr && pcap_stats(w->handle, &ps) == 0) {
+      recv += ps.ps_recv;
+      drop += ps.ps_drop;
+      ifdrop += ps.ps_ifdrop;
+      any_stats = true;
     }
-    pcap_close(pcap_handle_);
-    pcap_handle_ = nullptr;
   }
+  if (any_stats) {
+    last_ps_recv_ = recv;
+    last_ps_drop_ = drop;
+    last_ps_ifdrop_ = ifdrop;
+    last_stats_valid_ = true;
+  }
+  close_all_workers();
 }
 
-void CaptureEngine::run_loop() {
-  if (pcap_handle_ == nullptr) return;
-  int r = pcap_loop(pcap_handle_, -1, packet_handler, reinterpret_cast<u_char*>(this));
-  if (r == -1) {
-    report_error("UNRECOVERABLE", std::string("pcap_loop: ") + pcap_geterr(pcap_handle_));
+void CaptureEngine::run_loop(Worker* worker) {
+  if (worker->ring != nullptr) {
+    if (!worker->ring->run(stop_requested_, &CaptureEngine::ring_handler, worker)) {
+      report_error("UNRECOVERABLE", std::string("poll(PACKET_RX_RING): ") + std::strerror(errno));
+    }
+  } else if (worker->handle != nullptr) {
+    // The link type is fixed for the handle: choose its decoder once, not per packet.
+    pcap_handler handler = with_packet_decoder(
+        worker->link, [](auto decoder) -> pcap_handler { return &CaptureEngine::packet_handler<decltype(decoder)>; });
+    int r = pcap_loop(worker->handle, -1, handler, reinterpret_cast<u_char*>(worker));
+    if (r == -1) {
+      // For a file this is usually a truncated last record (tcpdump killed mid-write):
+      // reported, but what was read still completes below.
+      report_error("UNRECOVERABLE", std::string("pcap_loop: ") + pcap_geterr(worker->handle));
+    }
+  }
+  if (--active_workers_ == 0) {
+    if (!config_.pcap_file.empty() && !stop_requested_ && on_complete_) on_complete_();
+    running_ = false;
   }
-  running_ = false;
 }
 
 }  // namespace tcp_sniffer
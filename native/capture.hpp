@@ -1,53 +1,100 @@
 /**
  * TCP Sniffer — Capture layer (A1).
  * libpcap open, BPF filter from ports, packet loop, decode to TcpSegment.
- * See docs/specs/CPP_ENGINE.md.
+ * Optionally N worker threads sharing one PACKET_FANOUT_HASH group, and optionally a
+ * TPACKET_V3 mmap ring per worker instead of libpcap's receive path, or a capture file
+ * read with pcap_open_offline. See docs/specs/CPP_ENGINE.md.
  */
 
 #ifndef TCP_SNIFFER_CAPTURE_HPP
 #define TCP_SNIFFER_CAPTURE_HPP
 
 #include "packet.hpp"
+#include "stats.hpp"
+#include "tpacket.hpp"
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
 struct pcap;
 struct bpf_program;
+struct pcap_pkthdr;
 
 namespace tcp_sniffer {
 
+/** Packet source: libpcap, or a TPACKET_V3 ring owned by the engine. */
+enum class CaptureBackend { kPcap, kTpacket };
+
 /** Config passed from TS (subset used by capture). */
 struct CaptureConfig {
   std::string interface_name;
+  /**
+   * Read this capture file (pcap or pcapng) instead of interface_name, as fast as the
+   * callbacks allow. Each worker reads the whole file and keeps its flow_hash() share.
+   */
+  std::string pcap_file;
   std::vector<uint16_t> ports;
   double sample_rate{1.0};
   size_t max_body_size{1024 * 1024};
   size_t max_concurrent_connections{10000};
   uint64_t connection_idle_timeout_ms{300000};
+  size_t worker_threads{1};
+  CaptureBackend backend{CaptureBackend::kPcap};
+  /** Ring geometry for kTpacket; for kPcap, block_size * block_count is the kernel buffer size. */
+  size_t ring_block_size{1024 * 1024};
+  size_t ring_block_count{8};
+  /** kTpacket: block retire timeout (0 = kernel default). kPcap: read timeout (0 = immediate mode). */
+  unsigned ring_block_timeout_ms{10};
+  size_t snaplen{65535};
+  /**
+   * Extend the BPF so the kernel drops IPv4 segments without payload or SYN/FIN/RST
+   * (pure ACKs) and applies the sample_rate flow-hash test (see flow_hash()).
+   */
+  bool kernel_prefilter{false};
 };
 
-/** Callback for each decoded TCP segment. Called from capture thread. */
-using SegmentCallback = std::function<void(const TcpSegment&)>;
+/** decode_packet framing for a pcap datalink type (DLT_*); false when there is no decoder for it. */
+bool link_type_for_dlt(int dlt, LinkType* out);
+
+/**
+ * Callback for each decoded TCP segment. Called from the capture thread of worker
+ * `worker` (0 .. worker_threads-1). Both directions of a connection always arrive
+ * on the same worker, so per-worker state needs no locking.
+ */
+using SegmentCallback = std::function<void(size_t worker, const TcpSegment&)>;
 
 /** Optional error callback (fatal). */
 using ErrorCallback = std::function<void(const std::string& code, const std::string& message)>;
 
+/**
+ * Capture file exhausted (pcap_file only; not called when stop() ends the read early).
+ * Called once, from the last worker thread to finish, after every other worker's last
+ * on_segment.
+ */
+using CompleteCallback = std::function<void()>;
+
 /**
  * Capture engine: open pcap, apply BPF, run loop, decode and invoke callback.
- * Thread: start() begins a capture thread; stop() signals stop and joins.
+ * Thread: start() begins one capture thread per worker; stop() signals stop and joins.
+ * With more than one worker, each worker has its own pcap handle and all of them
+ * join one PACKET_FANOUT_HASH group, so the kernel spreads flows across workers
+ * using its flow-symmetric hash.
  */
 class CaptureEngine {
  public:
   CaptureEngine();
   ~CaptureEngine();
 
-  /** Build BPF from ports and open pcap on interface. Returns false on error. */
+  /** Build BPF from ports and open pcap on interface (or pcap_file). Returns false on error. */
   bool start(const CaptureConfig& config,
              SegmentCallback on_segment,
-             ErrorCallback on_error);
+             ErrorCallback on_error,
+             CompleteCallback on_complete = nullptr);
 
   /** Stop loop, drain (no-op in A1), close handle. Blocks until done. */
   void stop();
@@ -56,31 +103,79 @@ class CaptureEngine {
   bool is_running() const { return running_; }
 
   /** Called from pcap callback; invokes on_segment. Do not call from TS. */
-  void dispatch_segment(const TcpSegment& seg);
+  void dispatch_segment(size_t worker, const TcpSegment& seg);
 
   /** Last fatal error message if start failed. */
   std::string last_error_code() const { return last_error_code_; }
   std::string last_error_message() const { return last_error_message_; }
 
-  /** Capture stats from last stop() (pcap_stats). Only valid after stop() was called with a valid handle. */
+  /**
+   * Capture stats from last stop() (pcap_stats, or PACKET_STATISTICS for the ring
+   * backend), summed over all workers.
+   * Only valid after stop() was called with a valid handle.
+   */
   unsigned int last_ps_recv() const { return last_ps_recv_; }
   unsigned int last_ps_drop() const { return last_ps_drop_; }
   unsigned int last_ps_ifdrop() const { return last_ps_ifdrop_; }
   bool has_last_stats() const { return last_stats_valid_; }
 
+  /**
+   * Live packet counts over all workers: packets decoded to a TCP segment and handed
+   * on, and packets rejected (not IP/TCP, fragments, truncated). Call from the thread
+   * that calls start() and stop().
+   */
+  void packet_counts(uint64_t* decoded, uint64_t* rejected) const;
+
+  /**
+   * Fullest TPACKET_V3 ring over workers (0–1); 0 for the pcap and file backends,
+   * whose buffers libpcap does not expose. Any thread may call it between start()
+   * and stop() (the worker list only changes there).
+   */
+  double ring_fill() const;
+
  private:
-  void run_loop();
-  std::string build_bpf_filter(const std::vector<uint16_t>& ports) const;
+  /** One capture handle (pcap, or ring) and its thread. */
+  struct Worker {
+    CaptureEngine* engine{nullptr};
+    size_t index{0};
+    pcap* handle{nullptr};
+    bpf_program* program{nullptr};
+    LinkType link{LinkType::kEthernet};
+    /** Capture file workers: keep flows with flow_share(tuple, shares) == index (1 = all). */
+    size_t shares{1};
+    Counter decoded;
+    Counter rejected;
+    std::unique_ptr<TpacketRing> ring;
+    std::thread thread;
+  };
+
+  /** Instantiated per PacketDecoder; run_loop picks one for the worker's link type. */
+  template <typename Decoder>
+  static void packet_handler(unsigned char* user, const pcap_pkthdr* h, const unsigned char* bytes);
+  static void ring_handler(void* user, const uint8_t* data, size_t caplen, uint32_t ts_sec, uint32_t ts_nsec);
+  bool open_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                   int fanout_arg);
+  bool open_pcap_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                        int fanout_arg);
+  bool open_ring_worker(Worker& worker, const std::string& iface, const std::string& filter,
+                        int fanout_arg);
+  bool open_file_worker(Worker& worker, const std::string& filter);
+  bool set_pcap_filter(Worker& worker, const std::string& filter);
+  void close_worker(Worker& worker);
+  void close_all_workers();
+  void run_loop(Worker* worker);
+  std::string build_bpf_filter(const CaptureConfig& config) const;
   void report_error(const std::string& code, const std::string& message);
 
-  pcap* pcap_handle_{nullptr};
-  bpf_program* bpf_program_{nullptr};
+  std::vector<std::unique_ptr<Worker>> workers_;
   CaptureConfig config_;
   SegmentCallback on_segment_;
   ErrorCallback on_error_;
-  bool running_{false};
-  bool stop_requested_{false};
-  std::thread capture_thread_;
+  CompleteCallback on_complete_;
+  std::atomic<bool> running_{false};
+  std::atomic<size_t> active_workers_{0};
+  std::atomic<bool> stop_requested_{false};
+  std::mutex error_mutex_;  // workers may report concurrently
   std::string last_error_code_;
   std::string last_error_message_;
   unsigned int last_ps_recv_{0};
@@ -0,0 +1,158 @@
+/**
+ * TCP Sniffer — Connection table implementation.
+ */
+
+#include "connection_table.hpp"
+#include <cstring>
+
+namespace tcp_sniffer {
+
+namespace {
+
+uint64_t mix64(uint64_t x) {
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ULL;
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ULL;
+  x ^= x >> 32;
+  return x;
+}
+
+uint64_t hash_key_bytes(const uint8_t* bytes, size_t len) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+  for (size_t i = 0; i < len; i += 8) {
+    uint64_t w;
+    std::memcpy(&w, bytes + i, sizeof(w));  // bytes is zero-padded to a multiple of 8
+    h = mix64(h ^ w) + 0x9e3779b97f4a7c15ULL;
+  }
+  return mix64(h);
+}
+
+/** Order endpoints by (address, port) so both directions map to one key. */
+bool endpoint_less(const IpAddress& a, uint16_t a_port, const IpAddress& b, uint16_t b_port) {
+  int c = std::memcmp(a.bytes, b.bytes, a.size());
+  if (c != 0) return c < 0;
+  return a_port < b_port;
+}
+
+size_t next_pow2(size_t n) {
+  size_t p = 16;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+}  // namespace
+
+bool ConnectionKey::operator==(const ConnectionKey& other) const {
+  return hash == other.hash && len == other.len && std::memcmp(bytes, other.bytes, len) == 0;
+}
+
+ConnectionKey connection_key(const FourTuple& tuple) {
+  ConnectionKey key;
+  const IpAddress* lo_ip = &tuple.src_ip;
+  const IpAddress* hi_ip = &tuple.dst_ip;
+  uint16_t lo_port = tuple.src_port;
+  uint16_t hi_port = tuple.dst_port;
+  if (!endpoint_less(tuple.src_ip, tuple.src_port, tuple.dst_ip, tuple.dst_port)) {
+    std::swap(lo_ip, hi_ip);
+    std::swap(lo_port, hi_port);
+  }
+  size_t addr_len = tuple.src_ip.size();
+  uint8_t* p = key.bytes;
+  *p++ = tuple.src_ip.family;
+  std::memcpy(p, lo_ip->bytes, addr_len);
+  p += addr_len;
+  std::memcpy(p, hi_ip->bytes, addr_len);
+  p += addr_len;
+  *p++ = static_cast<uint8_t>(lo_port >> 8);
+  *p++ = static_cast<uint8_t>(lo_port);
+  *p++ = static_cast<uint8_t>(hi_port >> 8);
+  *p++ = static_cast<uint8_t>(hi_port);
+  key.len = static_cast<uint8_t>(p - key.bytes);
+  key.hash = hash_key_bytes(key.bytes, key.len);
+  return key;
+}
+
+ConnectionTable::ConnectionTable(size_t expected_connections) {
+  buckets_.resize(next_pow2(expected_connections * 2));
+  mask_ = buckets_.size() - 1;
+}
+
+uint32_t ConnectionTable::find(const ConnectionKey& key) const {
+  uint32_t tag = static_cast<uint32_t>(key.hash);
+  for (size_t i = tag & mask_;; i = (i + 1) & mask_) {
+    const Bucket& b = buckets_[i];
+    if (b.id == kNone) return kNone;
+    if (b.tag == tag && at(b.id).key == key) return b.id;
+  }
+}
+
+void ConnectionTable::place(uint32_t tag, uint32_t id) {
+  size_t i = tag & mask_;
+  while (buckets_[i].id != kNone) i = (i + 1) & mask_;
+  buckets_[i].tag = tag;
+  buckets_[i].id = id;
+}
+
+void ConnectionTable::grow_buckets() {
+  std::vector<Bucket> old;
+  old.swap(buckets_);
+  buckets_.resize(old.size() * 2);
+  mask_ = buckets_.size() - 1;
+  for (const Bucket& b : old) {
+    if (b.id != kNone) place(b.tag, b.id);
+  }
+}
+
+uint32_t ConnectionTable::allocate_slot() {
+  if (!free_slots_.empty()) {
+    uint32_t id = free_slots_.back();
+    free_slots_.pop_back();
+    return id;
+  }
+  if (slot_count_ % kSlabSize == 0) {
+    slabs_.emplace_back(new Connection[kSlabSize]);
+  }
+  return slot_count_++;
+}
+
+uint32_t ConnectionTable::insert(const ConnectionKey& key) {
+  if ((size_ + 1) * 2 > buckets_.size()) grow_buckets();
+  uint32_t id = allocate_slot();
+  Connection& c = at(id);
+  c.key = key;
+  c.in_use = true;
+  place(static_cast<uint32_t>(key.hash), id);
+  ++size_;
+  return id;
+}
+
+void ConnectionTable::erase(uint32_t id) {
+  Connection& c = at(id);
+  if (!c.in_use) return;
+  uint32_t tag = static_cast<uint32_t>(c.key.hash);
+  size_t i = tag & mask_;
+  while (buckets_[i].id != id) i = (i + 1) & mask_;
+
+  // Backward-shift deletion: pull later entries of the probe run into the hole
+  // so lookups never need tombstones.
+  size_t hole = i;
+  for (size_t j = (hole + 1) & mask_; buckets_[j].id != kNone; j = (j + 1) & mask_) {
+    size_t home = buckets_[j].tag & mask_;
+    // Move j into the hole unless its home lies cyclically in (hole, j].
+    bool home_in_range = (hole <= j) ? (home > hole && home <= j) : (home > hole || home <= j);
+    if (!home_in_range) {
+      buckets_[hole] = buckets_[j];
+      hole = j;
+    }
+  }
+  buckets_[hole] = Bucket{};
+
+  c.in_use = false;
+  c.client_to_server = StreamState{};
+  c.server_to_client = StreamState{};
+  free_slots_.push_back(id);
+  --size_;
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,155 @@
+/**
+ * TCP Sniffer — Connection table (A2).
+ * Packed binary 4-tuple keys and a flat open-addressing table whose slots hold the
+ * reassembly state, detected protocol and both per-direction parsers of a connection.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_CONNECTION_TABLE_HPP
+#define TCP_SNIFFER_CONNECTION_TABLE_HPP
+
+#include "fifo.hpp"
+#include "http_parser.hpp"
+#include "packet.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/**
+ * Canonical connection key: family, lower endpoint address, higher endpoint address,
+ * lower port, higher port — 13 bytes for IPv4, 37 for IPv6. Both directions of a
+ * connection produce the same key. hash is computed once when the key is built.
+ */
+struct ConnectionKey {
+  alignas(8) uint8_t bytes[40]{};  // zero-padded to a whole number of words for hashing
+  uint8_t len{0};
+  uint64_t hash{0};
+
+  bool operator==(const ConnectionKey& other) const;
+};
+
+/** Build the canonical key (and its hash) for a segment's 4-tuple. */
+ConnectionKey connection_key(const FourTuple& tuple);
+
+/**
+ * Per-direction reassembly state. Sequence numbers are unwrapped to 64 bits
+ * relative to next_seq, so ordering survives 32-bit wraparound.
+ */
+struct StreamState {
+  uint64_t next_seq{0};       // unwrapped; next expected byte (after last delivered)
+  bool initial_seq_set{false};
+  bool gap_logged{false};
+  bool gap_skip_logged{false};
+  bool overflow_logged{false};
+  uint64_t gap_since_ms{0};  // when the hole before segments opened
+  uint64_t fin_seq{0};       // unwrapped sequence of the FIN; 0 = none seen
+  bool syn_seen{false};      // the stream's start was captured, so its first bytes start a message
+  bool started{false};       // payload has been delivered (the first chunk was classified)
+  bool fin_reached{false};   // every byte before the FIN was delivered (or skipped)
+  /**
+   * Out-of-order data by unwrapped start; intervals never overlap and all start
+   * after next_seq. In-order data is delivered without copying.
+   */
+  std::map<uint64_t, std::vector<uint8_t>> segments;
+  size_t buffered_bytes{0};  // total size of segments, bounded by max_out_of_order_bytes
+};
+
+/** correlateExchanges: a parsed request awaiting its response. */
+struct PendingRequest {
+  HttpMessageData message;
+  uint64_t end_seq{0};  // unwrapped client→server sequence just past the segment that completed it
+};
+
+/** Everything tracked for one connection; lives in a ConnectionTable slot. */
+struct Connection {
+  ConnectionKey key;
+  IpAddress receiver_ip;
+  uint16_t receiver_port{0};
+  IpAddress dest_ip;
+  uint16_t dest_port{0};
+  StreamState client_to_server;
+  StreamState server_to_client;
+  uint64_t last_activity_ms{0};
+  uint64_t created_at_ms{0};
+  uint64_t closed_at_ms{0};  // FIN both ways or RST: lingering until removed; 0 = open
+  uint32_t lru_prev{UINT32_MAX};  // intrusive LRU list by slot id (Reassembler)
+  uint32_t lru_next{UINT32_MAX};
+  HttpStreamParser request_parser;   // client→server
+  HttpStreamParser response_parser;  // server→client
+  StreamProtocol protocol{StreamProtocol::kUnknown};  // from the connection's first payload bytes
+  bool ignored{false};  // no parser for protocol: segments are dropped right after the lookup
+  /** ReassemblyConfig::parser_factory parsers, used instead of the HTTP/1.x pair when set. */
+  std::unique_ptr<StreamParser> plugin_request_parser;
+  std::unique_ptr<StreamParser> plugin_response_parser;
+  size_t max_body_size{0};           // kept-body limit of this receiver port (before load shedding)
+  VectorFifo<PendingRequest> pending_requests;  // correlateExchanges: awaiting a response, oldest first
+  /**
+   * correlateExchanges, unwrapped client→server sequences (0 = none): the ack of the
+   * latest server segment, and the highest ack a final response was emitted at. A
+   * response only answers a request the server had received, and a request parsed
+   * after a response that acknowledged it was answered by a response already gone.
+   */
+  uint64_t server_ack{0};
+  uint64_t answered_seq{0};
+  bool in_use{false};
+};
+
+/**
+ * Open-addressing hash table (linear probing, backward-shift deletion) over a
+ * slab of Connection slots. The probe array stores only a 32-bit hash tag and a
+ * slot id, so lookups touch one cache line before the matching slot. Slot ids are
+ * stable for the life of the connection; freed slots are reused, including their
+ * parser and buffer allocations.
+ */
+class ConnectionTable {
+ public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  /** expected_connections sizes the probe array so the cap fits without rehashing. */
+  explicit ConnectionTable(size_t expected_connections);
+
+  /** Slot id for key, or kNone. */
+  uint32_t find(const ConnectionKey& key) const;
+
+  /**
+   * Insert key (must not be present) and return its slot id. The slot may be
+   * recycled; the caller is responsible for resetting its contents.
+   */
+  uint32_t insert(const ConnectionKey& key);
+
+  /** Remove the connection in slot id and return the slot to the free list. */
+  void erase(uint32_t id);
+
+  Connection& at(uint32_t id) { return slabs_[id / kSlabSize][id % kSlabSize]; }
+  const Connection& at(uint32_t id) const { return slabs_[id / kSlabSize][id % kSlabSize]; }
+
+  size_t size() const { return size_; }
+
+ private:
+  struct Bucket {
+    uint32_t tag{0};
+    uint32_t id{kNone};
+  };
+
+  static constexpr uint32_t kSlabSize = 256;
+
+  uint32_t allocate_slot();
+  void grow_buckets();
+  void place(uint32_t tag, uint32_t id);
+
+  std::vector<Bucket> buckets_;
+  size_t mask_{0};
+  std::vector<std::unique_ptr<Connection[]>> slabs_;
+  uint32_t slot_count_{0};
+  std::vector<uint32_t> free_slots_;
+  size_t size_{0};
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_CONNECTION_TABLE_HPP
@@ -0,0 +1,79 @@
+/**
+ * TCP Sniffer — Small per-connection FIFOs (A2, A3).
+ * Connection slots are allocated in slabs for the whole connection cap, so their
+ * queues must cost no heap until used (std::deque allocates a map and a node when
+ * constructed). See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_FIFO_HPP
+#define TCP_SNIFFER_FIFO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/** Fixed-capacity ring stored inline, for small trivially copyable items. push_back requires !full(). */
+template <typename T, size_t N>
+class InlineFifo {
+ public:
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == N; }
+  size_t size() const { return size_; }
+  const T& front() const { return items_[head_]; }
+  void push_back(T item) {
+    items_[(head_ + size_) % N] = item;
+    ++size_;
+  }
+  void pop_front() {
+    head_ = (head_ + 1) % N;
+    --size_;
+  }
+  void clear() { head_ = size_ = 0; }
+
+ private:
+  T items_[N]{};
+  uint32_t head_{0};
+  uint32_t size_{0};
+};
+
+/**
+ * FIFO over a std::vector: nothing is allocated until the first push. Popped entries
+ * stay in front of head_ until the live ones are no more than them, then the vector
+ * is compacted (amortized O(1) per item).
+ */
+template <typename T>
+class VectorFifo {
+ public:
+  bool empty() const { return head_ == items_.size(); }
+  size_t size() const { return items_.size() - head_; }
+  T& front() { return items_[head_]; }
+  void push_back(T&& item) { items_.push_back(std::move(item)); }
+  void pop_front() {
+    items_[head_++] = T();  // release what the entry owned now, not at compaction
+    if (head_ == items_.size()) {
+      clear();
+    } else if (head_ >= items_.size() - head_) {
+      items_.erase(items_.begin(), items_.begin() + static_cast<std::ptrdiff_t>(head_));
+      head_ = 0;
+    }
+  }
+  /** Storage is kept for reuse up to kRetained items (slots are recycled), freed beyond. */
+  void clear() {
+    items_.clear();
+    head_ = 0;
+    if (items_.capacity() > kRetained) std::vector<T>().swap(items_);
+  }
+
+ private:
+  static constexpr size_t kRetained = 4;
+
+  std::vector<T> items_;
+  size_t head_{0};
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_FIFO_HPP
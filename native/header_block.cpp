@@ -0,0 +1,49 @@
+/**
+ * TCP Sniffer — HTTP header storage implementation.
+ */
+
+#include "header_block.hpp"
+#include "http_scan.hpp"
+
+namespace tcp_sniffer {
+
+void HeaderBlock::add(std::string_view name, std::string_view value) {
+  Span s;
+  s.name_off = static_cast<uint32_t>(bytes_.size());
+  s.name_len = static_cast<uint32_t>(name.size());
+  s.value_off = s.name_off + s.name_len;
+  s.value_len = static_cast<uint32_t>(value.size());
+  bytes_.resize(bytes_.size() + name.size());
+  char* out = &bytes_[s.name_off];
+  for (size_t i = 0; i < name.size(); ++i) out[i] = static_cast<char>(kLowerTable[static_cast<uint8_t>(name[i])]);
+  bytes_.append(value.data(), value.size());
+  fields_.push_back(s);
+}
+
+bool HeaderBlock::find(std::string_view lower_name, std::string_view* value) const {
+  for (size_t i = fields_.size(); i-- > 0;) {
+    Field f = (*this)[i];
+    if (f.first == lower_name) {
+      *value = f.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void HeaderBlock::clear(size_t retain_bytes) {
+  bytes_.clear();
+  fields_.clear();
+  if (bytes_.capacity() > retain_bytes) std::string().swap(bytes_);
+  if (fields_.capacity() * sizeof(Span) > retain_bytes) std::vector<Span>().swap(fields_);
+}
+
+HeaderBlock HeaderBlock::compact_copy() const {
+  // Copy construction allocates exactly size(), not the arena's capacity.
+  HeaderBlock copy;
+  copy.bytes_ = bytes_;
+  copy.fields_ = fields_;
+  return copy;
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,86 @@
+/**
+ * TCP Sniffer — HTTP header storage (A3).
+ * All names and values of one message in one bump-allocated byte buffer plus a
+ * field index, instead of a string pair and hash node per header.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_HEADER_BLOCK_HPP
+#define TCP_SNIFFER_HEADER_BLOCK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/**
+ * Header fields in wire order. A repeated name is stored once per occurrence;
+ * consumers that build a name → value map let the last one win.
+ */
+class HeaderBlock {
+ public:
+  using Field = std::pair<std::string_view, std::string_view>;
+
+  /** Append a field; the name is lowercased as it is copied. */
+  void add(std::string_view name, std::string_view value);
+
+  /** Set *value to the last field named lower_name; false when there is none. */
+  bool find(std::string_view lower_name, std::string_view* value) const;
+
+  /**
+   * Drop all fields. Up to retain_bytes of capacity is kept for the next message;
+   * more is released, so one oversized header block does not stay pinned.
+   */
+  void clear(size_t retain_bytes = SIZE_MAX);
+
+  /** Exact-size copy: two allocations regardless of the field count. */
+  HeaderBlock compact_copy() const;
+
+  void reserve(size_t bytes) { bytes_.reserve(bytes); }
+  size_t size() const { return fields_.size(); }
+  bool empty() const { return fields_.empty(); }
+  /** Total name and value bytes. */
+  size_t byte_size() const { return bytes_.size(); }
+  Field operator[](size_t i) const {
+    const Span& s = fields_[i];
+    return {std::string_view(bytes_.data() + s.name_off, s.name_len),
+            std::string_view(bytes_.data() + s.value_off, s.value_len)};
+  }
+
+  class const_iterator {
+   public:
+    const_iterator(const HeaderBlock* block, size_t i) : block_(block), i_(i) {}
+    Field operator*() const { return (*block_)[i_]; }
+    const_iterator& operator++() {
+      ++i_;
+      return *this;
+    }
+    bool operator!=(const const_iterator& other) const { return i_ != other.i_; }
+
+   private:
+    const HeaderBlock* block_;
+    size_t i_;
+  };
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, fields_.size()); }
+
+ private:
+  /** Offsets into bytes_, so the index stays valid when bytes_ grows. */
+  struct Span {
+    uint32_t name_off;
+    uint32_t name_len;
+    uint32_t value_off;
+    uint32_t value_len;
+  };
+
+  std::string bytes_;
+  std::vector<Span> fields_;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_HEADER_BLOCK_HPP
@@ -3,9 +3,11 @@
  */
 
 #include "http_parser.hpp"
-#include <chrono>
+#include "http_scan.hpp"
+#include "timestamp.hpp"
+#include <algorithm>
+#include <charconv>
 #include <cctype>
-#include <cstdio>
 #include <cstring>
 #include <iomanip>
 #include <sstream>
@@ -14,36 +16,45 @@ namespace tcp_sniffer {
 
 namespace {
 
-bool is_utf8(const uint8_t* data, size_t len) {
-  size_t i = 0;
-  while (i < len) {
-    unsigned char c = data[i];
-    if (c <= 0x7f) {
-      i += 1;
-    } else if (c >= 0xc2 && c <= 0xdf && i + 1 < len) {
-      if ((data[i + 1] & 0xc0) != 0x80) return false;
-      i += 2;
-    } else if (c >= 0xe0 && c <= 0xef && i + 2 < len) {
-      if ((data[i + 1] & 0xc0) != 0x80 || (data[i + 2] & 0xc0) != 0x80) return false;
-      i += 3;
-    } else if (c >= 0xf0 && c <= 0xf4 && i + 3 < len) {
-      if ((data[i + 1] & 0xc0) != 0x80 || (data[i + 2] & 0xc0) != 0x80 || (data[i + 3] & 0xc0) != 0x80) return false;
-      i += 4;
-    } else {
-      return false;
-    }
-  }
-  return true;
-}
+/**
+ * Capacity a parser keeps across messages and connections (slots are recycled) for
+ * its header arena and pending buffer; anything larger is freed once used, so a few
+ * oversized messages do not raise RSS for every idle connection.
+ */
+constexpr size_t kRetainedCapacity = 16 * 1024;
 
-std::string to_lower(const std::string& s) {
-  std::string r = s;
-  for (char& c : r) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-  return r;
-}
+/** First reservation for a Content-Length body; larger bodies grow as they arrive. */
+constexpr size_t kInitialBodyReserve = 64 * 1024;
+
+/**
+ * Longest header block accepted without its terminating blank line. Past it the stream
+ * is not HTTP (or nothing would accept it), and buffering it further is unbounded.
+ */
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+
+/** Longest chunk-size line (hex size plus extensions) accepted without its LF. */
+constexpr size_t kMaxChunkLineBytes = 1024;
 
 }  // namespace
 
+HeaderFilter::Action HeaderFilter::classify(std::string_view name) const {
+  // Lists are a handful of names; a linear scan beats hashing a lowercased copy.
+  if (!include.empty()) {
+    bool listed = false;
+    for (const std::string& n : include) {
+      if (equals_ci(name, n)) {
+        listed = true;
+        break;
+      }
+    }
+    if (!listed) return kDrop;
+  }
+  for (const std::string& n : redact) {
+    if (equals_ci(name, n)) return kRedact;
+  }
+  return kKeep;
+}
+
 HttpStreamParser::HttpStreamParser(size_t max_body_size) : max_body_size_(max_body_size) {}
 
 void HttpStreamParser::set_connection_metadata(const std::string& receiver_ip, uint16_t receiver_port,
@@ -56,41 +67,29 @@ void HttpStreamParser::set_connection_metadata(const std::string& receiver_ip, u
 
 void HttpStreamParser::reset() {
   buffer_.clear();
+  if (buffer_.capacity() > kRetainedCapacity) std::vector<uint8_t>().swap(buffer_);
+  read_pos_ = 0;
+  header_scanned_ = 0;
+  pending_ts_us_ = 0;
+  first_byte_us_ = 0;
   state_ = kHeaders;
-  content_length_ = -1;
+  content_length_ = 0;
   body_read_ = 0;
-  headers_.clear();
+  body_kept_ = 0;
+  chunk_remaining_ = 0;
+  trailer_bytes_ = 0;
+  method_.clear();
+  path_.clear();
+  status_code_ = 0;
+  status_phrase_.clear();
+  headers_.clear(kRetainedCapacity);
   body_.clear();
   body_truncated_ = false;
   body_encoding_.clear();
-  chunked_consumed_ = 0;
-}
-
-std::string HttpStreamParser::iso_timestamp() const {
-  auto now = std::chrono::system_clock::now();
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
-  time_t s = static_cast<time_t>(ms / 1000);
-  struct tm tm_buf;
-#ifdef _WIN32
-  gmtime_s(&tm_buf, &s);
-#else
-  gmtime_r(&s, &tm_buf);
-#endif
-  char buf[32];
-  snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
-           tm_buf.tm_year + 1900, tm_buf.tm_mon + 1, tm_buf.tm_mday,
-           tm_buf.tm_hour, tm_buf.tm_min, tm_buf.tm_sec, (long)(ms % 1000));
-  return std::string(buf);
-}
-
-std::string HttpStreamParser::header_value(const std::string& name) const {
-  std::string lower = to_lower(name);
-  auto it = headers_.find(lower);
-  if (it != headers_.end()) return it->second;
-  for (const auto& [k, v] : headers_) {
-    if (to_lower(k) == lower) return v;
-  }
-  return "";
+  incomplete_ = false;
+  resync_at_line_start_ = false;
+  body_utf8_.reset();
+  expected_responses_.clear();
 }
 
 void HttpStreamParser::emit_message() {
@@ -101,223 +100,464 @@ void HttpStreamParser::emit_message() {
   msg.dest_ip = dest_ip_;
   msg.dest_port = dest_port_;
   msg.is_request = is_request_;
-  msg.method = method_;
-  msg.path = path_;
+  // Per-message state is cleared right after emit, so hand it over instead of copying.
+  msg.method = std::move(method_);
+  msg.path = std::move(path_);
   msg.status_code = status_code_;
-  msg.headers = headers_;
-  msg.body = body_;
+  // Copied out at its exact size; the arena stays with the parser for the next message.
+  msg.headers = headers_.compact_copy();
+  msg.body = std::move(body_);
+  msg.body_length = body_read_;
   msg.body_truncated = body_truncated_;
-  msg.body_encoding = body_encoding_;
-  msg.timestamp = iso_timestamp();
-  on_message_(msg);
+  msg.body_encoding = std::move(body_encoding_);
+  msg.incomplete = incomplete_;
+  msg.first_byte_us = first_byte_us_;
+  msg.complete_us = chunk_ts_us_;
+  on_message_(std::move(msg));
 }
 
-void HttpStreamParser::feed(const uint8_t* data, size_t len) {
+void HttpStreamParser::feed(const uint8_t* data, size_t len, uint64_t ts_us) {
   if (data == nullptr || len == 0) return;
+  chunk_ts_us_ = ts_us != 0 ? ts_us : unix_time_us();
+  if (read_pos_ == buffer_.size()) {
+    // Nothing pending: parse straight from the caller's chunk and keep only the tail.
+    buffer_.clear();
+    read_pos_ = 0;
+    chunk_begin_ = data;
+    size_t used = parse(data, len);
+    if (used < len) {
+      buffer_.assign(data + used, data + len);
+      pending_ts_us_ = chunk_ts_us_;
+    }
+    return;
+  }
+  // Compact once the consumed prefix is at least half the buffer (amortized O(1) per byte).
+  if (read_pos_ > 0 && read_pos_ >= buffer_.size() - read_pos_) {
+    buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(read_pos_));
+    read_pos_ = 0;
+  }
+  size_t old_size = buffer_.size();
   buffer_.insert(buffer_.end(), data, data + len);
-  parse();
+  chunk_begin_ = buffer_.data() + old_size;
+  read_pos_ += parse(buffer_.data() + read_pos_, buffer_.size() - read_pos_);
+  if (read_pos_ == buffer_.size()) {
+    buffer_.clear();
+    read_pos_ = 0;
+  } else if (read_pos_ >= old_size) {
+    pending_ts_us_ = chunk_ts_us_;  // the older bytes are all consumed
+  }
 }
 
-void HttpStreamParser::parse() {
-  for (;;) {
-    if (state_ == kHeaders) {
-      if (!try_parse_headers()) break;
-    } else if (state_ == kBodyContentLength) {
-      parse_body_content_length(content_length_);
-      if (state_ != kDone) break;
-    } else if (state_ == kBodyChunked) {
-      parse_body_chunked();
-      if (state_ != kDone) break;
-    } else {
-      break;
+size_t HttpStreamParser::parse(const uint8_t* data, size_t len) {
+  size_t pos = 0;
+  // Keep going while progress is made, so pipelined messages in one chunk all complete.
+  while (pos < len) {
+    size_t used = 0;
+    switch (state_) {
+      case kHeaders:
+        used = try_parse_headers(data + pos, len - pos);
+        break;
+      case kBodyContentLength:
+        used = parse_body_content_length(data + pos, len - pos);
+        break;
+      case kBodyUntilClose:
+        used = parse_body_until_close(data + pos, len - pos);
+        break;
+      case kTunnel:
+        used = len - pos;
+        break;
+      case kResync:
+        used = resync(data + pos, len - pos);
+        if (state_ == kHeaders) {
+          pos += used;
+          continue;  // found a start line, possibly at pos itself
+        }
+        break;
+      default:
+        used = parse_body_chunked(data + pos, len - pos);
+        break;
     }
+    if (used == 0) break;
+    pos += used;
   }
+  return pos;
 }
 
-bool HttpStreamParser::try_parse_headers() {
-  const uint8_t* base = buffer_.data();
-  size_t n = buffer_.size();
-  const uint8_t* double_end = nullptr;
-  for (size_t i = 0; i + 1 < n; i++) {
-    if (base[i] == '\r' && base[i + 1] == '\n' && i + 3 < n && base[i + 2] == '\r' && base[i + 3] == '\n') {
-      double_end = base + i;
-      break;
-    }
-    if (base[i] == '\n' && i + 1 < n && base[i + 1] == '\n') {
-      double_end = base + i;
-      break;
-    }
+namespace {
+
+std::string_view trim_ows(std::string_view v) {
+  while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+  while (!v.empty() && (v.back() == ' ' || v.back() == '\t' || v.back() == '\r')) v.remove_suffix(1);
+  return v;
+}
+
+template <typename T>
+bool parse_decimal(std::string_view v, T& out) {
+  auto r = std::from_chars(v.data(), v.data() + v.size(), out);
+  return r.ec == std::errc();
+}
+
+}  // namespace
+
+void HttpStreamParser::parse_start_line(std::string_view line) {
+  if (line.size() >= 5 && line.compare(0, 5, "HTTP/") == 0) {
+    is_request_ = false;
+    size_t code_start = line.find(' ', 5);
+    if (code_start == std::string_view::npos) return;
+    std::string_view rest = line.substr(code_start + 1);
+    int code = 0;
+    if (parse_decimal(rest.substr(0, rest.find(' ')), code)) status_code_ = code;
+    size_t phrase_start = rest.find(' ');
+    if (phrase_start != std::string_view::npos) status_phrase_.assign(rest.substr(phrase_start + 1));
+    return;
+  }
+  is_request_ = true;
+  size_t sp1 = line.find(' ');
+  if (sp1 == std::string_view::npos) return;
+  method_.assign(line.substr(0, sp1));
+  size_t sp2 = line.find(' ', sp1 + 1);
+  path_.assign(sp2 != std::string_view::npos ? line.substr(sp1 + 1, sp2 - (sp1 + 1)) : line.substr(sp1 + 1));
+}
+
+size_t HttpStreamParser::try_parse_headers(const uint8_t* data, size_t len) {
+  // Empty lines before a start line are ignored (RFC 9112 2.2), e.g. a CRLF left over from a chunked trailer.
+  size_t skip = 0;
+  while (skip < len && (data[skip] == '\r' || data[skip] == '\n')) skip++;
+  if (skip > 0) {
+    header_scanned_ = 0;
+    return skip;
   }
-  if (double_end == nullptr) return false;
-  size_t header_len = double_end - base;
-  if (base[header_len] == '\r') header_len += 4;
-  else header_len += 2;
 
-  std::string block(reinterpret_cast<const char*>(base), header_len);
-  buffer_.erase(buffer_.begin(), buffer_.begin() + header_len);
+  if (header_scanned_ == 0) first_byte_us_ = ts_at(data);
+  // Resume where the previous feed stopped instead of rescanning the partial block.
+  size_t header_len = find_header_end(data, len, header_scanned_);
+  if (header_len == kNoHeaderEnd) {
+    if (len < kMaxHeaderBytes) {
+      header_scanned_ = len;
+      return 0;
+    }
+    // Nothing is emitted; input is discarded up to the next plausible start line.
+    if (headers_too_large_) headers_too_large_->add();
+    drop_expected_responses();
+    header_scanned_ = 0;
+    state_ = kResync;
+    resync_at_line_start_ = false;
+    return 1;
+  }
+  header_scanned_ = 0;
 
-  size_t pos = 0;
-  size_t line_start = 0;
+  // Tokenize in place: lines, names and values are views into the block. Names and
+  // values fit in the block, so one reservation covers the arena.
+  headers_.reserve(header_len);
+  std::string_view block(reinterpret_cast<const char*>(data), header_len);
   bool first = true;
-  while (pos <= block.size()) {
-    if (pos == block.size() || block[pos] == '\n') {
-      std::string line = block.substr(line_start, pos - line_start);
-      while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
-      if (line.empty()) break;
-      if (first) {
-        first = false;
-        if (line.size() >= 5 && line.substr(0, 5) == "HTTP/") {
-          is_request_ = false;
-          size_t code_start = line.find(' ', 5);
-          if (code_start != std::string::npos) {
-            try {
-              status_code_ = std::stoi(line.substr(code_start + 1));
-            } catch (...) {}
-            size_t phrase_start = line.find(' ', code_start + 1);
-            if (phrase_start != std::string::npos)
-              status_phrase_ = line.substr(phrase_start + 1);
-          }
-        } else {
-          is_request_ = true;
-          size_t sp1 = line.find(' ');
-          if (sp1 != std::string::npos) {
-            method_ = line.substr(0, sp1);
-            size_t sp2 = line.find(' ', sp1 + 1);
-            if (sp2 != std::string::npos)
-              path_ = line.substr(sp1 + 1, sp2 - (sp1 + 1));
-            else
-              path_ = line.substr(sp1 + 1);
-          }
-        }
-      } else {
-        size_t colon = line.find(':');
-        if (colon != std::string::npos) {
-          std::string key = line.substr(0, colon);
-          size_t val_start = colon + 1;
-          while (val_start < line.size() && (line[val_start] == ' ' || line[val_start] == '\t')) val_start++;
-          std::string val = (val_start < line.size()) ? line.substr(val_start) : "";
-          headers_[to_lower(key)] = val;
-        }
-      }
-      line_start = pos + 1;
+  bool chunked = false;
+  bool has_content_length = false;
+  bool connection_close = false;
+  bool keep_alive = false;
+  size_t content_length = 0;
+  while (!block.empty()) {
+    size_t nl = block.find('\n');
+    std::string_view line = block.substr(0, nl);
+    block.remove_prefix(nl == std::string_view::npos ? block.size() : nl + 1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.empty()) break;
+    if (first) {
+      first = false;
+      parse_start_line(line);
+      continue;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) continue;
+    std::string_view name = line.substr(0, colon);
+    std::string_view val = trim_ows(line.substr(colon + 1));
+    // Framing is read before filtering: a dropped Transfer-Encoding still delimits the body.
+    if (equals_ci(name, "transfer-encoding")) {
+      chunked = contains_ci(val, "chunked");
+    } else if (equals_ci(name, "content-length")) {
+      has_content_length = true;
+      if (!parse_decimal(val, content_length)) content_length = 0;
+    } else if (equals_ci(name, "connection")) {
+      connection_close = connection_close || contains_ci(val, "close");
+      keep_alive = keep_alive || contains_ci(val, "keep-alive");
     }
-    pos++;
+    HeaderFilter::Action action = header_filter_ ? header_filter_->classify(name) : HeaderFilter::kKeep;
+    if (action == HeaderFilter::kDrop) continue;
+    headers_.add(name, action == HeaderFilter::kRedact ? HeaderFilter::kRedactedValue : val);
   }
 
-  std::string te = header_value("transfer-encoding");
-  if (to_lower(te).find("chunked") != std::string::npos) {
-    state_ = kBodyChunked;
-    chunked_consumed_ = 0;
-  } else {
-    content_length_ = 0;
-    std::string cl = header_value("content-length");
-    if (!cl.empty()) {
-      try {
-        content_length_ = std::stoi(cl);
-      } catch (...) {}
+  body_read_ = 0;
+  body_kept_ = 0;
+  body_limit_ = max_body_size_;
+  RequestKind answers = RequestKind::kOther;
+  if (is_request_) {
+    if (response_parser_) {
+      response_parser_->expect_response(method_ == "HEAD"      ? RequestKind::kHead
+                                        : method_ == "CONNECT" ? RequestKind::kConnect
+                                                               : RequestKind::kOther);
     }
+  } else if ((status_code_ >= 200 || status_code_ == 101) && !expected_responses_.empty()) {
+    answers = expected_responses_.front();  // interim 1xx responses answer nothing
+    expected_responses_.pop_front();
+  }
+  // HTTP/1.1 connections persist unless closed explicitly; HTTP/1.0 ones only with keep-alive.
+  bool http10 = !is_request_ && header_len >= 8 && std::memcmp(data, "HTTP/1.0", 8) == 0;
+  bool persistent = !connection_close && (!http10 || keep_alive);
+  bool tunnel = !is_request_ && (status_code_ == 101 || (answers == RequestKind::kConnect && status_code_ / 100 == 2));
+  // 1xx, 204 and 304 never have a body (RFC 9112 6.3 rule 1), nor does a response to HEAD.
+  bool no_body = !is_request_ && (answers == RequestKind::kHead || status_code_ / 100 == 1 ||
+                                  status_code_ == 204 || status_code_ == 304);
+  if (tunnel || no_body) {
+    // No body whatever the headers say; after a protocol switch the bytes are not HTTP.
+    content_length_ = 0;
+    state_ = kBodyContentLength;
+    finish_message();
+    if (tunnel) state_ = kTunnel;
+  } else if (chunked) {
+    state_ = kChunkSize;
+  } else if (!has_content_length && !is_request_ && !persistent) {
+    // No framing: the body is everything until the server closes the connection.
+    // Requests without either header have no body (RFC 9112 6.3).
+    state_ = kBodyUntilClose;
+    body_.reserve(std::min(body_limit_, kInitialBodyReserve));
+  } else {
+    content_length_ = content_length;
     state_ = kBodyContentLength;
-    body_read_ = 0;
+    body_.reserve(std::min({content_length_, body_limit_, kInitialBodyReserve}));
+    if (content_length_ == 0) finish_message();  // no body: complete now, without more input
   }
-  return true;
+  return header_len;
 }
 
-void HttpStreamParser::parse_body_content_length(int content_length) {
-  size_t need = static_cast<size_t>(content_length) - body_read_;
-  if (need == 0) {
-    emit_message();
-    method_.clear();
-    path_.clear();
-    status_code_ = 0;
-    headers_.clear();
-    body_.clear();
-    body_truncated_ = false;
-    body_encoding_.clear();
-    state_ = kHeaders;
-    return;
-  }
-  if (buffer_.size() < need) return;
-  size_t to_take = need;
-  if (body_read_ + to_take > max_body_size_) {
-    to_take = (body_read_ >= max_body_size_) ? 0 : (max_body_size_ - body_read_);
-    body_truncated_ = true;
-  }
-  if (to_take > 0) {
-    const uint8_t* start = buffer_.data();
-    if (is_utf8(start, to_take)) {
-      body_.append(reinterpret_cast<const char*>(start), to_take);
+void HttpStreamParser::drop_expected_responses() {
+  // A request missed here never queued its kind, a response missed never took one: the
+  // queue no longer lines up, and stale kinds would frame the wrong responses.
+  expected_responses_.clear();
+  if (response_parser_) response_parser_->expected_responses_.clear();
+}
+
+void HttpStreamParser::expect_response(RequestKind kind) {
+  // Bounded for a flow whose responses are never seen; past it their framing falls back.
+  if (!expected_responses_.full()) expected_responses_.push_back(kind);
+}
+
+void HttpStreamParser::append_body(const uint8_t* data, size_t len) {
+  size_t room = body_kept_ >= body_limit_ ? 0 : body_limit_ - body_kept_;
+  size_t keep = len < room ? len : room;
+  if (keep < len && body_limit_ > 0) body_truncated_ = true;  // with 0, bodies are not captured at all
+  if (keep == 0 || incomplete_) return;
+  body_kept_ += keep;
+  if (!body_utf8_.valid()) return;  // dropped at finish_message; no point copying more
+  body_utf8_.update(data, keep);
+  body_.append(reinterpret_cast<const char*>(data), keep);
+}
+
+void HttpStreamParser::finish_message() {
+  if (incomplete_) {
+    body_.clear();  // has a hole; kept bytes either side of it would misrepresent the body
+  } else if (!body_utf8_.complete()) {
+    if (body_truncated_ && body_utf8_.valid()) {
+      body_.resize(body_.size() - body_utf8_.pending());  // maxBodySize cut a character
     } else {
+      body_.clear();
       body_encoding_ = "binary";
     }
-    body_read_ += to_take;
-    buffer_.erase(buffer_.begin(), buffer_.begin() + (to_take < need ? to_take : need));
-  } else {
-    buffer_.erase(buffer_.begin(), buffer_.begin() + need);
-    body_read_ += need;
-  }
-  if (body_read_ >= static_cast<size_t>(content_length)) {
-    emit_message();
-    method_.clear();
-    path_.clear();
-    status_code_ = 0;
-    headers_.clear();
-    body_.clear();
-    body_truncated_ = false;
-    body_encoding_.clear();
-    state_ = kHeaders;
   }
+  emit_message();
+  method_.clear();
+  path_.clear();
+  status_code_ = 0;
+  status_phrase_.clear();
+  headers_.clear(kRetainedCapacity);
+  body_.clear();
+  body_truncated_ = false;
+  body_encoding_.clear();
+  incomplete_ = false;
+  body_utf8_.reset();
+  content_length_ = 0;
+  body_read_ = 0;
+  body_kept_ = 0;
+  state_ = kHeaders;
 }
 
-bool HttpStreamParser::parse_chunk_size(size_t& out_size, size_t& consumed) {
-  const uint8_t* p = buffer_.data();
-  size_t n = buffer_.size();
-  const uint8_t* end = std::find(p, p + n, '\n');
-  if (end == p + n) return false;
-  std::string line(reinterpret_cast<const char*>(p), end - p);
-  while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
-  size_t hex_end = 0;
-  while (hex_end < line.size() && std::isxdigit(static_cast<unsigned char>(line[hex_end]))) hex_end++;
-  if (hex_end == 0) { consumed = (end - p) + 1; out_size = 0; return true; }
-  out_size = static_cast<size_t>(std::stoul(line.substr(0, hex_end), nullptr, 16));
-  consumed = (end - p) + 1;
-  return true;
+size_t HttpStreamParser::parse_body_content_length(const uint8_t* data, size_t len) {
+  // Consume whatever has arrived; only the kept prefix (body_limit_) is copied.
+  size_t need = content_length_ - body_read_;
+  size_t take = len < need ? len : need;
+  append_body(data, take);
+  body_read_ += take;
+  if (body_read_ == content_length_) finish_message();
+  return take;
 }
 
-void HttpStreamParser::parse_body_chunked() {
-  for (;;) {
-    size_t chunk_size = 0, consumed = 0;
-    if (!parse_chunk_size(chunk_size, consumed)) return;
-    buffer_.erase(buffer_.begin(), buffer_.begin() + consumed);
-    chunked_consumed_ += consumed;
-    if (chunk_size == 0) {
-      emit_message();
-      method_.clear();
-      path_.clear();
-      status_code_ = 0;
-      headers_.clear();
-      body_.clear();
-      body_truncated_ = false;
-      body_encoding_.clear();
-      state_ = kHeaders;
-      return;
+size_t HttpStreamParser::parse_body_until_close(const uint8_t* data, size_t len) {
+  append_body(data, len);
+  body_read_ += len;
+  return len;
+}
+
+size_t HttpStreamParser::parse_body_chunked(const uint8_t* data, size_t len) {
+  switch (state_) {
+    case kChunkSize: {
+      const uint8_t* nl = static_cast<const uint8_t*>(std::memchr(data, '\n', len));
+      if (nl == nullptr) return len < kMaxChunkLineBytes ? 0 : abandon_chunked_body(len, false);
+      size_t line_len = static_cast<size_t>(nl - data) + 1;
+      size_t size = 0;
+      size_t i = 0;
+      for (; i < line_len && std::isxdigit(data[i]); ++i) {
+        if (size > (SIZE_MAX >> 4)) break;
+        int c = data[i];
+        size = (size << 4) | static_cast<size_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+      }
+      chunk_remaining_ = size;
+      state_ = size == 0 ? kChunkTrailer : kChunkData;
+      trailer_bytes_ = 0;
+      return line_len;
     }
-    if (buffer_.size() < chunk_size + 2) return;
-    size_t to_append = chunk_size;
-    if (body_.size() + to_append > max_body_size_) {
-      to_append = (body_.size() >= max_body_size_) ? 0 : (max_body_size_ - body_.size());
-      body_truncated_ = true;
+    case kChunkData: {
+      size_t take = len < chunk_remaining_ ? len : chunk_remaining_;
+      append_body(data, take);
+      body_read_ += take;
+      chunk_remaining_ -= take;
+      if (chunk_remaining_ == 0) state_ = kChunkDataEnd;
+      return take;
     }
-    if (to_append > 0) {
-      const uint8_t* start = buffer_.data();
-      if (is_utf8(start, to_append)) {
-        body_.append(reinterpret_cast<const char*>(start), to_append);
-      } else {
-        body_encoding_ = "binary";
+    case kChunkDataEnd: {
+      // CRLF (or bare LF) after chunk data.
+      if (data[0] == '\r') {
+        if (len < 2) return 0;
+        state_ = kChunkSize;
+        return data[1] == '\n' ? 2 : 1;
       }
+      state_ = kChunkSize;
+      if (data[0] == '\n') return 1;
+      return parse_body_chunked(data, len);  // missing terminator: read the next size line
+    }
+    case kChunkTrailer: {
+      // Trailer fields are skipped line by line; an empty line ends the message. The
+      // section is bounded like a header block.
+      const uint8_t* nl = static_cast<const uint8_t*>(std::memchr(data, '\n', len));
+      if (nl == nullptr) return trailer_bytes_ + len < kMaxHeaderBytes ? 0 : abandon_chunked_body(len, false);
+      size_t line_len = static_cast<size_t>(nl - data) + 1;
+      if (line_len == 1 || (line_len == 2 && data[0] == '\r')) {
+        finish_message();
+        return line_len;
+      }
+      trailer_bytes_ += line_len;
+      return trailer_bytes_ < kMaxHeaderBytes ? line_len : abandon_chunked_body(line_len, true);
+    }
+    default:
+      return 0;
+  }
+}
+
+size_t HttpStreamParser::abandon_chunked_body(size_t consumed, bool at_line_start) {
+  if (headers_too_large_) headers_too_large_->add();
+  incomplete_ = true;
+  finish_message();
+  drop_expected_responses();
+  state_ = kResync;
+  resync_at_line_start_ = at_line_start;
+  return consumed;
+}
+
+namespace {
+
+/** Request methods accepted as a resync point (RFC 9110 9.3, plus PATCH). */
+constexpr std::string_view kResyncTokens[] = {"GET ",     "HEAD ",    "POST ",  "PUT ",   "DELETE ",
+                                              "CONNECT ", "OPTIONS ", "TRACE ", "PATCH ", "HTTP/1."};
+
+/** 1 if data starts with a start line token, 0 if not, -1 if it is a prefix of one. */
+int start_line_at(const uint8_t* data, size_t len) {
+  std::string_view in(reinterpret_cast<const char*>(data), len);
+  for (std::string_view token : kResyncTokens) {
+    if (in.size() >= token.size()) {
+      if (in.compare(0, token.size(), token) == 0) return 1;
+    } else if (token.compare(0, in.size(), in) == 0) {
+      return -1;
     }
-    buffer_.erase(buffer_.begin(), buffer_.begin() + chunk_size + 2);
-    chunked_consumed_ += chunk_size + 2;
   }
+  return 0;
+}
+
+}  // namespace
+
+size_t HttpStreamParser::resync(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  if (!resync_at_line_start_) {
+    const void* nl = std::memchr(data, '\n', len);
+    if (nl == nullptr) return len;
+    i = static_cast<size_t>(static_cast<const uint8_t*>(nl) - data) + 1;
+    resync_at_line_start_ = true;
+  }
+  while (i < len) {
+    int match = start_line_at(data + i, len - i);
+    if (match > 0) {
+      state_ = kHeaders;
+      header_scanned_ = 0;
+      return i;
+    }
+    if (match < 0) return i;  // keep the candidate until more bytes arrive
+    const void* nl = std::memchr(data + i, '\n', len - i);
+    if (nl == nullptr) {
+      resync_at_line_start_ = false;
+      return len;
+    }
+    i = static_cast<size_t>(static_cast<const uint8_t*>(nl) - data) + 1;
+  }
+  return len;
+}
+
+void HttpStreamParser::skip(uint64_t len) {
+  if (len == 0 || state_ == kTunnel) return;
+  bool nothing_pending = read_pos_ == buffer_.size();
+  // A hole that ends inside the body being read: count the lost bytes as body and stay in sync.
+  if (state_ == kBodyContentLength && nothing_pending && len <= content_length_ - body_read_) {
+    incomplete_ = true;
+    body_read_ += static_cast<size_t>(len);
+    if (body_read_ == content_length_) finish_message();
+    return;
+  }
+  if (state_ == kBodyUntilClose) {
+    incomplete_ = true;
+    body_read_ += static_cast<size_t>(len);
+    return;
+  }
+  if (state_ == kChunkData && nothing_pending && len <= chunk_remaining_) {
+    incomplete_ = true;
+    body_read_ += static_cast<size_t>(len);
+    chunk_remaining_ -= static_cast<size_t>(len);
+    if (chunk_remaining_ == 0) state_ = kChunkDataEnd;
+    return;
+  }
+  // Sync is lost: emit what is known of the current message and look for the next one.
+  if (state_ != kHeaders && state_ != kResync) {
+    incomplete_ = true;
+    finish_message();
+  }
+  drop_expected_responses();
+  buffer_.clear();
+  read_pos_ = 0;
+  header_scanned_ = 0;
+  // The hole may have ended exactly at a message boundary, so the next byte is a candidate.
+  state_ = kResync;
+  resync_at_line_start_ = true;
+}
+
+void HttpStreamParser::start_mid_stream() {
+  state_ = kResync;
+  resync_at_line_start_ = true;
+}
+
+void HttpStreamParser::close(uint64_t ts_us, bool aborted) {
+  if (state_ != kHeaders && state_ != kResync && state_ != kTunnel) {
+    chunk_ts_us_ = ts_us != 0 ? ts_us : unix_time_us();
+    if (aborted || state_ != kBodyUntilClose) incomplete_ = true;
+    finish_message();
+  }
+  buffer_.clear();
+  read_pos_ = 0;
+  header_scanned_ = 0;
 }
 
 }  // namespace tcp_sniffer
@@ -7,10 +7,16 @@
 #ifndef TCP_SNIFFER_HTTP_PARSER_HPP
 #define TCP_SNIFFER_HTTP_PARSER_HPP
 
+#include "fifo.hpp"
+#include "header_block.hpp"
+#include "stats.hpp"
+#include "stream_parser.hpp"
+#include "utf8.hpp"
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 namespace tcp_sniffer {
@@ -25,28 +31,107 @@ struct HttpMessageData {
   std::string method;
   std::string path;
   int status_code{0};
-  std::unordered_map<std::string, std::string> headers;
+  HeaderBlock headers;  // lowercased names, wire order
   std::string body;
+  uint64_t body_length{0};  // body bytes on the wire (de-chunked), whether kept or not
   bool body_truncated{false};
   std::string body_encoding;  // "binary" or empty
-  std::string timestamp;     // ISO 8601 UTC
+  /** Bytes of this message were lost in a skipped reassembly gap; body is omitted. */
+  bool incomplete{false};
+  uint64_t first_byte_us{0};  // capture time of the message's first byte (µs since epoch)
+  uint64_t complete_us{0};    // capture time of the segment that completed it
+  /** correlateExchanges: on a response, the request it answers (null when none was seen). */
+  std::unique_ptr<HttpMessageData> request;
 };
 
-using HttpMessageCallback = std::function<void(const HttpMessageData&)>;
+/**
+ * Header allowlist and redaction (includeHeaders / redactHeaders), applied while the
+ * header block is tokenized so dropped headers are never stored. Names are lowercase.
+ */
+struct HeaderFilter {
+  enum Action { kKeep, kDrop, kRedact };
+  std::vector<std::string> include;  // empty = keep every header
+  std::vector<std::string> redact;   // value replaced by kRedactedValue
+
+  static constexpr std::string_view kRedactedValue = "[REDACTED]";
+
+  bool empty() const { return include.empty() && redact.empty(); }
+  Action classify(std::string_view name) const;
+};
+
+/** Receives each complete message by rvalue; the callee may move from it. */
+using HttpMessageCallback = std::function<void(HttpMessageData&&)>;
 
 /**
  * Stateful HTTP/1.x stream parser. Feed bytes; invokes callback per complete message.
- * Handles Content-Length and Transfer-Encoding: chunked. Applies max_body_size.
+ * Handles Content-Length, Transfer-Encoding: chunked and responses delimited by the
+ * connection closing (RFC 9112 6.3). Applies max_body_size. The built-in StreamParser
+ * for StreamProtocol::kHttp1.
+ *
+ * A response is only read until close when the connection is not persistent
+ * (`Connection: close`, or HTTP/1.0 without keep-alive). Without that, an unframed
+ * response on a keep-alive connection is taken to have no body, so a response to a
+ * request whose method is unknown cannot swallow the ones after it.
  */
-class HttpStreamParser {
+class HttpStreamParser final : public StreamParser {
  public:
-  explicit HttpStreamParser(size_t max_body_size);
+  explicit HttpStreamParser(size_t max_body_size = 1024 * 1024);
   void set_message_callback(HttpMessageCallback cb) { on_message_ = std::move(cb); }
+  /**
+   * Body bytes kept per message; 0 keeps none (bodies are still framed and counted).
+   * A message whose headers are already parsed keeps the limit it started with.
+   */
+  void set_max_body_size(size_t max_body_size) { max_body_size_ = max_body_size; }
+  /** Filter applied to every header; must outlive the parser (null = keep all). */
+  void set_header_filter(const HeaderFilter* filter) { header_filter_ = filter && !filter->empty() ? filter : nullptr; }
+  /**
+   * Response parser of the same connection (null = none). Each request's method is
+   * queued on it, so a response to HEAD, or a 2xx to CONNECT, is known to have no
+   * body (RFC 9112 6.3 rules 1-2). Must outlive this parser.
+   */
+  void set_response_parser(HttpStreamParser* response_parser) { response_parser_ = response_parser; }
+  /**
+   * Counts header blocks still unterminated after 64 KiB, which are dropped without
+   * emitting anything, and chunked bodies given up on for a chunk-size line over 1 KiB
+   * or a trailer section over 64 KiB, emitted as incomplete (null = not counted). Must
+   * outlive the parser.
+   */
+  void set_headers_too_large_counter(Counter* counter) { headers_too_large_ = counter; }
+
+  /** A 101 Switching Protocols or a 2xx to CONNECT was parsed: what follows is not HTTP. */
+  bool tunnelled() const { return state_ == kTunnel; }
+
+  /** Sync was lost (a skipped gap, or joined mid-stream): input is discarded up to a start line. */
+  bool resyncing() const { return state_ == kResync; }
+
+  /** Feed more bytes (from reassembled stream); ts_us is their capture time (0 = now). */
+  void feed(const uint8_t* data, size_t len, uint64_t ts_us = 0) override;
+
+  /**
+   * len bytes of the stream were lost (reassembly skipped a gap); the next feed
+   * continues after them. A hole inside a body of known length is stepped over and
+   * the message flagged incomplete. Otherwise the partial message is emitted as
+   * incomplete (if its headers were parsed), input is discarded until a line that
+   * looks like a request or status line, and the request kinds queued for responses
+   * are dropped (responses after the hole are framed as answering a GET).
+   */
+  void skip(uint64_t len) override;
+
+  /**
+   * The stream was joined after its start (its first bytes are not a start line):
+   * discard input up to the next line that looks like one, as after a skipped gap.
+   */
+  void start_mid_stream();
 
-  /** Feed more bytes (from reassembled stream). */
-  void feed(const uint8_t* data, size_t len);
+  /**
+   * The stream ended at capture time ts_us (0 = now). After a clean FIN (not aborted)
+   * a response read until close is complete and emitted; any other message whose
+   * headers were parsed, and any message on an aborted close, is emitted as
+   * incomplete. Buffered input is discarded.
+   */
+  void close(uint64_t ts_us = 0, bool aborted = false) override;
 
-  /** Reset parser state for a new connection (optional). */
+  /** Reset parser state for a new connection (keeps buffer capacity for reuse). */
   void reset();
 
   /** Set connection metadata (receiver/dest) from StreamChunk; call before first feed. */
@@ -54,35 +139,86 @@ class HttpStreamParser {
                                const std::string& dest_ip, uint16_t dest_port);
 
  private:
-  void parse();
-  bool try_parse_headers();
-  void parse_body_content_length(int content_length);
-  void parse_body_chunked();
-  bool parse_chunk_size(size_t& out_size, size_t& consumed);
-  std::string header_value(const std::string& name) const;
+  /** Parse from data[0, len); returns bytes consumed. Never retains data. */
+  size_t parse(const uint8_t* data, size_t len);
+  /** Header block starting at data; returns its length (including terminator) or 0 if incomplete. */
+  size_t try_parse_headers(const uint8_t* data, size_t len);
+  void parse_start_line(std::string_view line);
+  size_t parse_body_content_length(const uint8_t* data, size_t len);
+  size_t parse_body_chunked(const uint8_t* data, size_t len);
+  /**
+   * A chunk-size line or trailer section ran past its limit: count it, emit the message
+   * as incomplete and resync. Returns consumed, the bytes of it given up on.
+   */
+  size_t abandon_chunked_body(size_t consumed, bool at_line_start);
+  size_t parse_body_until_close(const uint8_t* data, size_t len);
+  /** Discard input up to the next plausible start line; returns bytes discarded. */
+  size_t resync(const uint8_t* data, size_t len);
+  void append_body(const uint8_t* data, size_t len);
+  void finish_message();
+  /** What a response's framing depends on in the request it answers. */
+  enum class RequestKind : uint8_t { kOther, kHead, kConnect };
+  /** Requests queued on the response parser awaiting their responses (pipelining depth). */
+  static constexpr size_t kMaxExpectedResponses = 64;
+  void expect_response(RequestKind kind);
+  /** Sync was lost: forget the request kinds queued on the response parser (or this one). */
+  void drop_expected_responses();
   void emit_message();
-  std::string iso_timestamp() const;
+  /** Capture time of a byte of the current parse input. */
+  uint64_t ts_at(const uint8_t* p) const { return p < chunk_begin_ ? pending_ts_us_ : chunk_ts_us_; }
 
   size_t max_body_size_;
+  size_t body_limit_{0};  // max_body_size_ when the current message's headers ended
+  const HeaderFilter* header_filter_{nullptr};
   HttpMessageCallback on_message_;
+  /**
+   * Bytes not yet consumed are buffer_[read_pos_, size). The cursor advances as bytes
+   * are parsed; the front is only compacted when it dominates the buffer, so
+   * consumption is amortized O(1) per byte instead of an erase per token.
+   */
   std::vector<uint8_t> buffer_;
-  enum { kHeaders, kBodyContentLength, kBodyChunked, kDone } state_{kHeaders};
-  int content_length_{-1};
-  size_t body_read_{0};
+  size_t read_pos_{0};
+  size_t header_scanned_{0};  // bytes of the pending header block already searched for its end
+  // Parse input before chunk_begin_ was buffered by earlier feeds; its first byte arrived at pending_ts_us_.
+  const uint8_t* chunk_begin_{nullptr};
+  uint64_t chunk_ts_us_{0};
+  uint64_t pending_ts_us_{0};
+  uint64_t first_byte_us_{0};
+  enum {
+    kHeaders,
+    kBodyContentLength,
+    kBodyUntilClose,  // response without Content-Length or chunked framing
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd,
+    kChunkTrailer,
+    kResync,
+    kTunnel,  // after a protocol switch: input is discarded
+  } state_{kHeaders};
+  bool resync_at_line_start_{false};  // kResync: the next input byte starts a line
+  size_t content_length_{0};
+  size_t body_read_{0};   // body bytes consumed (wire, excluding chunk framing)
+  size_t body_kept_{0};   // body bytes kept, at most max_body_size_
+  size_t chunk_remaining_{0};
+  size_t trailer_bytes_{0};  // kChunkTrailer: trailer field bytes consumed so far
   std::string method_;
   std::string path_;
   int status_code_{0};
   std::string status_phrase_;
-  std::unordered_map<std::string, std::string> headers_;
+  HeaderBlock headers_;  // arena for the message being parsed; cleared, not freed, per message
   std::string body_;
   bool body_truncated_{false};
   std::string body_encoding_;
+  bool incomplete_{false};
+  Utf8Validator body_utf8_;  // over the kept body bytes, across slices
   bool is_request_{true};
+  HttpStreamParser* response_parser_{nullptr};
+  Counter* headers_too_large_{nullptr};
+  InlineFifo<RequestKind, kMaxExpectedResponses> expected_responses_;  // response parser: requests not yet answered, oldest first
   std::string receiver_ip_;
   uint16_t receiver_port_{0};
   std::string dest_ip_;
   uint16_t dest_port_{0};
-  size_t chunked_consumed_{0};
 };
 
 }  // namespace tcp_sniffer
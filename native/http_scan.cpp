@@ -0,0 +1,141 @@
+/**
+ * TCP Sniffer — HTTP header scanning implementation.
+ */
+
+#include "http_scan.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TCP_SNIFFER_SCAN_X86 1
+#endif
+
+namespace tcp_sniffer {
+
+namespace {
+
+constexpr uint8_t lower_byte(int c) {
+  return static_cast<uint8_t>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+/**
+ * A '\n' at i ends the header block when followed by "\n" or "\r\n". Returns the
+ * end offset or kNoHeaderEnd (also when the bytes needed to decide are not there yet).
+ */
+inline size_t terminator_at(const uint8_t* data, size_t len, size_t i) {
+  if (i + 1 < len && data[i + 1] == '\n') return i + 2;
+  if (i + 2 < len && data[i + 1] == '\r' && data[i + 2] == '\n') return i + 3;
+  return kNoHeaderEnd;
+}
+
+/** Where to restart: two bytes back, so "\n\r\n" split across calls is re-examined. */
+inline size_t resume_point(size_t from) {
+  return from >= 2 ? from - 2 : 0;
+}
+
+#ifdef TCP_SNIFFER_SCAN_X86
+
+size_t find_header_end_sse2(const uint8_t* data, size_t len, size_t from) {
+  size_t i = resume_point(from);
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    while (mask != 0) {
+      size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+      size_t end = terminator_at(data, len, at);
+      if (end != kNoHeaderEnd) return end;
+      mask &= mask - 1;
+    }
+  }
+  return find_header_end_scalar(data, len, i + 2);
+}
+
+__attribute__((target("avx2"))) size_t find_header_end_avx2(const uint8_t* data, size_t len, size_t from) {
+  size_t i = resume_point(from);
+  const __m256i nl = _mm256_set1_epi8('\n');
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    while (mask != 0) {
+      size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+      size_t end = terminator_at(data, len, at);
+      if (end != kNoHeaderEnd) return end;
+      mask &= mask - 1;
+    }
+  }
+  return find_header_end_sse2(data, len, i + 2);
+}
+
+using ScanFn = size_t (*)(const uint8_t*, size_t, size_t);
+
+ScanFn select_scan() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? &find_header_end_avx2 : &find_header_end_sse2;
+}
+
+#endif  // TCP_SNIFFER_SCAN_X86
+
+}  // namespace
+
+const uint8_t kLowerTable[256] = {
+#define TCP_SNIFFER_L4(n) lower_byte(n), lower_byte(n + 1), lower_byte(n + 2), lower_byte(n + 3)
+#define TCP_SNIFFER_L16(n) TCP_SNIFFER_L4(n), TCP_SNIFFER_L4(n + 4), TCP_SNIFFER_L4(n + 8), TCP_SNIFFER_L4(n + 12)
+#define TCP_SNIFFER_L64(n) TCP_SNIFFER_L16(n), TCP_SNIFFER_L16(n + 16), TCP_SNIFFER_L16(n + 32), TCP_SNIFFER_L16(n + 48)
+    TCP_SNIFFER_L64(0), TCP_SNIFFER_L64(64), TCP_SNIFFER_L64(128), TCP_SNIFFER_L64(192),
+#undef TCP_SNIFFER_L64
+#undef TCP_SNIFFER_L16
+#undef TCP_SNIFFER_L4
+};
+
+size_t find_header_end_scalar(const uint8_t* data, size_t len, size_t from) {
+  size_t i = resume_point(from);
+  while (i < len) {
+    const void* hit = std::memchr(data + i, '\n', len - i);
+    if (hit == nullptr) return kNoHeaderEnd;
+    size_t at = static_cast<size_t>(static_cast<const uint8_t*>(hit) - data);
+    size_t end = terminator_at(data, len, at);
+    if (end != kNoHeaderEnd) return end;
+    i = at + 1;
+  }
+  return kNoHeaderEnd;
+}
+
+size_t find_header_end(const uint8_t* data, size_t len, size_t from) {
+#ifdef TCP_SNIFFER_SCAN_X86
+  static const ScanFn scan = select_scan();
+  return scan(data, len, from);
+#else
+  return find_header_end_scalar(data, len, from);
+#endif
+}
+
+std::string lower_ascii(std::string_view s) {
+  std::string out(s.size(), '\0');
+  for (size_t i = 0; i < s.size(); ++i) out[i] = static_cast<char>(kLowerTable[static_cast<uint8_t>(s[i])]);
+  return out;
+}
+
+bool contains_ci(std::string_view haystack, std::string_view lower_needle) {
+  if (lower_needle.empty()) return true;
+  if (haystack.size() < lower_needle.size()) return false;
+  for (size_t i = 0; i + lower_needle.size() <= haystack.size(); ++i) {
+    size_t j = 0;
+    while (j < lower_needle.size() &&
+           kLowerTable[static_cast<uint8_t>(haystack[i + j])] == static_cast<uint8_t>(lower_needle[j])) {
+      ++j;
+    }
+    if (j == lower_needle.size()) return true;
+  }
+  return false;
+}
+
+bool equals_ci(std::string_view s, std::string_view lower) {
+  if (s.size() != lower.size()) return false;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (kLowerTable[static_cast<uint8_t>(s[i])] != static_cast<uint8_t>(lower[i])) return false;
+  }
+  return true;
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,45 @@
+/**
+ * TCP Sniffer — HTTP header scanning primitives (A3).
+ * Vectorized search for the end of a header block and ASCII lowercasing, used by
+ * HttpStreamParser. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_HTTP_SCAN_HPP
+#define TCP_SNIFFER_HTTP_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace tcp_sniffer {
+
+constexpr size_t kNoHeaderEnd = static_cast<size_t>(-1);
+
+/**
+ * Find the blank line ending a header block ("\r\n\r\n" or "\n\n") in data[0, len),
+ * starting the search at `from`. Returns the offset just past the terminator, or
+ * kNoHeaderEnd. Callers resuming an incomplete block pass the previous len as from;
+ * terminators straddling that point are still found.
+ * Uses AVX2 or SSE2 on x86-64 (picked at runtime), memchr elsewhere.
+ */
+size_t find_header_end(const uint8_t* data, size_t len, size_t from);
+
+/** Scalar reference for find_header_end (tests and benchmarks). */
+size_t find_header_end_scalar(const uint8_t* data, size_t len, size_t from);
+
+/** ASCII lowercase lookup table (bytes >= 0x80 map to themselves). */
+extern const uint8_t kLowerTable[256];
+
+/** Lowercase an ASCII token into a new string. */
+std::string lower_ascii(std::string_view s);
+
+/** Case-insensitive search for an ASCII token (needle must be lowercase). */
+bool contains_ci(std::string_view haystack, std::string_view lower_needle);
+
+/** Case-insensitive equality with an ASCII token (lower must be lowercase). */
+bool equals_ci(std::string_view s, std::string_view lower);
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_HTTP_SCAN_HPP
@@ -0,0 +1,117 @@
+/**
+ * TCP Sniffer — Load shedding implementation.
+ */
+
+#include "load_shedder.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace tcp_sniffer {
+
+namespace {
+
+uint64_t steady_now_ms() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+}  // namespace
+
+const char* shed_level_name(ShedLevel level) {
+  switch (level) {
+    case ShedLevel::kNone: return "none";
+    case ShedLevel::kNoBodies: return "noBodies";
+    case ShedLevel::kReducedSampling: return "reducedSampling";
+    case ShedLevel::kNoNewConnections: return "noNewConnections";
+  }
+  return "none";
+}
+
+LoadShedder::LoadShedder(LoadShedConfig config) : config_(config) {
+  if (config_.interval_ms == 0) config_.interval_ms = 1;
+}
+
+LoadShedder::~LoadShedder() {
+  stop();
+}
+
+void LoadShedder::start(LoadSampler sampler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable()) return;
+  sampler_ = std::move(sampler);
+  stopping_ = false;
+  changed_at_ms_ = steady_now_ms();
+  thread_ = std::thread(&LoadShedder::run, this);
+}
+
+void LoadShedder::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
+
+LoadSignals LoadShedder::signals() const {
+  LoadSignals s;
+  s.queue_fill = queue_fill_.load(std::memory_order_relaxed);
+  s.ring_fill = ring_fill_.load(std::memory_order_relaxed);
+  s.busy = busy_.load(std::memory_order_relaxed);
+  return s;
+}
+
+void LoadShedder::update(const LoadSignals& signals, uint64_t now_ms) {
+  queue_fill_.store(signals.queue_fill, std::memory_order_relaxed);
+  ring_fill_.store(signals.ring_fill, std::memory_order_relaxed);
+  busy_.store(signals.busy, std::memory_order_relaxed);
+  double pressure = std::max({signals.queue_fill, signals.ring_fill, signals.busy});
+  ShedLevel current = level();
+
+  if (pressure > config_.low_watermark) {
+    calm_ = false;
+  } else if (!calm_) {
+    calm_ = true;
+    calm_since_ms_ = now_ms;
+  }
+
+  // Escalate quickly, recover slowly: one level per step either way, so a burst
+  // sheds bodies before it costs any flows.
+  if (pressure >= config_.high_watermark) {
+    if (current != ShedLevel::kNoNewConnections && now_ms - changed_at_ms_ >= config_.escalate_after_ms) {
+      set_level(static_cast<ShedLevel>(static_cast<uint8_t>(current) + 1), now_ms);
+    }
+  } else if (calm_ && current != ShedLevel::kNone && now_ms - calm_since_ms_ >= config_.recover_after_ms &&
+             now_ms - changed_at_ms_ >= config_.recover_after_ms) {
+    set_level(static_cast<ShedLevel>(static_cast<uint8_t>(current) - 1), now_ms);
+  }
+}
+
+void LoadShedder::set_level(ShedLevel level, uint64_t now_ms) {
+  ShedLevel previous = level_.exchange(level, std::memory_order_relaxed);
+  transitions_.add();
+  changed_at_ms_ = now_ms;
+  Logger& log = Logger::instance();
+  if (log.admit(LogEvent::kLoadShed)) {
+    log.write(LogEvent::kLoadShed,
+              "\"shedLevel\":\"%s\",\"previousShedLevel\":\"%s\",\"queueFill\":%.3f,\"ringFill\":%.3f,\"busy\":%.3f",
+              shed_level_name(level), shed_level_name(previous), queue_fill_.load(std::memory_order_relaxed),
+              ring_fill_.load(std::memory_order_relaxed), busy_.load(std::memory_order_relaxed));
+  }
+}
+
+void LoadShedder::run() {
+  const auto interval = std::chrono::milliseconds(config_.interval_ms);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    cv_.wait_for(lock, interval, [this] { return stopping_; });
+    if (stopping_) break;
+    lock.unlock();
+    update(sampler_(), steady_now_ms());
+    lock.lock();
+  }
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,103 @@
+/**
+ * TCP Sniffer — Adaptive load shedding (A4).
+ * Samples the engine's own lag (message queue fill, capture ring fill, time spent per
+ * packet) and, under sustained overload, degrades in stages that lose whole flows
+ * deterministically instead of letting the kernel drop packets at random.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_LOAD_SHEDDER_HPP
+#define TCP_SNIFFER_LOAD_SHEDDER_HPP
+
+#include "stats.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace tcp_sniffer {
+
+/** Cumulative: each level also applies the ones below it. */
+enum class ShedLevel : uint8_t {
+  kNone,
+  kNoBodies,          // parsers keep no body bytes, from each stream's next message
+  kReducedSampling,   // new flows sampled at reduced_sample_fraction of sample_rate
+  kNoNewConnections,  // packets of untracked flows are dropped before creating state
+};
+
+/** Name reported to JS: "none", "noBodies", "reducedSampling", "noNewConnections". */
+const char* shed_level_name(ShedLevel level);
+
+/** One sample of lag, each as a fraction in [0, 1]. */
+struct LoadSignals {
+  double queue_fill{0};  // messages queued / message queue capacity
+  double ring_fill{0};   // fullest capture ring (tpacket backend)
+  double busy{0};        // busiest worker's share of wall time spent in push_segment
+};
+
+using LoadSampler = std::function<LoadSignals()>;
+
+struct LoadShedConfig {
+  uint64_t interval_ms{100};
+  /** Pressure (the largest signal) at or above this raises the level by one... */
+  double high_watermark{0.8};
+  /** ...at most once per escalate_after_ms. */
+  uint64_t escalate_after_ms{200};
+  /** Pressure at or below this for recover_after_ms lowers the level by one. */
+  double low_watermark{0.5};
+  uint64_t recover_after_ms{2000};
+  /** kReducedSampling keeps this share of the flows sample_rate would keep. */
+  double reduced_sample_fraction{0.25};
+};
+
+/**
+ * Owns one sampling thread that feeds update(). Capture threads read level() once
+ * per segment (a relaxed load); everything else is read by getStats().
+ */
+class LoadShedder {
+ public:
+  explicit LoadShedder(LoadShedConfig config = {});
+  ~LoadShedder();
+  LoadShedder(const LoadShedder&) = delete;
+  LoadShedder& operator=(const LoadShedder&) = delete;
+
+  /** Start sampling every interval_ms; sampler runs on the shedder's thread. */
+  void start(LoadSampler sampler);
+
+  /** Join the sampling thread. The level is kept (stop() of the engine follows). */
+  void stop();
+
+  /** One evaluation step with a sample taken at now_ms (steady clock). */
+  void update(const LoadSignals& signals, uint64_t now_ms);
+
+  ShedLevel level() const { return level_.load(std::memory_order_relaxed); }
+  uint64_t transitions() const { return transitions_.get(); }
+  /** Most recent sample. */
+  LoadSignals signals() const;
+  const LoadShedConfig& config() const { return config_; }
+
+ private:
+  void run();
+  void set_level(ShedLevel level, uint64_t now_ms);
+
+  LoadShedConfig config_;
+  LoadSampler sampler_;
+  std::atomic<ShedLevel> level_{ShedLevel::kNone};
+  Counter transitions_;
+  std::atomic<double> queue_fill_{0};
+  std::atomic<double> ring_fill_{0};
+  std::atomic<double> busy_{0};
+  uint64_t changed_at_ms_{0};
+  bool calm_{false};  // pressure has stayed at or below low_watermark since calm_since_ms_
+  uint64_t calm_since_ms_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_LOAD_SHEDDER_HPP
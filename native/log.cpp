@@ -0,0 +1,281 @@
+/**
+ * TCP Sniffer — Native structured logging implementation.
+ */
+
+#include "log.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace tcp_sniffer {
+
+namespace {
+
+struct EventInfo {
+  const char* name;     // "event" field
+  const char* message;  // "message" field of a single record
+  LogLevel level;
+};
+
+constexpr EventInfo kEvents[] = {
+    {"capture_started", "capture started", LogLevel::kInfo},
+    {"eviction", "connection evicted", LogLevel::kInfo},
+    {"reassembly_gap", "reassembly gap", LogLevel::kWarn},
+    {"reassembly_gap_skipped", "reassembly gap skipped", LogLevel::kWarn},
+    {"reassembly_out_of_order_overflow", "out-of-order buffer full", LogLevel::kWarn},
+    {"load_shed", "load shedding level changed", LogLevel::kWarn},
+    {"stdout_write_failed", "stdout write failed, discarding nativeStdout output", LogLevel::kError},
+};
+static_assert(sizeof(kEvents) / sizeof(kEvents[0]) == static_cast<size_t>(LogEvent::kCount),
+              "one EventInfo per LogEvent");
+
+/** How often the drain thread wakes to write queued records. */
+constexpr auto kDrainInterval = std::chrono::milliseconds(50);
+constexpr uint64_t kRateWindowMs = 1000;
+
+const char* level_name(LogLevel level) {
+  switch (level) {
+    case LogLevel::kDebug: return "debug";
+    case LogLevel::kInfo: return "info";
+    case LogLevel::kWarn: return "warn";
+    case LogLevel::kError: return "error";
+  }
+  return "info";
+}
+
+uint64_t wall_now_us() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+uint64_t steady_now_ms() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/** ISO 8601 with milliseconds in UTC, as Date.prototype.toISOString. */
+void append_iso_timestamp(std::string& out, uint64_t wall_us) {
+  time_t secs = static_cast<time_t>(wall_us / 1000000);
+  struct tm tm_utc;
+  gmtime_r(&secs, &tm_utc);
+  char buf[32];
+  size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm_utc);
+  snprintf(buf + n, sizeof(buf) - n, ".%03uZ", static_cast<unsigned>((wall_us / 1000) % 1000));
+  out += buf;
+}
+
+/** 12345 -> "12,345", for summary messages. */
+std::string group_digits(uint64_t v) {
+  std::string digits = std::to_string(v);
+  std::string out;
+  for (size_t i = 0; i < digits.size(); ++i) {
+    if (i > 0 && (digits.size() - i) % 3 == 0) out += ',';
+    out += digits[i];
+  }
+  return out;
+}
+
+/** Same members and order as getPlacement() in src/logger.ts; empty when none is set. */
+std::string render_placement() {
+  const char* keys[] = {"pod", "namespace", "node"};
+  const char* vars[] = {"POD_NAME", "NAMESPACE", "NODE_NAME"};
+  std::string members;
+  for (size_t i = 0; i < 3; ++i) {
+    const char* v = getenv(vars[i]);
+    if (v == nullptr) continue;
+    if (!members.empty()) members += ',';
+    members += std::string("\"") + keys[i] + "\":\"" + json_escape(v) + "\"";
+  }
+  return members.empty() ? std::string() : ",\"placement\":{" + members + "}";
+}
+
+}  // namespace
+
+std::string json_escape(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (char c : s) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+          out += buf;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out;
+}
+
+Logger& Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger() : slots_(new Slot[kRingCapacity]), placement_(render_placement()) {
+  for (size_t i = 0; i < kRingCapacity; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+  thread_ = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stopping_ = true;
+  }
+  wake_cv_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
+
+bool Logger::admit(LogEvent event) {
+  EventCounters& c = counters_[static_cast<size_t>(event)];
+  c.interval.fetch_add(1, std::memory_order_relaxed);
+  if (c.window.fetch_add(1, std::memory_order_relaxed) < kBurstPerSecond) return true;
+  c.suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void Logger::write(LogEvent event, const char* fields_fmt, ...) {
+  // Bounded MPMC ring (Vyukov): a slot is free for position pos when its seq equals
+  // pos and holds a record for the consumer when it equals pos + 1.
+  size_t pos = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos % kRingCapacity];
+    size_t seq = slot->seq.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      ring_drops_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+  Record& r = slot->record;
+  r.wall_us = wall_now_us();
+  r.event = event;
+  va_list args;
+  va_start(args, fields_fmt);
+  int n = vsnprintf(r.fields, sizeof(r.fields), fields_fmt, args);
+  va_end(args);
+  // A cut-off fragment would make the line invalid JSON.
+  if (n < 0 || static_cast<size_t>(n) >= sizeof(r.fields)) snprintf(r.fields, sizeof(r.fields), "\"truncated\":true");
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::append_line(std::string& out, uint64_t wall_us, LogLevel level, const std::string& message,
+                         const char* event, const char* fields) {
+  out += "{\"timestamp\":\"";
+  append_iso_timestamp(out, wall_us);
+  out += "\",\"level\":\"";
+  out += level_name(level);
+  out += "\",\"message\":\"";
+  out += message;
+  out += '"';
+  out += placement_;
+  out += ",\"event\":\"";
+  out += event;
+  out += '"';
+  if (fields[0] != '\0') {
+    out += ',';
+    out += fields;
+  }
+  out += "}\n";
+}
+
+void Logger::drain_locked(std::string& out) {
+  for (;;) {
+    Slot& slot = slots_[tail_ % kRingCapacity];
+    if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) return;
+    const EventInfo& info = kEvents[static_cast<size_t>(slot.record.event)];
+    append_line(out, slot.record.wall_us, info.level, info.message, info.name, slot.record.fields);
+    slot.seq.store(tail_ + kRingCapacity, std::memory_order_release);
+    ++tail_;
+  }
+}
+
+void Logger::summarize(std::string& out, uint64_t interval_ms) {
+  uint64_t now_us = wall_now_us();
+  std::string seconds = interval_ms >= 1000 ? std::to_string((interval_ms + 500) / 1000) + "s"
+                                            : std::to_string(interval_ms) + "ms";
+  char fields[128];
+  for (size_t i = 0; i < counters_.size(); ++i) {
+    EventCounters& c = counters_[i];
+    uint64_t suppressed = c.suppressed.exchange(0, std::memory_order_relaxed);
+    uint64_t count = c.interval.exchange(0, std::memory_order_relaxed);
+    // Without suppression every occurrence already has its own line.
+    if (suppressed == 0) continue;
+    snprintf(fields, sizeof(fields), "\"count\":%llu,\"suppressed\":%llu,\"intervalMs\":%llu",
+             static_cast<unsigned long long>(count), static_cast<unsigned long long>(suppressed),
+             static_cast<unsigned long long>(interval_ms));
+    append_line(out, now_us, kEvents[i].level, group_digits(count) + " " + kEvents[i].name + " events in last " + seconds,
+                kEvents[i].name, fields);
+  }
+  uint64_t drops = ring_drops_.exchange(0, std::memory_order_relaxed);
+  if (drops > 0) {
+    snprintf(fields, sizeof(fields), "\"count\":%llu,\"intervalMs\":%llu", static_cast<unsigned long long>(drops),
+             static_cast<unsigned long long>(interval_ms));
+    append_line(out, now_us, LogLevel::kWarn, group_digits(drops) + " log records dropped (ring full) in last " + seconds,
+                "log_dropped", fields);
+  }
+}
+
+void Logger::flush() {
+  std::string out;
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_locked(out);
+  }
+  if (!out.empty()) {
+    fwrite(out.data(), 1, out.size(), stderr);
+    fflush(stderr);
+  }
+}
+
+void Logger::run() {
+  uint64_t window_start = steady_now_ms();
+  uint64_t summary_start = window_start;
+  std::string out;
+  bool stopping = false;
+  while (!stopping) {
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_cv_.wait_for(lock, kDrainInterval, [this] { return stopping_; });
+      stopping = stopping_;
+    }
+    uint64_t now = steady_now_ms();
+    if (now - window_start >= kRateWindowMs) {
+      for (EventCounters& c : counters_) c.window.store(0, std::memory_order_relaxed);
+      window_start = now;
+    }
+    out.clear();
+    {
+      std::lock_guard<std::mutex> lock(drain_mutex_);
+      drain_locked(out);
+      // The last, partial interval is summarized too so no suppressed count is lost at exit.
+      if (stopping || now - summary_start >= kSummaryIntervalMs) {
+        summarize(out, now - summary_start);
+        summary_start = now;
+      }
+    }
+    // One write per pass, however many records were queued.
+    if (!out.empty()) {
+      fwrite(out.data(), 1, out.size(), stderr);
+      fflush(stderr);
+    }
+  }
+}
+
+}  // namespace tcp_sniffer
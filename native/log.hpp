@@ -0,0 +1,116 @@
+/**
+ * TCP Sniffer — Native structured logging (A5).
+ * Capture and reassembly threads push records onto a lock-free ring; a background thread
+ * writes them to stderr as JSON lines in the format of src/logger.ts. Each event type is
+ * rate limited, and what the limit suppressed is reported as a periodic summary.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_LOG_HPP
+#define TCP_SNIFFER_LOG_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace tcp_sniffer {
+
+enum class LogLevel : uint8_t { kDebug, kInfo, kWarn, kError };
+
+/** Event types; each has its own message, level, rate limit and summary. */
+enum class LogEvent : uint8_t {
+  kCaptureStarted,
+  kEviction,
+  kReassemblyGap,
+  kReassemblyGapSkipped,
+  kOutOfOrderOverflow,
+  kLoadShed,
+  kStdoutWriteFailed,
+  kCount
+};
+
+/** Escapes s for use inside a JSON string literal. */
+std::string json_escape(const std::string& s);
+
+class Logger {
+ public:
+  /** Records per event type written per second; the rest are only counted. */
+  static constexpr uint32_t kBurstPerSecond = 10;
+  /** Interval of the summary lines for event types that had records suppressed. */
+  static constexpr uint64_t kSummaryIntervalMs = 10000;
+  static constexpr size_t kRingCapacity = 1024;
+  /** Room for the pre-rendered fields of one record. */
+  static constexpr size_t kFieldsSize = 256;
+
+  /** Process-wide logger; the drain thread starts on first use. */
+  static Logger& instance();
+
+  ~Logger();
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  /**
+   * Counts an occurrence of event and returns whether it is within its rate limit.
+   * Call before building the record so a suppressed event costs only a few relaxed atomic adds.
+   */
+  bool admit(LogEvent event);
+
+  /**
+   * Queues a record without blocking. fields_fmt renders the JSON members after
+   * timestamp, level, message and event (e.g. "\"bytes\":%llu", no braces or leading
+   * comma); string values must already be escaped. Fields longer than kFieldsSize are
+   * replaced by "truncated":true. A full ring drops the record and counts it for the
+   * next summary.
+   */
+  void write(LogEvent event, const char* fields_fmt, ...) __attribute__((format(printf, 3, 4)));
+
+  /** Writes out everything queued so far (e.g. on stop, before control returns to JS). */
+  void flush();
+
+ private:
+  struct Record {
+    uint64_t wall_us;
+    LogEvent event;
+    char fields[kFieldsSize];
+  };
+  struct Slot {
+    std::atomic<size_t> seq;
+    Record record;
+  };
+  struct EventCounters {
+    std::atomic<uint32_t> window{0};      // occurrences in the current second
+    std::atomic<uint64_t> interval{0};    // occurrences since the last summary
+    std::atomic<uint64_t> suppressed{0};  // over the rate limit since the last summary
+  };
+
+  Logger();
+  void run();
+  /** Formats queued records into out; caller holds drain_mutex_. */
+  void drain_locked(std::string& out);
+  void summarize(std::string& out, uint64_t interval_ms);
+  void append_line(std::string& out, uint64_t wall_us, LogLevel level, const std::string& message,
+                   const char* event, const char* fields);
+
+  std::unique_ptr<Slot[]> slots_;
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) size_t tail_{0};
+  std::array<EventCounters, static_cast<size_t>(LogEvent::kCount)> counters_{};
+  std::atomic<uint64_t> ring_drops_{0};
+  std::string placement_;  // pre-rendered ,"placement":{...} or empty
+
+  std::mutex drain_mutex_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_LOG_HPP
@@ -0,0 +1,97 @@
+/**
+ * TCP Sniffer — Binary message batch encoding implementation.
+ */
+
+#include "message_codec.hpp"
+#include <string>
+#include <string_view>
+
+namespace tcp_sniffer {
+
+namespace {
+
+void put_u16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(static_cast<uint8_t>(v));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 24));
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t v) {
+  put_u32(out, static_cast<uint32_t>(v));
+  put_u32(out, static_cast<uint32_t>(v >> 32));
+}
+
+void patch_u32(std::vector<uint8_t>& out, size_t at, uint32_t v) {
+  out[at] = static_cast<uint8_t>(v);
+  out[at + 1] = static_cast<uint8_t>(v >> 8);
+  out[at + 2] = static_cast<uint8_t>(v >> 16);
+  out[at + 3] = static_cast<uint8_t>(v >> 24);
+}
+
+/** u32 byte length, then the bytes. */
+void put_str(std::vector<uint8_t>& out, std::string_view s) {
+  put_u32(out, static_cast<uint32_t>(s.size()));
+  out.insert(out.end(), s.begin(), s.end());
+}
+
+size_t encoded_size(const HttpMessageData& m) {
+  // length + flags/reserved + 3 x u16 + 3 x u64 + 6 strings and the header count (u32 each).
+  size_t n = 4 + 2 + 6 + 24 + 7 * 4;
+  n += m.receiver_ip.size() + m.dest_ip.size() + m.method.size() + m.path.size() + m.body_encoding.size() +
+       m.body.size();
+  n += 8 * m.headers.size() + m.headers.byte_size();
+  if (m.request) n += encoded_size(*m.request);
+  return n;
+}
+
+void put_record(std::vector<uint8_t>& out, const HttpMessageData& m) {
+  size_t length_at = out.size();
+  put_u32(out, 0);
+  uint8_t flags = 0;
+  if (m.is_request) flags |= kMessageFlagRequest;
+  if (m.body_truncated) flags |= kMessageFlagBodyTruncated;
+  if (m.request) flags |= kMessageFlagHasRequest;
+  if (m.incomplete) flags |= kMessageFlagIncomplete;
+  out.push_back(flags);
+  out.push_back(0);
+  put_u16(out, m.receiver_port);
+  put_u16(out, m.dest_port);
+  put_u16(out, static_cast<uint16_t>(m.status_code));
+  put_u64(out, m.first_byte_us);
+  put_u64(out, m.complete_us);
+  put_u64(out, m.body_length);
+  put_str(out, m.receiver_ip);
+  put_str(out, m.dest_ip);
+  put_str(out, m.method);
+  put_str(out, m.path);
+  put_str(out, m.body_encoding);
+  put_str(out, m.body);
+  if (m.request) put_record(out, *m.request);
+  // Headers last, so a reader can reach everything else without walking them.
+  put_u32(out, static_cast<uint32_t>(m.headers.size()));
+  for (const auto& [k, v] : m.headers) {
+    put_str(out, k);
+    put_str(out, v);
+  }
+  patch_u32(out, length_at, static_cast<uint32_t>(out.size() - length_at - 4));
+}
+
+}  // namespace
+
+void encode_message_batch(const std::vector<HttpMessageData>& messages, std::vector<uint8_t>& out) {
+  size_t total = 8;
+  for (const HttpMessageData& m : messages) total += encoded_size(m);
+  out.clear();
+  out.reserve(total);
+  put_u32(out, kMessageBatchMagic);
+  put_u32(out, static_cast<uint32_t>(messages.size()));
+  for (const HttpMessageData& m : messages) put_record(out, m);
+}
+
+}  // namespace tcp_sniffer
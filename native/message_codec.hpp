@@ -0,0 +1,31 @@
+/**
+ * TCP Sniffer — Binary message batch encoding (A4).
+ * Serializes a batch of HttpMessageData into one contiguous buffer for
+ * messageEncoding: 'binary'. Layout: docs/specs/TS_CPP_CONTRACT.md §2.1; decoder:
+ * src/binary-message.ts.
+ */
+
+#ifndef TCP_SNIFFER_MESSAGE_CODEC_HPP
+#define TCP_SNIFFER_MESSAGE_CODEC_HPP
+
+#include "http_parser.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/** "TSB1" read as a little-endian u32. */
+constexpr uint32_t kMessageBatchMagic = 0x31425354;
+
+constexpr uint8_t kMessageFlagRequest = 0x01;
+constexpr uint8_t kMessageFlagBodyTruncated = 0x02;
+/** A nested request record follows the body (correlateExchanges). */
+constexpr uint8_t kMessageFlagHasRequest = 0x04;
+constexpr uint8_t kMessageFlagIncomplete = 0x08;
+
+/** Replace out with the encoding of messages. */
+void encode_message_batch(const std::vector<HttpMessageData>& messages, std::vector<uint8_t>& out);
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_MESSAGE_CODEC_HPP
@@ -0,0 +1,110 @@
+/**
+ * TCP Sniffer — Message queue implementation.
+ */
+
+#include "message_queue.hpp"
+#include <algorithm>
+
+namespace tcp_sniffer {
+
+MessageQueue::MessageQueue(MessageQueueConfig config, BatchSink sink)
+    : config_(config), sink_(std::move(sink)) {
+  if (config_.capacity == 0) config_.capacity = 1;
+  if (config_.batch_size == 0) config_.batch_size = 1;
+  if (config_.max_in_flight == 0) config_.max_in_flight = 1;
+  ring_.resize(config_.capacity);
+}
+
+MessageQueue::~MessageQueue() {
+  stop();
+}
+
+void MessageQueue::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable()) return;
+  stopping_ = false;
+  draining_ = false;
+  thread_ = std::thread(&MessageQueue::run, this);
+}
+
+bool MessageQueue::push(HttpMessageData&& msg) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (count_ == config_.capacity && config_.policy == BackpressurePolicy::kBlock && !stopping_) {
+    not_full_cv_.wait(lock, [this] { return count_ < config_.capacity || stopping_; });
+  }
+  if (count_ == config_.capacity || stopping_) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  ring_[(head_ + count_) % config_.capacity] = std::move(msg);
+  if (count_++ == 0) oldest_ = Clock::now();
+  // Wake the flusher to start the latency timer, or because a batch is ready.
+  if (count_ == 1 || count_ == config_.batch_size) flusher_cv_.notify_one();
+  return true;
+}
+
+void MessageQueue::batch_done() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (in_flight_ > 0) --in_flight_;
+  flusher_cv_.notify_one();
+}
+
+MessageBatch* MessageQueue::take_batch() {
+  size_t n = std::min(count_, config_.batch_size);
+  auto* batch = new MessageBatch();
+  batch->reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    batch->push_back(std::move(ring_[head_]));
+    head_ = (head_ + 1) % config_.capacity;
+  }
+  count_ -= n;
+  if (count_ > 0) oldest_ = Clock::now();
+  return batch;
+}
+
+void MessageQueue::run() {
+  const auto latency = std::chrono::milliseconds(config_.batch_latency_ms);
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    flusher_cv_.wait(lock, [this] { return count_ > 0 || stopping_; });
+    if (count_ == 0) break;  // stopping and drained
+    if (count_ < config_.batch_size && !stopping_) {
+      flusher_cv_.wait_until(lock, oldest_ + latency,
+                             [this] { return count_ >= config_.batch_size || stopping_; });
+    }
+    // Bound batches queued toward the consumer; once draining, flush regardless.
+    flusher_cv_.wait(lock, [this] { return in_flight_ < config_.max_in_flight || draining_ || stopping_; });
+    MessageBatch* batch = take_batch();
+    ++in_flight_;
+    not_full_cv_.notify_all();
+    lock.unlock();
+    sink_(batch);
+    lock.lock();
+  }
+}
+
+void MessageQueue::depth(size_t* queued, size_t* in_flight) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  *queued = count_;
+  *in_flight = in_flight_;
+}
+
+void MessageQueue::begin_drain() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    draining_ = true;
+  }
+  flusher_cv_.notify_all();
+}
+
+void MessageQueue::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  flusher_cv_.notify_all();
+  not_full_cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+}  // namespace tcp_sniffer
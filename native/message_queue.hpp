@@ -0,0 +1,99 @@
+/**
+ * TCP Sniffer — Bounded message queue and batcher (A4).
+ * Capture workers push parsed messages into a fixed-capacity ring; one flusher thread
+ * hands them to the sink in batches, when a batch fills or the oldest message has
+ * waited batch_latency_ms. When the ring is full, messages are dropped (counted) or
+ * the producer blocks, per policy. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_MESSAGE_QUEUE_HPP
+#define TCP_SNIFFER_MESSAGE_QUEUE_HPP
+
+#include "http_parser.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tcp_sniffer {
+
+enum class BackpressurePolicy { kDrop, kBlock };
+
+struct MessageQueueConfig {
+  size_t capacity{8192};
+  size_t batch_size{256};
+  uint64_t batch_latency_ms{10};
+  BackpressurePolicy policy{BackpressurePolicy::kDrop};
+  /** Batches handed to the sink but not yet acknowledged with batch_done(). */
+  size_t max_in_flight{2};
+};
+
+using MessageBatch = std::vector<HttpMessageData>;
+
+/** Receives ownership of each batch; called on the flusher thread. */
+using BatchSink = std::function<void(MessageBatch* batch)>;
+
+class MessageQueue {
+ public:
+  MessageQueue(MessageQueueConfig config, BatchSink sink);
+  ~MessageQueue();
+  MessageQueue(const MessageQueue&) = delete;
+  MessageQueue& operator=(const MessageQueue&) = delete;
+
+  /** Start the flusher thread. */
+  void start();
+
+  /** Enqueue a message (thread-safe). Returns false if it was dropped. */
+  bool push(HttpMessageData&& msg);
+
+  /** The consumer finished with one batch; frees an in-flight slot. */
+  void batch_done();
+
+  /**
+   * Stop applying the in-flight limit so queued messages (and producers blocked on a
+   * full ring) make progress while the consumer thread is busy shutting down.
+   */
+  void begin_drain();
+
+  /**
+   * Flush everything still queued (ignoring the in-flight limit, since the consumer
+   * may be the caller) and join the flusher. Pushes after stop() are dropped.
+   */
+  void stop();
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  size_t capacity() const { return config_.capacity; }
+
+  /** Messages waiting in the ring and batches handed to the sink but not yet done (locks). */
+  void depth(size_t* queued, size_t* in_flight);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void run();
+  MessageBatch* take_batch();
+
+  MessageQueueConfig config_;
+  BatchSink sink_;
+  std::vector<HttpMessageData> ring_;
+  size_t head_{0};
+  size_t count_{0};
+  size_t in_flight_{0};
+  bool stopping_{false};
+  bool draining_{false};
+  Clock::time_point oldest_{};  // enqueue time of ring_[head_] (approximate after a partial take)
+  std::mutex mutex_;
+  std::condition_variable flusher_cv_;
+  std::condition_variable not_full_cv_;
+  std::atomic<uint64_t> dropped_{0};
+  std::thread thread_;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_MESSAGE_QUEUE_HPP
@@ -0,0 +1,276 @@
+/**
+ * TCP Sniffer — NDJSON message encoding implementation.
+ */
+
+#include "ndjson_codec.hpp"
+#include "timestamp.hpp"
+#include "utf8.hpp"
+#include <charconv>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TCP_SNIFFER_JSON_SSE2 1
+#endif
+
+namespace tcp_sniffer {
+
+namespace {
+
+inline bool needs_escape(uint8_t c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+void append_escape(std::string& out, uint8_t c) {
+  switch (c) {
+    case '"': out += "\\\""; return;
+    case '\\': out += "\\\\"; return;
+    case '\b': out += "\\b"; return;
+    case '\f': out += "\\f"; return;
+    case '\n': out += "\\n"; return;
+    case '\r': out += "\\r"; return;
+    case '\t': out += "\\t"; return;
+    default: {
+      static const char kHex[] = "0123456789abcdef";
+      char buf[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf]};
+      out.append(buf, sizeof(buf));
+    }
+  }
+}
+
+/** Escapes s[from, len) onto out; bytes up to `run` before from are still unwritten. */
+void escape_tail(std::string& out, const char* s, size_t len, size_t from, size_t run) {
+  for (size_t i = from; i < len; ++i) {
+    uint8_t c = static_cast<uint8_t>(s[i]);
+    if (!needs_escape(c)) continue;
+    out.append(s + run, i - run);
+    append_escape(out, c);
+    run = i + 1;
+  }
+  out.append(s + run, len - run);
+}
+
+void escape_valid(std::string& out, std::string_view sv) {
+  const char* s = sv.data();
+  size_t len = sv.size();
+  size_t i = 0;
+  size_t run = 0;
+#ifdef TCP_SNIFFER_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control_max = _mm_set1_epi8(0x1f);
+  while (i + 16 <= len) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    // max_epu8(v, 0x1f) == 0x1f exactly for the unsigned bytes <= 0x1f.
+    __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                _mm_cmpeq_epi8(_mm_max_epu8(v, control_max), control_max));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+    if (mask == 0) {
+      i += 16;
+      continue;
+    }
+    size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+    out.append(s + run, at - run);
+    append_escape(out, static_cast<uint8_t>(s[at]));
+    run = i = at + 1;
+  }
+#endif
+  escape_tail(out, s, len, i, run);
+}
+
+/**
+ * Copy of s with each maximal invalid subsequence replaced by U+FFFD, the WHATWG
+ * decoding V8 applies when it makes a JS string from UTF-8.
+ */
+std::string replace_invalid_utf8(std::string_view s) {
+  static const char kReplacement[] = "\xEF\xBF\xBD";
+  std::string out;
+  out.reserve(s.size() + 8);
+  size_t i = 0;
+  while (i < s.size()) {
+    uint8_t c = static_cast<uint8_t>(s[i]);
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+      ++i;
+      continue;
+    }
+    size_t need = 0;
+    uint8_t lower = 0x80, upper = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+      need = 1;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      need = 2;
+      if (c == 0xE0) lower = 0xA0;
+      if (c == 0xED) upper = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      need = 3;
+      if (c == 0xF0) lower = 0x90;
+      if (c == 0xF4) upper = 0x8F;
+    }
+    size_t j = i + 1;
+    size_t seen = 0;
+    while (seen < need && j < s.size()) {
+      uint8_t b = static_cast<uint8_t>(s[j]);
+      if (b < lower || b > upper) break;
+      lower = 0x80;
+      upper = 0xBF;
+      ++j;
+      ++seen;
+    }
+    if (need != 0 && seen == need) {
+      out.append(s.data() + i, j - i);
+    } else {
+      out.append(kReplacement, 3);
+    }
+    i = j;
+  }
+  return out;
+}
+
+template <typename T>
+void append_int(std::string& out, T v) {
+  char buf[24];
+  auto res = std::to_chars(buf, buf + sizeof(buf), v);
+  out.append(buf, static_cast<size_t>(res.ptr - buf));
+}
+
+void append_endpoint(std::string& out, const char* key, const std::string& ip, uint16_t port) {
+  out += key;
+  out += "{\"ip\":";
+  append_json_string(out, ip, true);
+  out += ",\"port\":";
+  append_int(out, port);
+  out += '}';
+}
+
+/** Same members, order and omissions as message_to_object in addon.cpp. */
+void append_message(std::string& out, const HttpMessageData& m) {
+  append_endpoint(out, "{\"receiver\":", m.receiver_ip, m.receiver_port);
+  append_endpoint(out, ",\"destination\":", m.dest_ip, m.dest_port);
+  out += m.is_request ? ",\"direction\":\"request\"" : ",\"direction\":\"response\"";
+  if (!m.method.empty()) {
+    out += ",\"method\":";
+    append_json_string(out, m.method);
+  }
+  if (!m.path.empty()) {
+    out += ",\"path\":";
+    append_json_string(out, m.path);
+  }
+  if (m.status_code != 0) {
+    out += ",\"statusCode\":";
+    append_int(out, m.status_code);
+  }
+  out += ",\"headers\":{";
+  // A JS object keeps a repeated name at its first position with its last value.
+  bool first = true;
+  for (size_t i = 0; i < m.headers.size(); ++i) {
+    auto [name, value] = m.headers[i];
+    bool repeated = false;
+    for (size_t j = 0; j < i && !repeated; ++j) repeated = m.headers[j].first == name;
+    if (repeated) continue;
+    for (size_t j = i + 1; j < m.headers.size(); ++j) {
+      if (m.headers[j].first == name) value = m.headers[j].second;
+    }
+    if (!first) out += ',';
+    first = false;
+    append_json_string(out, name);
+    out += ':';
+    append_json_string(out, value);
+  }
+  out += "},\"timestamp\":\"";
+  out += format_iso_timestamp(m.first_byte_us);
+  out += "\",\"timestampUs\":";
+  append_int(out, m.first_byte_us);
+  if (!m.body.empty()) {
+    out += ",\"body\":";
+    append_json_string(out, m.body, true);  // the parser keeps only valid UTF-8 bodies
+  }
+  if (m.body_length != 0) {
+    out += ",\"bodyLength\":";
+    append_int(out, m.body_length);
+  }
+  if (m.body_truncated) out += ",\"bodyTruncated\":true";
+  if (!m.body_encoding.empty()) {
+    out += ",\"bodyEncoding\":";
+    append_json_string(out, m.body_encoding, true);
+  }
+  if (m.incomplete) out += ",\"incomplete\":true";
+  out += '}';
+}
+
+/** Same members and order as exchange_to_object in addon.cpp. */
+void append_exchange(std::string& out, const HttpMessageData& m) {
+  const HttpMessageData* request = m.is_request ? &m : m.request.get();
+  const HttpMessageData* response = m.is_request ? nullptr : &m;
+  append_endpoint(out, "{\"receiver\":", m.receiver_ip, m.receiver_port);
+  append_endpoint(out, ",\"destination\":", m.dest_ip, m.dest_port);
+  if (request != nullptr) {
+    out += ",\"request\":";
+    append_message(out, *request);
+  }
+  if (response != nullptr) {
+    out += ",\"response\":";
+    append_message(out, *response);
+  }
+  out += ",\"timing\":{";
+  const char* sep = "";
+  auto field = [&](const char* key, int64_t v) {
+    out += sep;
+    out += key;
+    append_int(out, v);
+    sep = ",";
+  };
+  if (request != nullptr) {
+    field("\"requestStartUs\":", static_cast<int64_t>(request->first_byte_us));
+    field("\"requestEndUs\":", static_cast<int64_t>(request->complete_us));
+  }
+  if (response != nullptr) {
+    field("\"responseStartUs\":", static_cast<int64_t>(response->first_byte_us));
+    field("\"responseEndUs\":", static_cast<int64_t>(response->complete_us));
+  }
+  if (request != nullptr && response != nullptr) {
+    field("\"latencyUs\":",
+          static_cast<int64_t>(response->first_byte_us) - static_cast<int64_t>(request->complete_us));
+  }
+  out += "}}";
+}
+
+size_t estimated_size(const HttpMessageData& m) {
+  size_t n = 256 + m.method.size() + m.path.size() + m.body.size() + m.headers.byte_size() + 8 * m.headers.size();
+  if (m.request) n += estimated_size(*m.request);
+  return n;
+}
+
+}  // namespace
+
+void append_json_string(std::string& out, std::string_view s, bool known_utf8) {
+  out += '"';
+  if (known_utf8 || validate_utf8(reinterpret_cast<const uint8_t*>(s.data()), s.size())) {
+    escape_valid(out, s);
+  } else {
+    escape_valid(out, replace_invalid_utf8(s));
+  }
+  out += '"';
+}
+
+void append_json_string_scalar(std::string& out, std::string_view s) {
+  out += '"';
+  escape_tail(out, s.data(), s.size(), 0, 0);
+  out += '"';
+}
+
+void encode_ndjson_batch(const std::vector<HttpMessageData>& messages, bool exchanges, std::string& out) {
+  size_t total = 0;
+  for (const HttpMessageData& m : messages) total += estimated_size(m);
+  out.reserve(out.size() + total);
+  for (const HttpMessageData& m : messages) {
+    if (exchanges) {
+      append_exchange(out, m);
+    } else {
+      append_message(out, m);
+    }
+    out += '\n';
+  }
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,37 @@
+/**
+ * TCP Sniffer — NDJSON message encoding (A4).
+ * Serializes a batch of HttpMessageData as one JSON line per message (or exchange
+ * record), byte for byte what JSON.stringify writes for the object the addon would
+ * have handed to JS, for nativeStdout. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_NDJSON_CODEC_HPP
+#define TCP_SNIFFER_NDJSON_CODEC_HPP
+
+#include "http_parser.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/**
+ * Append s as a JSON string literal, quotes included, escaped as JSON.stringify does.
+ * Scans 16 bytes at a time with SSE2 on x86-64 for bytes that need escaping. Unless
+ * known_utf8, s is validated first and invalid bytes are written as U+FFFD, as a
+ * conversion to a JS string would.
+ */
+void append_json_string(std::string& out, std::string_view s, bool known_utf8 = false);
+
+/** Scalar reference for append_json_string on valid UTF-8 (tests and benchmarks). */
+void append_json_string_scalar(std::string& out, std::string_view s);
+
+/**
+ * Append one line per message: exchange records (contract §2.2) when exchanges is set,
+ * messages (§2) otherwise, with members in the contract order.
+ */
+void encode_ndjson_batch(const std::vector<HttpMessageData>& messages, bool exchanges, std::string& out);
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_NDJSON_CODEC_HPP
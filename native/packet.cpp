@@ -1,85 +1,229 @@
 /**
  * TCP Sniffer — Packet decoding implementation.
- * Handles Ethernet II, IPv4, and TCP. No IPv6 in MVP.
+ * Byte loads only (no struct casts), so headers at any alignment decode the same.
  */
 
 #include "packet.hpp"
 #include <arpa/inet.h>
 #include <cstring>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <sys/types.h>
 
 namespace tcp_sniffer {
 
 namespace {
 
-const size_t MIN_ETH_IP_TCP = 14 + 20 + 20;  // eth + ip + tcp min headers
+constexpr uint16_t kEtherTypeIp4 = 0x0800;
+constexpr uint16_t kEtherTypeIp6 = 0x86dd;
+constexpr uint16_t kEtherTypeVlan = 0x8100;   // 802.1Q
+constexpr uint16_t kEtherTypeQinQ = 0x88a8;   // 802.1ad service tag
+constexpr uint16_t kEtherTypeQinQ1 = 0x9100;  // pre-standard QinQ
+constexpr uint8_t kProtoTcp = 6;
+constexpr size_t kMaxVlanTags = 2;
+constexpr size_t kMaxIp6ExtHeaders = 8;
+
+inline uint16_t load16(const uint8_t* p) {
+  return static_cast<uint16_t>((static_cast<uint16_t>(p[0]) << 8) | p[1]);
+}
 
-/** Ethernet type for IPv4. */
-const uint16_t ETH_P_IP4 = 0x0800;
+inline uint32_t load32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
 
-std::string ip4_to_string(uint32_t addr) {
-  char buf[INET_ADDRSTRLEN];
-  struct in_addr a;
-  a.s_addr = addr;
-  return inet_ntop(AF_INET, &a, buf, sizeof(buf)) ? std::string(buf) : "";
+inline bool is_vlan(uint16_t ether_type) {
+  return ether_type == kEtherTypeVlan || ether_type == kEtherTypeQinQ || ether_type == kEtherTypeQinQ1;
 }
 
-}  // namespace
+inline void set_address(IpAddress& out, uint8_t family, const uint8_t* bytes) {
+  out.family = family;
+  std::memcpy(out.bytes, bytes, family == 6 ? 16 : 4);
+}
 
-bool decode_packet(const uint8_t* data, size_t len, TcpSegment& segment) {
-  if (data == nullptr || len < MIN_ETH_IP_TCP) return false;
+/**
+ * End of the IP datagram: start + the length the header claims, when that fits in
+ * the capture. 0 (TSO, jumbograms) or a claim past a snaplen cut falls back to len.
+ */
+inline size_t datagram_end(size_t start, size_t claimed, size_t len) {
+  return claimed != 0 && claimed <= len - start ? start + claimed : len;
+}
 
-  // Ethernet II: 6 dst MAC, 6 src MAC, 2 type
-  uint16_t ether_type = (static_cast<uint16_t>(data[12]) << 8) | data[13];
-  if (ether_type != ETH_P_IP4) return false;
+/** Network-layer offset and ether type for a frame, or false for other framing. */
+template <LinkType Link>
+inline bool link_header(const uint8_t* data, size_t len, size_t* offset, uint16_t* ether_type) {
+  if constexpr (Link == LinkType::kRaw) {
+    if (len < 1) return false;
+    *offset = 0;
+    *ether_type = (data[0] >> 4) == 6 ? kEtherTypeIp6 : kEtherTypeIp4;
+    return true;
+  } else {
+    if constexpr (Link == LinkType::kEthernet) {
+      if (len < 14) return false;
+      *offset = 14;
+      *ether_type = load16(data + 12);
+    } else if constexpr (Link == LinkType::kLinuxSll) {
+      if (len < 16) return false;
+      *offset = 16;
+      *ether_type = load16(data + 14);
+    } else {
+      if (len < 20) return false;
+      *offset = 20;
+      *ether_type = load16(data);
+    }
+    // Ethernet, or cooked captures of tagged frames the kernel did not untag.
+    for (size_t i = 0; i < kMaxVlanTags && is_vlan(*ether_type); ++i) {
+      if (len < *offset + 4) return false;
+      *ether_type = load16(data + *offset + 2);
+      *offset += 4;
+    }
+    return true;
+  }
+}
 
-  const uint8_t* ip_base = data + 14;
-  size_t ip_len = len - 14;
-  if (ip_len < sizeof(struct ip)) return false;
+/** IPv4 header at data[off]: TCP offset and datagram end. False unless unfragmented-or-first TCP. */
+__attribute__((always_inline)) inline bool ip4_header(const uint8_t* data, size_t len, size_t off,
+                                                      TcpSegment& segment, size_t* tcp_off, size_t* end) {
+  if (len - off < 20) return false;
+  const uint8_t* ip = data + off;
+  size_t header_len = static_cast<size_t>(ip[0] & 0x0f) * 4;
+  if ((ip[0] >> 4) != 4 || header_len < 20 || ip[9] != kProtoTcp) return false;
+  if ((load16(ip + 6) & 0x1fff) != 0) return false;  // fragment offset: no TCP header here
+  *end = datagram_end(off, load16(ip + 2), len);
+  if (*end - off < header_len) return false;
+  set_address(segment.tuple.src_ip, 4, ip + 12);
+  set_address(segment.tuple.dst_ip, 4, ip + 16);
+  *tcp_off = off + header_len;
+  return true;
+}
 
-  const struct ip* ip = reinterpret_cast<const struct ip*>(ip_base);
-  if (ip->ip_v != 4 || ip->ip_p != 6) return false;  // 6 = IPPROTO_TCP
+/** IPv6 header at data[off], skipping extension headers up to TCP. */
+bool ip6_header(const uint8_t* data, size_t len, size_t off, TcpSegment& segment, size_t* tcp_off, size_t* end) {
+  if (len - off < 40) return false;
+  const uint8_t* ip = data + off;
+  if ((ip[0] >> 4) != 6) return false;
+  *end = datagram_end(off + 40, load16(ip + 4), len);
+  uint8_t next = ip[6];
+  size_t at = off + 40;
+  for (size_t i = 0; i < kMaxIp6ExtHeaders && next != kProtoTcp; ++i) {
+    if (*end - at < 8) return false;
+    const uint8_t* ext = data + at;
+    size_t ext_len;
+    switch (next) {
+      case 0:   // hop-by-hop options
+      case 43:  // routing
+      case 60:  // destination options
+        ext_len = (static_cast<size_t>(ext[1]) + 1) * 8;
+        break;
+      case 44:  // fragment
+        if ((load16(ext + 2) & 0xfff8) != 0) return false;
+        ext_len = 8;
+        break;
+      case 51:  // authentication header
+        ext_len = (static_cast<size_t>(ext[1]) + 2) * 4;
+        break;
+      default:
+        return false;
+    }
+    next = ext[0];
+    at += ext_len;
+    if (at > *end) return false;
+  }
+  if (next != kProtoTcp) return false;
+  set_address(segment.tuple.src_ip, 6, ip + 8);
+  set_address(segment.tuple.dst_ip, 6, ip + 24);
+  *tcp_off = at;
+  return true;
+}
 
-  size_t ip_header_len = static_cast<size_t>(ip->ip_hl) * 4;
-  if (ip_len < ip_header_len) return false;
+/** TCP header at data[tcp_off] of a datagram ending at end. */
+__attribute__((always_inline)) inline bool tcp_header(const uint8_t* data, size_t tcp_off, size_t end, TcpSegment& segment) {
+  if (end - tcp_off < 20) return false;
+  const uint8_t* tcp = data + tcp_off;
+  size_t tcp_header_len = static_cast<size_t>(tcp[12] >> 4) * 4;
+  if (tcp_header_len < 20 || end - tcp_off < tcp_header_len) return false;
+
+  uint8_t flags = tcp[13];
+  segment.tuple.src_port = load16(tcp);
+  segment.tuple.dst_port = load16(tcp + 2);
+  segment.seq = load32(tcp + 4);
+  segment.ack = load32(tcp + 8);
+  segment.fin = (flags & 0x01) != 0;
+  segment.syn = (flags & 0x02) != 0;
+  segment.rst = (flags & 0x04) != 0;
+
+  size_t payload_len = end - tcp_off - tcp_header_len;
+  segment.payload = payload_len > 0 ? tcp + tcp_header_len : nullptr;
+  segment.payload_len = payload_len;
+  return true;
+}
 
-  const uint8_t* tcp_base = ip_base + ip_header_len;
-  size_t tcp_total = ip_len - ip_header_len;
-  if (tcp_total < sizeof(struct tcphdr)) return false;
+/** Network and transport decode for one address family, after the link header. */
+template <uint8_t Family>
+__attribute__((always_inline)) inline bool decode_ip(const uint8_t* data, size_t len, size_t off, TcpSegment& segment) {
+  size_t tcp_off = 0;
+  size_t end = 0;
+  bool ok = Family == 4 ? ip4_header(data, len, off, segment, &tcp_off, &end)
+                        : ip6_header(data, len, off, segment, &tcp_off, &end);
+  return ok && tcp_header(data, tcp_off, end, segment);
+}
 
-  const struct tcphdr* tcp = reinterpret_cast<const struct tcphdr*>(tcp_base);
-  size_t tcp_header_len = static_cast<size_t>(tcp->th_off) * 4;
-  if (tcp_total < tcp_header_len) return false;
+}  // namespace
 
-  segment.src_ip = ip4_to_string(ip->ip_src.s_addr);
-  segment.dst_ip = ip4_to_string(ip->ip_dst.s_addr);
-  segment.src_port = ntohs(tcp->th_sport);
-  segment.dst_port = ntohs(tcp->th_dport);
-  segment.seq = ntohl(tcp->th_seq);
-  segment.ack = ntohl(tcp->th_ack);
-  segment.syn = (tcp->th_flags & TH_SYN) != 0;
-  segment.fin = (tcp->th_flags & TH_FIN) != 0;
-  segment.rst = (tcp->th_flags & TH_RST) != 0;
+bool IpAddress::operator==(const IpAddress& other) const {
+  return family == other.family && std::memcmp(bytes, other.bytes, size()) == 0;
+}
 
-  size_t payload_len = tcp_total - tcp_header_len;
-  if (payload_len > 0) {
-    segment.payload.assign(tcp_base + tcp_header_len, tcp_base + tcp_total);
-  } else {
-    segment.payload.clear();
+template <LinkType Link>
+bool PacketDecoder<Link>::decode(const uint8_t* data, size_t len, TcpSegment& segment) {
+  if (data == nullptr) return false;
+  size_t off = 0;
+  uint16_t ether_type = 0;
+  if (!link_header<Link>(data, len, &off, &ether_type)) return false;
+  // IPv4 is inlined as the common case; IPv6 (with its extension header walk) is a call.
+  if (__builtin_expect(ether_type == kEtherTypeIp4, 1)) return decode_ip<4>(data, len, off, segment);
+  if (ether_type == kEtherTypeIp6) return decode_ip<6>(data, len, off, segment);
+  return false;
+}
+
+template struct PacketDecoder<LinkType::kEthernet>;
+template struct PacketDecoder<LinkType::kLinuxSll>;
+template struct PacketDecoder<LinkType::kLinuxSll2>;
+template struct PacketDecoder<LinkType::kRaw>;
+
+bool decode_packet(const uint8_t* data, size_t len, TcpSegment& segment, LinkType link) {
+  return with_packet_decoder(link, [&](auto decoder) { return decltype(decoder)::decode(data, len, segment); });
+}
+
+namespace {
+
+uint32_t fold_address(const IpAddress& addr) {
+  uint32_t h = 0;
+  for (size_t i = 0; i < addr.size(); i += 4) {
+    h ^= (static_cast<uint32_t>(addr.bytes[i]) << 24) | (static_cast<uint32_t>(addr.bytes[i + 1]) << 16) |
+         (static_cast<uint32_t>(addr.bytes[i + 2]) << 8) | addr.bytes[i + 3];
   }
+  return h;
+}
 
-  segment.tuple.src_ip = segment.src_ip;
-  segment.tuple.src_port = segment.src_port;
-  segment.tuple.dst_ip = segment.dst_ip;
-  segment.tuple.dst_port = segment.dst_port;
+}  // namespace
 
-  return true;
+uint32_t flow_hash(const FourTuple& tuple) {
+  uint32_t x = fold_address(tuple.src_ip) ^ fold_address(tuple.dst_ip) ^ tuple.src_port ^ tuple.dst_port;
+  return x * 2654435761u;
+}
+
+uint32_t sample_threshold(double rate) {
+  if (!(rate > 0.0)) return 0;
+  if (rate >= 1.0) return 65536;
+  return static_cast<uint32_t>(rate * 65536.0 + 0.5);
+}
+
+std::string ip_to_string(const IpAddress& addr) {
+  char buf[INET6_ADDRSTRLEN];
+  int af = addr.family == 6 ? AF_INET6 : AF_INET;
+  return inet_ntop(af, addr.bytes, buf, sizeof(buf)) ? std::string(buf) : "";
 }
 
-std::string format_endpoint(const std::string& ip, uint16_t port) {
-  return ip + ":" + std::to_string(port);
+std::string format_endpoint(const IpAddress& ip, uint16_t port) {
+  return ip_to_string(ip) + ":" + std::to_string(port);
 }
 
 }  // namespace tcp_sniffer
@@ -1,27 +1,46 @@
 /**
  * TCP Sniffer — Packet decoding (A1).
- * Decode Ethernet / IP / TCP from libpcap payload.
+ * Decode Ethernet, Linux cooked (SLL/SLL2) or raw IP frames, 802.1Q/802.1ad tags,
+ * IPv4 / IPv6 and TCP from libpcap or TPACKET payload.
  * See docs/specs/CPP_ENGINE.md and docs/specs/TS_CPP_CONTRACT.md.
  */
 
 #ifndef TCP_SNIFFER_PACKET_HPP
 #define TCP_SNIFFER_PACKET_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#include <vector>
 
 namespace tcp_sniffer {
 
+/**
+ * Binary IP address in network byte order. IPv4 uses the first 4 bytes.
+ * Kept binary on the hot path; format with ip_to_string() only at output time.
+ */
+struct IpAddress {
+  uint8_t family{0};  // 4 or 6; 0 = unset
+  uint8_t bytes[16]{};
+
+  /** Number of significant bytes (4 for IPv4, 16 for IPv6). */
+  size_t size() const { return family == 6 ? 16 : 4; }
+  bool operator==(const IpAddress& other) const;
+  bool operator!=(const IpAddress& other) const { return !(*this == other); }
+};
+
 /** Decoded 4-tuple: source and destination IP + port. */
 struct FourTuple {
-  std::string src_ip;
+  IpAddress src_ip;
   uint16_t src_port{0};
-  std::string dst_ip;
+  IpAddress dst_ip;
   uint16_t dst_port{0};
 };
 
-/** Decoded TCP segment for reassembly: sequence, payload, flags. */
+/**
+ * Decoded TCP segment for reassembly: sequence, payload, flags.
+ * payload is a view into the capture buffer and is only valid for the duration
+ * of the segment callback; anything kept longer must be copied.
+ */
 struct TcpSegment {
   FourTuple tuple;
   uint32_t seq{0};
@@ -29,18 +48,93 @@ struct TcpSegment {
   bool syn{false};
   bool fin{false};
   bool rst{false};
-  std::vector<uint8_t> payload;
+  const uint8_t* payload{nullptr};
+  size_t payload_len{0};
+  uint64_t ts_us{0};  // capture time, µs since the Unix epoch (set by the capture backend)
+};
+
+/** Link-layer framing of captured packets (from the pcap datalink type). */
+enum class LinkType : uint8_t {
+  kEthernet,   // DLT_EN10MB
+  kLinuxSll,   // DLT_LINUX_SLL: 16-byte cooked header ("any" interface)
+  kLinuxSll2,  // DLT_LINUX_SLL2: 20-byte cooked header
+  kRaw,        // DLT_RAW: IPv4 or IPv6 header first
 };
 
 /**
  * Decode packet from link-layer payload.
+ * Up to two VLAN tags (802.1Q, 802.1ad / QinQ) are skipped, as are IPv6 extension
+ * headers before TCP. The payload ends where the IP length says, so Ethernet padding
+ * is not taken for data; non-first fragments are rejected.
  * Returns true if the packet is TCP and was decoded; false otherwise.
- * segment is only valid when true.
+ * segment is only valid when true. Does not allocate. Dispatches on link per call;
+ * packet loops use PacketDecoder below.
+ */
+bool decode_packet(const uint8_t* data, size_t len, TcpSegment& segment, LinkType link = LinkType::kEthernet);
+
+/**
+ * decode_packet for one link type, fixed at compile time: the link header is read at
+ * constant offsets, and the IPv4 path is inlined after it with IPv6 out of line.
+ * Select the instantiation once per capture handle (with_packet_decoder) and call
+ * decode() directly in the packet loop, with no per-packet dispatch on the framing.
  */
-bool decode_packet(const uint8_t* data, size_t len, TcpSegment& segment);
+template <LinkType Link>
+struct PacketDecoder {
+  static bool decode(const uint8_t* data, size_t len, TcpSegment& segment);
+};
+
+extern template struct PacketDecoder<LinkType::kEthernet>;
+extern template struct PacketDecoder<LinkType::kLinuxSll>;
+extern template struct PacketDecoder<LinkType::kLinuxSll2>;
+extern template struct PacketDecoder<LinkType::kRaw>;
+
+/** Returns f(PacketDecoder<link>{}): resolves the runtime link type to its decoder once. */
+template <typename F>
+auto with_packet_decoder(LinkType link, F&& f) {
+  switch (link) {
+    case LinkType::kLinuxSll:
+      return f(PacketDecoder<LinkType::kLinuxSll>{});
+    case LinkType::kLinuxSll2:
+      return f(PacketDecoder<LinkType::kLinuxSll2>{});
+    case LinkType::kRaw:
+      return f(PacketDecoder<LinkType::kRaw>{});
+    case LinkType::kEthernet:
+    default:
+      return f(PacketDecoder<LinkType::kEthernet>{});
+  }
+}
+
+/**
+ * Direction-independent 32-bit flow hash for connection sampling. For IPv4 it is
+ * (saddr ^ daddr ^ sport ^ dport) * 2654435761 mod 2^32 over host-order fields, so a
+ * classic BPF program can compute the same value in the kernel. IPv6 addresses are
+ * folded to 32 bits by XOR of their words first.
+ */
+uint32_t flow_hash(const FourTuple& tuple);
+
+/**
+ * Share in [0, shares) of a flow split across shares workers. flow_hash is re-mixed
+ * first (murmur3's finalizer): sampling keeps flows by its high bits, so taking the
+ * share from them too would leave only the first shares × sampleRate workers any flows.
+ */
+inline size_t flow_share(const FourTuple& tuple, size_t shares) {
+  uint32_t h = flow_hash(tuple);
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return static_cast<size_t>((static_cast<uint64_t>(h) * shares) >> 32);
+}
+
+/** Sampling threshold for rate in [0, 1]: a flow is kept when (flow_hash >> 16) < threshold. */
+uint32_t sample_threshold(double rate);
+
+/** Format a binary address as dotted-quad / RFC 5952 text. */
+std::string ip_to_string(const IpAddress& addr);
 
 /** Format IP:port for logging. */
-std::string format_endpoint(const std::string& ip, uint16_t port);
+std::string format_endpoint(const IpAddress& ip, uint16_t port);
 
 }  // namespace tcp_sniffer
 
@@ -3,195 +3,668 @@
  */
 
 #include "reassembly.hpp"
+#include "log.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstring>
-#include <cstdio>
+#include <iterator>
+#include <string>
 
 namespace tcp_sniffer {
 
 namespace {
 
-std::string endpoint_key(const std::string& ip, uint16_t port) {
-  return ip + ":" + std::to_string(port);
+/** Human-readable connection id for logs; only built for records within the rate limit. */
+std::string connection_label(const Connection& conn) {
+  return format_endpoint(conn.receiver_ip, conn.receiver_port) + "-" +
+         format_endpoint(conn.dest_ip, conn.dest_port);
 }
 
-}  // namespace
+const char* direction_name(bool client_to_server) {
+  return client_to_server ? "client_to_server" : "server_to_client";
+}
+
+/**
+ * Pipelined requests waiting for a response, per connection. Past this the oldest is
+ * emitted unanswered, bounding memory on a connection whose responses are not seen.
+ */
+constexpr size_t kMaxPendingRequests = 64;
 
-std::string connection_key(const std::string& src_ip, uint16_t src_port,
-                           const std::string& dst_ip, uint16_t dst_port) {
-  std::string a = endpoint_key(src_ip, src_port);
-  std::string b = endpoint_key(dst_ip, dst_port);
-  if (a < b) return a + "-" + b;
-  return b + "-" + a;
+/**
+ * Unwrapped value of the first sequence number seen on a stream. The 2^32 offset
+ * keeps retransmits of bytes from before it from unwrapping below zero.
+ */
+constexpr uint64_t kSeqBase = uint64_t{1} << 32;
+
+/** The 64-bit sequence nearest ref whose low 32 bits are seq (RFC 1982 serial arithmetic). */
+uint64_t unwrap_seq(uint32_t seq, uint64_t ref) {
+  int32_t delta = static_cast<int32_t>(seq - static_cast<uint32_t>(ref));
+  return ref + static_cast<uint64_t>(static_cast<int64_t>(delta));
 }
 
-Reassembler::Reassembler(ReassemblyConfig config) : config_(std::move(config)) {}
+/** Idle timers only need coarse resolution: ~1/64 of the timeout, 1–100 ms. */
+uint64_t idle_tick_ms(uint64_t timeout_ms) {
+  return std::max<uint64_t>(1, std::min<uint64_t>(100, timeout_ms / 64));
+}
 
-uint64_t Reassembler::now_ms() const {
+uint64_t steady_now_ms() {
   return static_cast<uint64_t>(
       std::chrono::duration_cast<std::chrono::milliseconds>(
           std::chrono::steady_clock::now().time_since_epoch())
           .count());
 }
 
-void Reassembler::log_eviction(const std::string& key) {
-  (void)key;
-  // Structured log: eviction (once per event). Could fprintf or callback.
-  fprintf(stderr, "[tcp_sniffer] eviction connection=%s\n", key.c_str());
+uint64_t wall_now_us() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
 }
 
-void Reassembler::log_gap(const std::string& key, bool client_to_server) {
-  (void)key;
-  (void)client_to_server;
-  fprintf(stderr, "[tcp_sniffer] reassembly_gap connection=%s direction=%s\n",
-          key.c_str(), client_to_server ? "client_to_server" : "server_to_client");
+}  // namespace
+
+Reassembler::Reassembler(ReassemblyConfig config)
+    : config_(std::move(config)),
+      connections_(config_.max_concurrent_connections + 1),
+      idle_timers_(idle_tick_ms(config_.connection_idle_timeout_ms), config_.capture_clock ? 0 : steady_now_ms()),
+      sample_threshold_(sample_threshold(config_.sample_rate)),
+      shed_sample_threshold_(config_.load_shedder != nullptr
+                                 ? static_cast<uint32_t>(sample_threshold_ *
+                                                         config_.load_shedder->config().reduced_sample_fraction)
+                                 : sample_threshold_) {}
+
+uint64_t Reassembler::now_ms() const {
+  return config_.capture_clock ? clock_us_ / 1000 : steady_now_ms();
+}
+
+void Reassembler::log_eviction(const Connection& conn) {
+  Logger& log = Logger::instance();
+  if (!log.admit(LogEvent::kEviction)) return;
+  log.write(LogEvent::kEviction, "\"connection\":\"%s\"", connection_label(conn).c_str());
+}
+
+void Reassembler::log_gap(const Connection& conn, bool client_to_server) {
+  Logger& log = Logger::instance();
+  if (!log.admit(LogEvent::kReassemblyGap)) return;
+  log.write(LogEvent::kReassemblyGap, "\"connection\":\"%s\",\"direction\":\"%s\"", connection_label(conn).c_str(),
+            direction_name(client_to_server));
+}
+
+void Reassembler::log_gap_skipped(const Connection& conn, bool client_to_server, uint64_t bytes) {
+  Logger& log = Logger::instance();
+  if (!log.admit(LogEvent::kReassemblyGapSkipped)) return;
+  log.write(LogEvent::kReassemblyGapSkipped, "\"connection\":\"%s\",\"direction\":\"%s\",\"bytes\":%llu",
+            connection_label(conn).c_str(), direction_name(client_to_server), static_cast<unsigned long long>(bytes));
+}
+
+void Reassembler::log_out_of_order_overflow(const Connection& conn, bool client_to_server) {
+  Logger& log = Logger::instance();
+  if (!log.admit(LogEvent::kOutOfOrderOverflow)) return;
+  log.write(LogEvent::kOutOfOrderOverflow, "\"connection\":\"%s\",\"direction\":\"%s\",\"limit\":%zu",
+            connection_label(conn).c_str(), direction_name(client_to_server), config_.max_out_of_order_bytes);
 }
 
 size_t Reassembler::connection_count() const {
   return connections_.size();
 }
 
-void Reassembler::evict_idle(uint64_t now_ms) {
-  std::vector<std::string> to_remove;
-  for (auto& [key, conn] : connections_) {
-    if (now_ms - conn.last_activity_ms >= config_.connection_idle_timeout_ms) {
-      to_remove.push_back(key);
+void Reassembler::lru_unlink(uint32_t id) {
+  Connection& c = connections_.at(id);
+  if (c.lru_prev != ConnectionTable::kNone) connections_.at(c.lru_prev).lru_next = c.lru_next;
+  else lru_head_ = c.lru_next;
+  if (c.lru_next != ConnectionTable::kNone) connections_.at(c.lru_next).lru_prev = c.lru_prev;
+  else lru_tail_ = c.lru_prev;
+  c.lru_prev = c.lru_next = ConnectionTable::kNone;
+}
+
+void Reassembler::lru_append(uint32_t id) {
+  Connection& c = connections_.at(id);
+  c.lru_prev = lru_tail_;
+  c.lru_next = ConnectionTable::kNone;
+  if (lru_tail_ != ConnectionTable::kNone) connections_.at(lru_tail_).lru_next = id;
+  else lru_head_ = id;
+  lru_tail_ = id;
+}
+
+void Reassembler::evict(uint32_t id) {
+  Connection& conn = connections_.at(id);
+  // A closed connection was flushed when it closed and is only lingering.
+  if (conn.closed_at_ms == 0) {
+    log_eviction(conn);
+    // Complete messages may be buffered behind a hole that will never fill now.
+    if (config_.gap_policy == GapPolicy::kSkip) skip_all_gaps(conn);
+    flush_pending_requests(conn);
+  }
+  remove(id);
+}
+
+void Reassembler::remove(uint32_t id) {
+  Connection& conn = connections_.at(id);
+  lru_unlink(id);
+  idle_timers_.cancel(id);
+  // Drop any partially parsed message and its buffered bytes with the connection.
+  conn.request_parser.reset();
+  conn.response_parser.reset();
+  conn.plugin_request_parser.reset();
+  conn.plugin_response_parser.reset();
+  connections_.erase(id);
+}
+
+void Reassembler::close_stream(Connection& conn, bool client_to_server, uint64_t ts_us, bool aborted) {
+  StreamState& stream = client_to_server ? conn.client_to_server : conn.server_to_client;
+  stream.fin_reached = true;
+  parser(conn, client_to_server).close(ts_us, aborted || !stream.segments.empty());
+}
+
+void Reassembler::close_connection(uint32_t id, Connection& conn, uint64_t ts_us) {
+  if (config_.gap_policy == GapPolicy::kSkip) skip_all_gaps(conn);
+  // Requests first: a response read until close still pairs with the oldest pending request.
+  for (bool c2s : {true, false}) {
+    StreamState& stream = c2s ? conn.client_to_server : conn.server_to_client;
+    // Not at its FIN (an RST, or bytes still missing): the stream was cut short.
+    if (!stream.fin_reached) close_stream(conn, c2s, ts_us, true);
+    stream.segments.clear();
+    stream.buffered_bytes = 0;
+  }
+  flush_pending_requests(conn);
+  conn.closed_at_ms = conn.last_activity_ms;
+  idle_timers_.schedule(id, conn.closed_at_ms + config_.close_linger_ms);
+}
+
+StreamParser& Reassembler::parser(Connection& conn, bool client_to_server) {
+  if (client_to_server) {
+    if (conn.plugin_request_parser) return *conn.plugin_request_parser;
+    return conn.request_parser;
+  }
+  if (conn.plugin_response_parser) return *conn.plugin_response_parser;
+  return conn.response_parser;
+}
+
+HttpMessageCallback Reassembler::message_callback(uint32_t id, bool client_to_server) {
+  if (config_.correlate_exchanges) {
+    // Slot ids are stable for the connection's lifetime, so the callbacks can hold one.
+    if (client_to_server) return [this, id](HttpMessageData&& m) { on_request(id, std::move(m)); };
+    return [this, id](HttpMessageData&& m) { on_response(id, std::move(m)); };
+  }
+  return [this](HttpMessageData&& m) {
+    on_parsed(m);
+    if (on_message_) on_message_(std::move(m));
+  };
+}
+
+void Reassembler::start_stream(Connection& conn, StreamState& stream, bool client_to_server,
+                               const uint8_t* data, size_t len) {
+  stream.started = true;
+  StreamProtocol protocol = classify_stream(data, len, client_to_server);
+  // Joined after the stream's start, its first bytes may be inside a message: only a
+  // recognizable other protocol is ignored, and HTTP parsing waits for a start line.
+  bool joined = protocol != StreamProtocol::kHttp1 && !stream.syn_seen;
+  if (conn.protocol == StreamProtocol::kUnknown) {
+    conn.protocol = joined && protocol == StreamProtocol::kOther ? StreamProtocol::kHttp1 : protocol;
+    if (conn.protocol != StreamProtocol::kHttp1 && !attach_plugin_parsers(conn)) {
+      conn.ignored = true;
+      stats_.connections_ignored.add();
+      return;
     }
   }
-  for (const auto& key : to_remove) {
-    log_eviction(key);
-    connections_.erase(key);
+  if (conn.protocol == StreamProtocol::kHttp1 && joined) {
+    (client_to_server ? conn.request_parser : conn.response_parser).start_mid_stream();
   }
+}
 
-  ensure_connection_cap(now_ms);
+bool Reassembler::attach_plugin_parsers(Connection& conn) {
+  if (!config_.parser_factory) return false;
+  uint32_t id = connections_.find(conn.key);  // once per connection, when it is classified
+  StreamParserContext context;
+  context.protocol = conn.protocol;
+  context.receiver_ip = ip_to_string(conn.receiver_ip);
+  context.receiver_port = conn.receiver_port;
+  context.dest_ip = ip_to_string(conn.dest_ip);
+  context.dest_port = conn.dest_port;
+  context.max_body_size = conn.max_body_size;
+  context.header_filter = &config_.header_filter;
+  for (bool c2s : {true, false}) {
+    context.client_to_server = c2s;
+    context.on_message = message_callback(id, c2s);
+    (c2s ? conn.plugin_request_parser : conn.plugin_response_parser) = config_.parser_factory(context);
+  }
+  if (conn.plugin_request_parser && conn.plugin_response_parser) return true;
+  conn.plugin_request_parser.reset();
+  conn.plugin_response_parser.reset();
+  return false;
 }
 
-void Reassembler::ensure_connection_cap(uint64_t now_ms) {
-  while (connections_.size() > config_.max_concurrent_connections) {
-    // Evict oldest by created_at_ms
-    std::string oldest_key;
-    uint64_t oldest = UINT64_MAX;
-    for (const auto& [key, conn] : connections_) {
-      if (conn.created_at_ms < oldest) {
-        oldest = conn.created_at_ms;
-        oldest_key = key;
-      }
+void Reassembler::ignore_segment(uint32_t id, Connection& conn, const TcpSegment& seg, bool client_to_server) {
+  // Nothing is parsed, so the flags alone end the connection; order does not matter.
+  if (seg.rst) {
+    stats_.closes_rst.add();
+    close_connection(id, conn, seg.ts_us);
+    return;
+  }
+  if (seg.fin) (client_to_server ? conn.client_to_server : conn.server_to_client).fin_reached = true;
+  if (conn.client_to_server.fin_reached && conn.server_to_client.fin_reached) {
+    stats_.closes_fin.add();
+    close_connection(id, conn, seg.ts_us);
+  }
+}
+
+void Reassembler::expire_idle(uint64_t now_ms) {
+  expired_.clear();
+  idle_timers_.advance(now_ms, expired_);
+  for (uint32_t id : expired_) {
+    const Connection& conn = connections_.at(id);
+    if (conn.closed_at_ms != 0) {
+      remove(id);  // end of the linger after close
+      continue;
+    }
+    uint64_t deadline = conn.last_activity_ms + config_.connection_idle_timeout_ms;
+    // Timers are armed lazily (not on every packet): re-arm if there was activity since.
+    if (now_ms >= deadline) {
+      stats_.evictions_idle.add();
+      evict(id);
+    } else {
+      idle_timers_.schedule(id, deadline);
+    }
+  }
+}
+
+void Reassembler::evict_idle(uint64_t now_ms) {
+  expire_idle(now_ms);
+  ensure_connection_cap();
+  stats_.connections.set(connections_.size());
+}
+
+void Reassembler::ensure_connection_cap() {
+  // Evict least recently active first.
+  while (connections_.size() > config_.max_concurrent_connections &&
+         lru_head_ != ConnectionTable::kNone) {
+    if (connections_.at(lru_head_).closed_at_ms == 0) stats_.evictions_cap.add();
+    evict(lru_head_);
+  }
+}
+
+void Reassembler::flush_pending_requests(Connection& conn) {
+  while (!conn.pending_requests.empty()) {
+    HttpMessageData request = std::move(conn.pending_requests.front().message);
+    conn.pending_requests.pop_front();
+    if (on_message_) on_message_(std::move(request));
+  }
+}
+
+void Reassembler::flush_exchanges() {
+  for (uint32_t id = lru_head_; id != ConnectionTable::kNone; id = connections_.at(id).lru_next) {
+    flush_pending_requests(connections_.at(id));
+  }
+}
+
+void Reassembler::close_all() {
+  uint64_t ts_us = config_.capture_clock ? clock_us_ : wall_now_us();
+  for (uint32_t id = lru_head_; id != ConnectionTable::kNone; id = connections_.at(id).lru_next) {
+    Connection& conn = connections_.at(id);
+    if (conn.closed_at_ms != 0) continue;
+    skip_all_gaps(conn);  // nothing more will arrive to fill them
+    close_connection(id, conn, ts_us);
+  }
+}
+
+void Reassembler::on_parsed(const HttpMessageData& m) {
+  stats_.messages_parsed.add();
+  // Input without capture times (tests, benchmarks) is stamped when fed: nothing to measure.
+  uint64_t now = wall_now_us();
+  if (m.complete_us != 0 && now >= m.complete_us) stats_.capture_to_parse_us.record(now - m.complete_us);
+}
+
+void Reassembler::on_request(uint32_t id, HttpMessageData&& request) {
+  on_parsed(request);
+  Connection& conn = connections_.at(id);
+  // Parsed only now (it was behind a hole), but already acknowledged by a response that
+  // went out: that response, or one before it, answered it.
+  uint64_t end_seq = conn.client_to_server.next_seq;
+  if (conn.answered_seq != 0 && end_seq <= conn.answered_seq) {
+    if (on_message_) on_message_(std::move(request));
+    return;
+  }
+  if (conn.pending_requests.size() >= kMaxPendingRequests) {
+    HttpMessageData oldest = std::move(conn.pending_requests.front().message);
+    conn.pending_requests.pop_front();
+    if (on_message_) on_message_(std::move(oldest));
+  }
+  conn.pending_requests.push_back(PendingRequest{std::move(request), end_seq});
+}
+
+void Reassembler::on_response(uint32_t id, HttpMessageData&& response) {
+  on_parsed(response);
+  Connection& conn = connections_.at(id);
+  // HTTP/1.1 answers in request order. Interim 1xx responses (other than 101) precede
+  // the final one and do not consume the request.
+  bool interim = response.status_code >= 100 && response.status_code < 200 && response.status_code != 101;
+  if (!interim) {
+    // A request the server had not received yet is not the one answered: the request
+    // this response answers was lost in a hole, and it goes out on its own.
+    if (!conn.pending_requests.empty() &&
+        (conn.server_ack == 0 || conn.pending_requests.front().end_seq <= conn.server_ack)) {
+      response.request = std::make_unique<HttpMessageData>(std::move(conn.pending_requests.front().message));
+      conn.pending_requests.pop_front();
     }
-    if (oldest_key.empty()) break;
-    log_eviction(oldest_key);
-    connections_.erase(oldest_key);
+    conn.answered_seq = std::max(conn.answered_seq, conn.server_ack);
   }
+  if (on_message_) on_message_(std::move(response));
 }
 
-void Reassembler::deliver_ordered(ConnectionState& conn, StreamState& stream,
-                                   const std::string& key, bool client_to_server,
-                                   uint32_t seq, const uint8_t* data, size_t len) {
+void Reassembler::emit_chunk(Connection& conn, bool client_to_server,
+                             const uint8_t* data, size_t len, uint64_t ts_us) {
+  if (len == 0) return;
+  StreamState& stream = client_to_server ? conn.client_to_server : conn.server_to_client;
+  if (!stream.started) start_stream(conn, stream, client_to_server, data, len);
+  if (conn.ignored) return;
+  stats_.bytes_reassembled.add(len);
+  if (on_chunk_) {
+    StreamChunk chunk;
+    chunk.key = &conn.key;
+    chunk.receiver_ip = conn.receiver_ip;
+    chunk.receiver_port = conn.receiver_port;
+    chunk.dest_ip = conn.dest_ip;
+    chunk.dest_port = conn.dest_port;
+    chunk.client_to_server = client_to_server;
+    chunk.data = data;
+    chunk.len = len;
+    chunk.ts_us = ts_us;
+    on_chunk_(chunk);
+  }
+  // The parser copies what it keeps; data may be the capture buffer.
+  parser(conn, client_to_server).feed(data, len, ts_us);
+  if (conn.response_parser.tunnelled()) {
+    // WebSocket, h2c or a CONNECT tunnel from here on: drop it like any other protocol.
+    conn.ignored = true;
+    stats_.connections_ignored.add();
+  }
+}
+
+void Reassembler::deliver_ordered(Connection& conn, StreamState& stream, bool client_to_server,
+                                   uint32_t seq, const uint8_t* data, size_t len, uint64_t ts_us) {
   if (len == 0) return;
   if (!stream.initial_seq_set) {
-    stream.next_seq = seq;
+    stream.next_seq = kSeqBase + seq;
     stream.initial_seq_set = true;
   }
-  // Only deliver if this segment is exactly at next_seq (no gap handling for MVP).
-  if (seq == stream.next_seq) {
-    stream.next_seq = seq + static_cast<uint32_t>(len);
-    if (on_chunk_) {
-      StreamChunk chunk;
-      chunk.connection_id = key;
-      chunk.receiver_ip = conn.receiver_ip;
-      chunk.receiver_port = conn.receiver_port;
-      chunk.dest_ip = conn.dest_ip;
-      chunk.dest_port = conn.dest_port;
-      chunk.client_to_server = client_to_server;
-      chunk.data.assign(data, data + len);
-      on_chunk_(chunk);
+  uint64_t start = unwrap_seq(seq, stream.next_seq);
+  uint64_t end = start + len;
+  while (start > stream.next_seq) {
+    if (buffer_out_of_order(conn, stream, start, data, len)) return;
+    // Over the out-of-order budget.
+    if (config_.gap_policy == GapPolicy::kWait) {
+      stats_.out_of_order_drops.add();
+      if (!stream.overflow_logged) {
+        log_out_of_order_overflow(conn, client_to_server);
+        stream.overflow_logged = true;
+      }
+      return;
+    }
+    // Give up on the oldest hole; this segment is retried against what remains.
+    skip_gap(conn, stream, client_to_server, stream.segments.empty() ? start : stream.segments.begin()->first, ts_us);
+  }
+  if (end <= stream.next_seq) return;  // retransmit of delivered data
+  // In-order (a retransmit may also carry new bytes): hand the new part of the
+  // capture buffer straight to the consumer, no copy.
+  size_t skip = static_cast<size_t>(stream.next_seq - start);
+  stream.next_seq = end;
+  emit_chunk(conn, client_to_server, data + skip, len - skip, ts_us);
+  if (!stream.segments.empty()) deliver_buffered(conn, stream, client_to_server, ts_us);
+}
+
+bool Reassembler::buffer_out_of_order(Connection& conn, StreamState& stream, uint64_t start,
+                                      const uint8_t* data, size_t len) {
+  // The capture buffer is about to be reused, so copy into owned storage. Only the
+  // parts not already buffered are kept: earlier copies of a byte win.
+  const uint64_t base = start;
+  const uint64_t end = start + len;
+  auto& segments = stream.segments;
+  if (segments.empty()) {
+    stream.gap_since_ms = conn.last_activity_ms;
+    stats_.gaps.add();
+  }
+  auto it = segments.upper_bound(start);
+  if (it != segments.begin()) {
+    auto prev = std::prev(it);
+    start = std::max(start, prev->first + prev->second.size());
+  }
+  while (start < end) {
+    uint64_t limit = it == segments.end() ? end : std::min(end, it->first);
+    if (limit > start) {
+      size_t n = static_cast<size_t>(limit - start);
+      if (stream.buffered_bytes + n > config_.max_out_of_order_bytes) return false;
+      const uint8_t* from = data + (start - base);
+      segments.emplace_hint(it, start, std::vector<uint8_t>(from, from + n));
+      stream.buffered_bytes += n;
+      stats_.out_of_order_bytes.add(n);
     }
-    // After delivering, check if any buffered segments can now be delivered
-    bool again = true;
-    while (again) {
-      again = false;
-      for (auto it = stream.segments.begin(); it != stream.segments.end(); ) {
-        if (it->first == stream.next_seq) {
-          const auto& d = it->second;
-          if (!d.empty() && on_chunk_) {
-            StreamChunk chunk;
-            chunk.connection_id = key;
-            chunk.receiver_ip = conn.receiver_ip;
-            chunk.receiver_port = conn.receiver_port;
-            chunk.dest_ip = conn.dest_ip;
-            chunk.dest_port = conn.dest_port;
-            chunk.client_to_server = client_to_server;
-            chunk.data = d;
-            on_chunk_(chunk);
-          }
-          stream.next_seq += static_cast<uint32_t>(it->second.size());
-          it = stream.segments.erase(it);
-          again = true;
-        } else if (it->first > stream.next_seq) {
-          log_gap(key, client_to_server);
-          break;  // gap
-        } else {
-          ++it;
-        }
+    if (it == segments.end()) break;
+    start = std::max(start, it->first + it->second.size());
+    ++it;
+  }
+  return true;
+}
+
+void Reassembler::deliver_buffered(Connection& conn, StreamState& stream, bool client_to_server, uint64_t ts_us) {
+  auto& segments = stream.segments;
+  while (!segments.empty()) {
+    auto it = segments.begin();
+    if (it->first > stream.next_seq) {
+      if (!stream.gap_logged) {
+        log_gap(conn, client_to_server);
+        stream.gap_logged = true;
       }
+      stream.gap_since_ms = conn.last_activity_ms;  // a new hole: the previous one filled
+      stats_.gaps.add();
+      return;
+    }
+    const std::vector<uint8_t>& d = it->second;
+    uint64_t seg_end = it->first + d.size();
+    if (seg_end > stream.next_seq) {
+      // An in-order segment may have covered the front of this one.
+      size_t skip = static_cast<size_t>(stream.next_seq - it->first);
+      stream.next_seq = seg_end;
+      emit_chunk(conn, client_to_server, d.data() + skip, d.size() - skip, ts_us);
+    }
+    stream.buffered_bytes -= d.size();
+    segments.erase(it);
+  }
+}
+
+void Reassembler::skip_gap(Connection& conn, StreamState& stream, bool client_to_server, uint64_t to,
+                           uint64_t ts_us) {
+  uint64_t bytes = to - stream.next_seq;
+  stats_.gaps_skipped.add();
+  stats_.gap_bytes_skipped.add(bytes);
+  if (!stream.gap_skip_logged) {
+    log_gap_skipped(conn, client_to_server, bytes);
+    stream.gap_skip_logged = true;
+  }
+  stream.next_seq = to;
+  // Lost before any payload: the stream's first bytes no longer start a message.
+  if (!stream.started) stream.syn_seen = false;
+  // The parser decides whether it can stay in sync across the hole or must resync.
+  parser(conn, client_to_server).skip(bytes);
+  // Responses lost in the hole answered pending requests, but which is unknown: they go
+  // out on their own instead of pairing with the responses after the hole.
+  if (!client_to_server && (conn.plugin_response_parser || conn.response_parser.resyncing())) {
+    flush_pending_requests(conn);
+  }
+  deliver_buffered(conn, stream, client_to_server, ts_us);
+}
+
+void Reassembler::skip_expired_gaps(Connection& conn, uint64_t now_ms, uint64_t ts_us) {
+  for (bool c2s : {true, false}) {
+    StreamState& stream = c2s ? conn.client_to_server : conn.server_to_client;
+    // With nothing buffered, a hole can still lie before a FIN that arrived early.
+    bool fin_hole = stream.segments.empty() && stream.fin_seq > stream.next_seq;
+    if ((!stream.segments.empty() || fin_hole) && now_ms - stream.gap_since_ms >= config_.gap_timeout_ms) {
+      skip_gap(conn, stream, c2s, fin_hole ? stream.fin_seq : stream.segments.begin()->first, ts_us);
     }
-  } else if (seq > stream.next_seq) {
-    // Buffer for later
-    stream.segments.push_back({seq, std::vector<uint8_t>(data, data + len)});
-    std::sort(stream.segments.begin(), stream.segments.end(),
-              [](const auto& a, const auto& b) { return a.first < b.first; });
   }
-  // else seq < next_seq: duplicate/retransmit, ignore
 }
 
-void Reassembler::process_segment(const std::string& key, ConnectionState& conn,
-                                   const TcpSegment& seg, bool is_client_to_server) {
+void Reassembler::skip_all_gaps(Connection& conn) {
+  for (bool c2s : {true, false}) {
+    StreamState& stream = c2s ? conn.client_to_server : conn.server_to_client;
+    while (!stream.segments.empty()) skip_gap(conn, stream, c2s, stream.segments.begin()->first, 0);
+  }
+}
+
+void Reassembler::process_segment(uint32_t id, Connection& conn, const TcpSegment& seg, bool is_client_to_server) {
+  if (conn.closed_at_ms != 0) return;  // lingering after close: a late retransmit
+  if (conn.ignored) {
+    stats_.segments_ignored.add();
+    ignore_segment(id, conn, seg, is_client_to_server);
+    return;
+  }
+  if (config_.gap_policy == GapPolicy::kSkip) skip_expired_gaps(conn, conn.last_activity_ms, seg.ts_us);
+  if (seg.rst) {
+    stats_.closes_rst.add();
+    close_connection(id, conn, seg.ts_us);
+    return;
+  }
   StreamState& stream = is_client_to_server ? conn.client_to_server : conn.server_to_client;
-  if (seg.payload.empty()) {
+  if (!is_client_to_server && config_.correlate_exchanges && conn.client_to_server.initial_seq_set) {
+    conn.server_ack = unwrap_seq(seg.ack, conn.client_to_server.next_seq);
+  }
+  if (seg.payload_len == 0) {
     if (seg.syn && !stream.initial_seq_set) {
       stream.initial_seq_set = true;
-      stream.next_seq = seg.seq + 1;  // SYN consumes one
+      stream.syn_seen = true;
+      stream.next_seq = kSeqBase + seg.seq + 1;  // SYN consumes one
+    }
+  } else {
+    deliver_ordered(conn, stream, is_client_to_server, seg.seq, seg.payload, seg.payload_len, seg.ts_us);
+  }
+  if (conn.ignored) {
+    // Classified by this segment: nothing buffered will be parsed.
+    for (StreamState* s : {&conn.client_to_server, &conn.server_to_client}) {
+      s->segments.clear();
+      s->buffered_bytes = 0;
     }
+    ignore_segment(id, conn, seg, is_client_to_server);
     return;
   }
-  uint32_t seq = seg.seq;
-  const uint8_t* data = seg.payload.data();
-  size_t len = seg.payload.size();
-  deliver_ordered(conn, stream, key, is_client_to_server, seq, data, len);
+  if (seg.fin && stream.fin_seq == 0) {
+    if (!stream.initial_seq_set) {
+      stream.next_seq = kSeqBase + seg.seq;  // nothing seen in this direction: the FIN is next
+      stream.initial_seq_set = true;
+    }
+    // The FIN follows the segment's payload; it may arrive before bytes it follows.
+    stream.fin_seq = unwrap_seq(seg.seq, stream.next_seq) + seg.payload_len;
+    if (stream.segments.empty() && stream.fin_seq > stream.next_seq) stream.gap_since_ms = conn.last_activity_ms;
+  }
+  // Skipping a gap or a filled hole can reach either direction's FIN.
+  for (bool c2s : {true, false}) {
+    StreamState& s = c2s ? conn.client_to_server : conn.server_to_client;
+    if (s.fin_seq != 0 && !s.fin_reached && s.next_seq >= s.fin_seq) close_stream(conn, c2s, seg.ts_us, false);
+  }
+  if (conn.client_to_server.fin_reached && conn.server_to_client.fin_reached) {
+    stats_.closes_fin.add();
+    close_connection(id, conn, seg.ts_us);
+  }
 }
 
-void Reassembler::push_segment(const TcpSegment& seg) {
-  uint64_t now = now_ms();
+void Reassembler::init_connection(uint32_t id, const FourTuple& t, uint64_t now) {
+  Connection& conn = connections_.at(id);
   bool receiver_is_src = false;
   for (uint16_t p : config_.capture_ports) {
-    if (seg.src_port == p) { receiver_is_src = true; break; }
-    if (seg.dst_port == p) break;
-  }
-  std::string key = connection_key(seg.src_ip, seg.src_port, seg.dst_ip, seg.dst_port);
-  ConnectionState& conn = connections_[key];
-  if (conn.receiver_port == 0) {
-    conn.created_at_ms = now;
-    conn.last_activity_ms = now;
-    if (receiver_is_src) {
-      conn.receiver_ip = seg.src_ip;
-      conn.receiver_port = seg.src_port;
-      conn.dest_ip = seg.dst_ip;
-      conn.dest_port = seg.dst_port;
-    } else {
-      conn.receiver_ip = seg.dst_ip;
-      conn.receiver_port = seg.dst_port;
-      conn.dest_ip = seg.src_ip;
-      conn.dest_port = seg.src_port;
+    if (t.src_port == p) { receiver_is_src = true; break; }
+    if (t.dst_port == p) break;
+  }
+  conn.created_at_ms = now;
+  conn.last_activity_ms = now;
+  conn.closed_at_ms = 0;
+  if (receiver_is_src) {
+    conn.receiver_ip = t.src_ip;
+    conn.receiver_port = t.src_port;
+    conn.dest_ip = t.dst_ip;
+    conn.dest_port = t.dst_port;
+  } else {
+    conn.receiver_ip = t.dst_ip;
+    conn.receiver_port = t.dst_port;
+    conn.dest_ip = t.src_ip;
+    conn.dest_port = t.src_port;
+  }
+  // Slots are recycled: reset parsers in place so their buffers are reused.
+  // Addresses are formatted here once per connection, not per packet.
+  std::string receiver = ip_to_string(conn.receiver_ip);
+  std::string dest = ip_to_string(conn.dest_ip);
+  size_t max_body_size = config_.max_body_size;
+  for (const auto& [port, limit] : config_.max_body_size_by_port) {
+    if (port == conn.receiver_port) max_body_size = limit;
+  }
+  conn.max_body_size = max_body_size;
+  for (HttpStreamParser* parser : {&conn.request_parser, &conn.response_parser}) {
+    parser->reset();
+    parser->set_max_body_size(max_body_size);
+    parser->set_header_filter(&config_.header_filter);
+    parser->set_headers_too_large_counter(&stats_.headers_too_large);
+    parser->set_connection_metadata(receiver, conn.receiver_port, dest, conn.dest_port);
+  }
+  conn.pending_requests.clear();
+  conn.server_ack = 0;
+  conn.answered_seq = 0;
+  conn.protocol = StreamProtocol::kUnknown;
+  conn.ignored = false;
+  conn.request_parser.set_response_parser(&conn.response_parser);  // slots never move
+  conn.request_parser.set_message_callback(message_callback(id, true));
+  conn.response_parser.set_message_callback(message_callback(id, false));
+}
+
+void Reassembler::push_segment(const TcpSegment& seg) {
+  auto started = std::chrono::steady_clock::now();
+  uint64_t now = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(started.time_since_epoch()).count());
+  // Capture times can step back (merged or re-ordered files): the clock only moves forward.
+  if (config_.capture_clock) now = (clock_us_ = std::max(clock_us_, seg.ts_us)) / 1000;
+  expire_idle(now);
+  const FourTuple& t = seg.tuple;
+  // Sampling is a pure function of the flow, so every packet of an unsampled
+  // connection is dropped here, before any key building, lookup or allocation.
+  if (sample_threshold_ < 65536 && (flow_hash(t) >> 16) >= sample_threshold_) return;
+  ShedLevel shed = config_.load_shedder != nullptr ? config_.load_shedder->level() : ShedLevel::kNone;
+  ConnectionKey key = connection_key(t);
+  uint32_t id = connections_.find(key);
+  if (id != ConnectionTable::kNone && seg.syn && connections_.at(id).closed_at_ms != 0) {
+    remove(id);  // a new connection on the tuple of one that just closed
+    id = ConnectionTable::kNone;
+  }
+  if (id == ConnectionTable::kNone) {
+    if (seg.rst) return;  // nothing to tear down
+    // Shedding only ever refuses whole flows that are not tracked yet; reduced sampling
+    // keeps a subset of the flows the configured rate keeps, by the same hash.
+    if (shed >= ShedLevel::kNoNewConnections ||
+        (shed >= ShedLevel::kReducedSampling && (flow_hash(t) >> 16) >= shed_sample_threshold_)) {
+      stats_.segments_shed.add();
+      return;
     }
+    id = connections_.insert(key);
+    init_connection(id, t, now);
+    lru_append(id);
+    idle_timers_.schedule(id, now + config_.connection_idle_timeout_ms);
+  } else if (id != lru_tail_) {
+    lru_unlink(id);
+    lru_append(id);
   }
+  Connection& conn = connections_.at(id);
   conn.last_activity_ms = now;
+  if (config_.load_shedder != nullptr) {
+    size_t body_limit = shed >= ShedLevel::kNoBodies ? 0 : conn.max_body_size;
+    conn.request_parser.set_max_body_size(body_limit);
+    conn.response_parser.set_max_body_size(body_limit);
+  }
 
   // Packet from destination (client) toward receiver (server) = client→server (request).
-  bool client_to_server = (seg.src_ip == conn.dest_ip && seg.src_port == conn.dest_port);
+  bool client_to_server = (t.src_ip == conn.dest_ip && t.src_port == conn.dest_port);
 
-  process_segment(key, conn, seg, client_to_server);
-  ensure_connection_cap(now);
+  process_segment(id, conn, seg, client_to_server);
+  ensure_connection_cap();
+  stats_.segments.add();
+  stats_.connections.set(connections_.size());
+  stats_.segment_ns.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count()));
 }
 
 }  // namespace tcp_sniffer
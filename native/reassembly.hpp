@@ -7,94 +7,225 @@
 #ifndef TCP_SNIFFER_REASSEMBLY_HPP
 #define TCP_SNIFFER_REASSEMBLY_HPP
 
+#include "connection_table.hpp"
+#include "http_parser.hpp"
+#include "load_shedder.hpp"
 #include "packet.hpp"
+#include "stats.hpp"
+#include "stream_parser.hpp"
+#include "timer_wheel.hpp"
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 namespace tcp_sniffer {
 
-/** Canonical connection key: "ip1:port1-ip2:port2" with smaller endpoint first. */
-std::string connection_key(const std::string& src_ip, uint16_t src_port,
-                           const std::string& dst_ip, uint16_t dst_port);
-
-/** Ordered chunk of stream data for one direction. */
+/**
+ * Ordered chunk of stream data for one direction.
+ * All fields are views: data points either into the capture buffer (in-order
+ * segment) or into reassembly storage (released out-of-order segment), and is
+ * only valid for the duration of the chunk callback.
+ */
 struct StreamChunk {
-  std::string connection_id;  // same as map key
-  std::string receiver_ip;
+  const ConnectionKey* key{nullptr};
+  IpAddress receiver_ip;
   uint16_t receiver_port{0};
-  std::string dest_ip;
+  IpAddress dest_ip;
   uint16_t dest_port{0};
   bool client_to_server{true};  // true = client→server, false = server→client
-  std::vector<uint8_t> data;
+  const uint8_t* data{nullptr};
+  size_t len{0};
+  uint64_t ts_us{0};  // capture time of the segment that made the data deliverable
 };
 
-/** Callback for each contiguous ordered chunk (to be parsed as HTTP in A3). */
+/**
+ * Optional tap for each contiguous ordered chunk. Chunks are always fed to the
+ * connection's own HttpStreamParser; the tap is for diagnostics and benchmarks.
+ */
 using StreamChunkCallback = std::function<void(const StreamChunk&)>;
 
+/**
+ * What to do about a hole in a stream: wait for the missing segment, or give up on
+ * it after ReassemblyConfig::gap_timeout_ms or once max_out_of_order_bytes are
+ * buffered behind it, and move on to the data after it.
+ */
+enum class GapPolicy { kWait, kSkip };
+
+/** What a plugged-in parser for one stream direction is created with (ReassemblyConfig::parser_factory). */
+struct StreamParserContext {
+  StreamProtocol protocol{StreamProtocol::kUnknown};
+  bool client_to_server{true};
+  std::string receiver_ip;
+  uint16_t receiver_port{0};
+  std::string dest_ip;
+  uint16_t dest_port{0};
+  size_t max_body_size{0};
+  const HeaderFilter* header_filter{nullptr};
+  /** Takes parsed messages into exchange correlation and delivery, as for HTTP/1.x. */
+  HttpMessageCallback on_message;
+};
+
+/** Parser for one direction of a connection of context.protocol, or null to ignore the connection. */
+using StreamParserFactory = std::function<std::unique_ptr<StreamParser>(const StreamParserContext& context)>;
+
 /** Config for reassembly (from CaptureConfig). */
 struct ReassemblyConfig {
   std::vector<uint16_t> capture_ports;
   size_t max_concurrent_connections{10000};
   uint64_t connection_idle_timeout_ms{300000};
+  /** Body bytes kept per message (0 = count only); max_body_size_by_port overrides it per receiver port. */
+  size_t max_body_size{1024 * 1024};
+  std::vector<std::pair<uint16_t, size_t>> max_body_size_by_port;
+  /** includeHeaders / redactHeaders, applied by every parser of this reassembler. */
+  HeaderFilter header_filter;
+  /** Fraction of connections to reassemble, decided per flow by flow_hash(). */
+  double sample_rate{1.0};
+  /** Out-of-order bytes buffered per stream direction; kWait drops data beyond it, kSkip skips the hole. */
+  size_t max_out_of_order_bytes{262144};
+  GapPolicy gap_policy{GapPolicy::kSkip};
+  /** kSkip: age at which a hole is skipped (checked on each segment of the connection). */
+  uint64_t gap_timeout_ms{1000};
+  /**
+   * After FIN in both directions or an RST, the connection's messages are flushed at
+   * once and its slot is kept this long (TIME_WAIT-style) so late retransmits are
+   * dropped instead of opening a new connection; a SYN on the tuple ends it early.
+   */
+  uint64_t close_linger_ms{2000};
+  /** Pair each response with its request and emit one exchange record (see HttpMessageData::request). */
+  bool correlate_exchanges{false};
+  /**
+   * Run the idle, gap and linger timeouts on segment capture times (ts_us) instead of
+   * the steady clock, so a capture file replays with the timing it was recorded with.
+   */
+  bool capture_clock{false};
+  /**
+   * Parsers for connections whose first bytes are not HTTP/1.x (e.g. kHttp2), created
+   * for both directions once the protocol is known. Unset, or a null parser, and the
+   * connection is ignored: later segments are dropped after the table lookup.
+   */
+  StreamParserFactory parser_factory;
+  /** Overload level applied to new flows and bodies (null = never shed); must outlive the reassembler. */
+  const LoadShedder* load_shedder{nullptr};
+};
+
+/** Live counters of one Reassembler, updated by its capture thread (see stats.hpp). */
+struct ReassemblyStats {
+  Counter segments;                 // segments processed (after sampling)
+  Counter bytes_reassembled;        // in-order bytes handed to the parsers
+  Counter out_of_order_bytes;       // bytes copied into out-of-order buffers
+  Counter out_of_order_drops;       // gapPolicy 'wait': segments dropped over the budget
+  Counter gaps;                     // holes opened in a stream
+  Counter gaps_skipped;             // holes given up on (gapPolicy 'skip')
+  Counter gap_bytes_skipped;
+  Counter evictions_idle;
+  Counter evictions_cap;
+  Counter closes_fin;               // connections closed by FIN in both directions
+  Counter closes_rst;               // connections closed by RST
+  Counter messages_parsed;          // requests and responses, before correlation
+  Counter connections;              // gauge: tracked connections
+  Counter segments_shed;            // segments of untracked flows refused by load shedding
+  Counter connections_ignored;      // classified as a protocol without a parser
+  Counter segments_ignored;         // segments of ignored connections, dropped after the lookup
+  Counter headers_too_large;        // header blocks (64 KiB), chunk-size lines (1 KiB) or trailers (64 KiB) unterminated
+  Histogram segment_ns;             // push_segment time: reassembly and parsing
+  Histogram capture_to_parse_us;    // completing segment's capture time to message parsed
 };
 
 /**
- * Reassembles TCP segments per connection, produces ordered byte streams per direction.
- * Enforces connection cap and idle timeout; logs evictions and gaps.
+ * Reassembles TCP segments per connection, produces ordered byte streams per direction
+ * and feeds them to the per-direction parsers stored alongside the connection, chosen
+ * by classify_stream() on the connection's first bytes.
+ * Enforces connection cap (least recently active first, via an intrusive LRU list)
+ * and idle timeout (via a timer wheel), both amortized O(1) per packet; tears
+ * connections down on FIN/RST after a short linger; logs evictions and gaps.
  */
 class Reassembler {
  public:
   explicit Reassembler(ReassemblyConfig config);
   void set_stream_chunk_callback(StreamChunkCallback cb) { on_chunk_ = std::move(cb); }
 
+  /**
+   * Callback for every parsed HTTP message (both directions, all connections). With
+   * correlate_exchanges, responses carry their request and requests are only passed
+   * on their own when no response arrives (connection evicted, or flush_exchanges).
+   */
+  void set_message_callback(HttpMessageCallback cb) { on_message_ = std::move(cb); }
+
   /** Process one decoded segment (called from capture thread). */
   void push_segment(const TcpSegment& seg);
 
-  /** Evict idle connections (call periodically or from capture loop). */
+  /**
+   * Evict idle connections. push_segment already does this incrementally; call
+   * only to expire connections when no packets are arriving.
+   */
   void evict_idle(uint64_t now_ms);
 
+  /** Emit requests still waiting for a response on every connection (e.g. at stop). */
+  void flush_exchanges();
+
+  /**
+   * End of input (pcapFile EOF): close every open connection as if cut short. Holes are
+   * skipped whatever the gap policy, buffered segments delivered and both parsers
+   * closed, so partial and read-until-close messages are emitted as incomplete.
+   */
+  void close_all();
+
   /** Number of currently tracked connections. */
   size_t connection_count() const;
 
-  /** Current time in ms (for evict_idle). */
+  /** Live counters; safe to read from any thread. */
+  const ReassemblyStats& stats() const { return stats_; }
+
+  /** Current time in ms (for evict_idle): the latest capture time seen with capture_clock. */
   uint64_t now_ms() const;
 
  private:
-  struct StreamState {
-    uint32_t next_seq{0};       // next expected sequence number (after last delivered)
-    bool initial_seq_set{false};
-    std::vector<uint8_t> pending;  // unordered pending; we merge and deliver in order
-    // Simple approach: store (seq, data) segments, then deliver in order
-    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> segments;
-  };
-
-  struct ConnectionState {
-    std::string receiver_ip;
-    uint16_t receiver_port{0};
-    std::string dest_ip;
-    uint16_t dest_port{0};
-    StreamState client_to_server;
-    StreamState server_to_client;
-    uint64_t last_activity_ms{0};
-    uint64_t created_at_ms{0};  // for LRU eviction
-  };
-
-  void ensure_connection_cap(uint64_t now_ms);
-  void process_segment(const std::string& key, ConnectionState& conn,
-                       const TcpSegment& seg, bool is_client_to_server);
-  void deliver_ordered(ConnectionState& conn, StreamState& stream,
-                       const std::string& key, bool client_to_server,
-                       uint32_t seq, const uint8_t* data, size_t len);
-  void log_eviction(const std::string& key);
-  void log_gap(const std::string& key, bool client_to_server);
+  void init_connection(uint32_t id, const FourTuple& t, uint64_t now);
+  void on_parsed(const HttpMessageData& m);
+  void on_request(uint32_t id, HttpMessageData&& request);
+  void on_response(uint32_t id, HttpMessageData&& response);
+  void flush_pending_requests(Connection& conn);
+  void evict(uint32_t id);
+  void remove(uint32_t id);
+  void close_stream(Connection& conn, bool client_to_server, uint64_t ts_us, bool aborted);
+  void start_stream(Connection& conn, StreamState& stream, bool client_to_server, const uint8_t* data, size_t len);
+  bool attach_plugin_parsers(Connection& conn);
+  void ignore_segment(uint32_t id, Connection& conn, const TcpSegment& seg, bool client_to_server);
+  StreamParser& parser(Connection& conn, bool client_to_server);
+  HttpMessageCallback message_callback(uint32_t id, bool client_to_server);
+  void close_connection(uint32_t id, Connection& conn, uint64_t ts_us);
+  void expire_idle(uint64_t now_ms);
+  void ensure_connection_cap();
+  void lru_unlink(uint32_t id);
+  void lru_append(uint32_t id);
+  void process_segment(uint32_t id, Connection& conn, const TcpSegment& seg, bool is_client_to_server);
+  void deliver_ordered(Connection& conn, StreamState& stream, bool client_to_server,
+                       uint32_t seq, const uint8_t* data, size_t len, uint64_t ts_us);
+  bool buffer_out_of_order(Connection& conn, StreamState& stream, uint64_t start, const uint8_t* data, size_t len);
+  void deliver_buffered(Connection& conn, StreamState& stream, bool client_to_server, uint64_t ts_us);
+  void skip_gap(Connection& conn, StreamState& stream, bool client_to_server, uint64_t to, uint64_t ts_us);
+  void skip_expired_gaps(Connection& conn, uint64_t now_ms, uint64_t ts_us);
+  void skip_all_gaps(Connection& conn);
+  void emit_chunk(Connection& conn, bool client_to_server, const uint8_t* data, size_t len, uint64_t ts_us);
+  void log_eviction(const Connection& conn);
+  void log_gap(const Connection& conn, bool client_to_server);
+  void log_gap_skipped(const Connection& conn, bool client_to_server, uint64_t bytes);
+  void log_out_of_order_overflow(const Connection& conn, bool client_to_server);
 
   ReassemblyConfig config_;
   StreamChunkCallback on_chunk_;
-  std::unordered_map<std::string, ConnectionState> connections_;
-  uint64_t connection_order_{0};  // for LRU
+  HttpMessageCallback on_message_;
+  ConnectionTable connections_;
+  TimerWheel idle_timers_;
+  std::vector<uint32_t> expired_;  // scratch for idle_timers_.advance
+  uint64_t clock_us_{0};            // capture_clock: latest segment capture time
+  uint32_t sample_threshold_;
+  uint32_t shed_sample_threshold_;  // ShedLevel::kReducedSampling threshold for new flows
+  uint32_t lru_head_{ConnectionTable::kNone};  // least recently active
+  uint32_t lru_tail_{ConnectionTable::kNone};  // most recently active
+  ReassemblyStats stats_;
 };
 
 }  // namespace tcp_sniffer
@@ -0,0 +1,63 @@
+/**
+ * TCP Sniffer — Live pipeline statistics implementation.
+ */
+
+#include "stats.hpp"
+
+namespace tcp_sniffer {
+
+size_t Histogram::bucket_index(uint64_t value) {
+  if (value < kSubBuckets) return static_cast<size_t>(value);
+  // The four bits below the most significant one pick the sub-bucket.
+  unsigned shift = static_cast<unsigned>(63 - __builtin_clzll(value)) - 4;
+  return (shift + 1) * kSubBuckets + static_cast<size_t>((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::bucket_upper_bound(size_t i) {
+  if (i < kSubBuckets) return i;
+  unsigned shift = static_cast<unsigned>(i / kSubBuckets) - 1;
+  uint64_t lower = (kSubBuckets + i % kSubBuckets) << shift;
+  return lower + ((uint64_t{1} << shift) - 1);
+}
+
+void Histogram::record(uint64_t value) {
+  std::atomic<uint64_t>& bucket = buckets_[bucket_index(value)];
+  bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+}
+
+void Histogram::reset() {
+  for (std::atomic<uint64_t>& b : buckets_) b.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+void HistogramSnapshot::merge(const Histogram& h) {
+  for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+    uint64_t n = h.buckets_[i].load(std::memory_order_relaxed);
+    buckets[i] += n;
+    count += n;
+  }
+  sum += h.sum_.load(std::memory_order_relaxed);
+  uint64_t m = h.max_.load(std::memory_order_relaxed);
+  if (m > max) max = m;
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+  if (count == 0) return 0;
+  // 1-based rank of the quantile among the recorded values.
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+  if (rank == 0) rank = 1;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < Histogram::kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t bound = Histogram::bucket_upper_bound(i);
+      return bound < max ? bound : max;
+    }
+  }
+  return max;
+}
+
+}  // namespace tcp_sniffer
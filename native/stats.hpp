@@ -0,0 +1,72 @@
+/**
+ * TCP Sniffer — Live pipeline statistics (A4).
+ * Single-writer counters and log-linear latency histograms that the capture, reassembly
+ * and delivery threads update without locks and getStats() reads from the JS thread.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_STATS_HPP
+#define TCP_SNIFFER_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace tcp_sniffer {
+
+/**
+ * Counter (or gauge) written by one thread and read by any. Updates are a relaxed
+ * load and store, not a locked read-modify-write, since there is a single writer.
+ */
+class Counter {
+ public:
+  void add(uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  void set(uint64_t v) { value_.store(v, std::memory_order_relaxed); }
+  uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+/**
+ * HDR-style histogram: values below 16 get a bucket each, larger ones 16 linear
+ * sub-buckets per power of two, so a bucket's bounds are within 1/16 of each other
+ * over the whole 64-bit range. Single writer (like Counter); snapshots from any thread.
+ */
+class Histogram {
+ public:
+  static constexpr size_t kSubBuckets = 16;
+  static constexpr size_t kBuckets = (64 - 4 + 1) * kSubBuckets;
+
+  void record(uint64_t value);
+  void reset();
+  /** Sum of the recorded values (without a full snapshot). */
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  static size_t bucket_index(uint64_t value);
+  /** Largest value that falls into bucket i. */
+  static uint64_t bucket_upper_bound(size_t i);
+
+ private:
+  friend struct HistogramSnapshot;
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+/** Point-in-time copy of one or more histograms (merged by adding buckets). */
+struct HistogramSnapshot {
+  std::array<uint64_t, Histogram::kBuckets> buckets{};
+  uint64_t count{0};
+  uint64_t sum{0};
+  uint64_t max{0};
+
+  void merge(const Histogram& h);
+  /** Upper bound of the bucket holding quantile q in [0, 1] (capped at max); 0 when empty. */
+  uint64_t percentile(double q) const;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_STATS_HPP
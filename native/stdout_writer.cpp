@@ -0,0 +1,171 @@
+/**
+ * TCP Sniffer — Native stdout writer implementation.
+ */
+
+#include "stdout_writer.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace tcp_sniffer {
+
+namespace {
+
+#ifdef IOV_MAX
+constexpr size_t kMaxIov = IOV_MAX;
+#else
+constexpr size_t kMaxIov = 1024;
+#endif
+
+}  // namespace
+
+StdoutWriter::StdoutWriter(StdoutWriterConfig config) : config_(config) {
+  if (config_.max_pending_bytes == 0) config_.max_pending_bytes = 1;
+}
+
+StdoutWriter::~StdoutWriter() {
+  stop();
+}
+
+void StdoutWriter::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable()) return;
+  stopping_ = false;
+  fd_ = config_.fd;
+  struct stat st;
+  if (::fstat(config_.fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+    // O_NONBLOCK on the shared description would change Node's own stdout writes.
+    std::string path = "/proc/self/fd/" + std::to_string(config_.fd);
+    own_fd_ = ::open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (own_fd_ >= 0) fd_ = own_fd_;
+  }
+  thread_ = std::thread(&StdoutWriter::run, this);
+}
+
+void StdoutWriter::write(std::string&& chunk, size_t messages) {
+  if (chunk.empty()) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  not_full_cv_.wait(lock, [this] {
+    return pending_bytes_ < config_.max_pending_bytes || failed_ || draining_ || stopping_;
+  });
+  if (failed_ || pending_bytes_ >= config_.max_pending_bytes) {
+    messages_dropped_.add(messages);
+    return;
+  }
+  pending_bytes_ += chunk.size();
+  pending_messages_ += messages;
+  pending_.push_back(std::move(chunk));
+  if (pending_.size() == 1) not_empty_cv_.notify_one();
+}
+
+void StdoutWriter::begin_drain() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    draining_ = true;
+    drain_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.drain_timeout_ms);
+    drain_started_.store(true, std::memory_order_release);
+  }
+  not_full_cv_.notify_all();
+}
+
+void StdoutWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  not_empty_cv_.notify_one();
+  not_full_cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+  if (own_fd_ >= 0) {
+    ::close(own_fd_);
+    own_fd_ = -1;
+  }
+}
+
+bool StdoutWriter::failed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failed_;
+}
+
+bool StdoutWriter::write_all(const std::vector<std::string>& chunks) {
+  std::vector<struct iovec> iov;
+  iov.reserve(std::min(chunks.size(), kMaxIov));
+  size_t next = 0;  // first chunk not yet in iov
+  while (next < chunks.size() || !iov.empty()) {
+    while (next < chunks.size() && iov.size() < kMaxIov) {
+      const std::string& c = chunks[next++];
+      iov.push_back({const_cast<char*>(c.data()), c.size()});
+    }
+    ssize_t n = ::writev(fd_, iov.data(), static_cast<int>(iov.size()));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      const char* error = std::strerror(errno);
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (!drain_started_.load(std::memory_order_acquire) || std::chrono::steady_clock::now() < drain_deadline_) {
+          // The pipe is full; wait until the reader takes some.
+          struct pollfd pfd = {fd_, POLLOUT, 0};
+          ::poll(&pfd, 1, 100);
+          continue;
+        }
+        error = "reader stalled while stopping";
+      }
+      Logger& log = Logger::instance();
+      if (log.admit(LogEvent::kStdoutWriteFailed)) {
+        log.write(LogEvent::kStdoutWriteFailed, "\"error\":\"%s\"", json_escape(error).c_str());
+      }
+      return false;
+    }
+    writes_.add();
+    bytes_written_.add(static_cast<uint64_t>(n));
+    // Drop what was written in full and trim a partially written first entry.
+    size_t done = static_cast<size_t>(n);
+    size_t consumed = 0;
+    while (consumed < iov.size() && done >= iov[consumed].iov_len) done -= iov[consumed++].iov_len;
+    iov.erase(iov.begin(), iov.begin() + static_cast<std::ptrdiff_t>(consumed));
+    if (!iov.empty()) {
+      iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + done;
+      iov[0].iov_len -= done;
+    }
+  }
+  return true;
+}
+
+void StdoutWriter::run() {
+  std::vector<std::string> writing;
+  size_t writing_messages = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_cv_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+      if (pending_.empty()) return;  // stopping, and everything queued has been written
+      writing.swap(pending_);
+      writing_messages = pending_messages_;
+      pending_bytes_ = 0;
+      pending_messages_ = 0;
+    }
+    not_full_cv_.notify_all();
+    bool ok = write_all(writing);
+    writing.clear();
+    if (!ok) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ = true;
+      // Lines of the failed batch may have gone out; its messages count as not written in full.
+      messages_dropped_.add(writing_messages + pending_messages_);
+      pending_.clear();
+      pending_bytes_ = 0;
+      pending_messages_ = 0;
+      not_full_cv_.notify_all();
+      return;
+    }
+  }
+}
+
+}  // namespace tcp_sniffer
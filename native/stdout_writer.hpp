@@ -0,0 +1,100 @@
+/**
+ * TCP Sniffer — Native stdout writer (A4).
+ * A dedicated thread writes queued NDJSON chunks to a file descriptor with one
+ * writev per wakeup, so nativeStdout output never passes through the JS thread. The
+ * queue is bounded in bytes: when the reader of the pipe falls behind, write() blocks
+ * the caller (the message queue's flusher), and the message queue applies
+ * backpressurePolicy. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_STDOUT_WRITER_HPP
+#define TCP_SNIFFER_STDOUT_WRITER_HPP
+
+#include "stats.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tcp_sniffer {
+
+struct StdoutWriterConfig {
+  int fd{1};
+  /** Bytes queued and not yet being written before write() blocks. */
+  size_t max_pending_bytes{8u << 20};
+  /** After begin_drain(), how long the final writes may wait for the reader. */
+  uint64_t drain_timeout_ms{1000};
+};
+
+class StdoutWriter {
+ public:
+  explicit StdoutWriter(StdoutWriterConfig config = {});
+  ~StdoutWriter();
+  StdoutWriter(const StdoutWriter&) = delete;
+  StdoutWriter& operator=(const StdoutWriter&) = delete;
+
+  /**
+   * Start the writer thread. A pipe is written through its own non-blocking open of
+   * /proc/self/fd/N, so a stalled reader can be given up on without changing the
+   * flags of the caller's descriptor.
+   */
+  void start();
+
+  /**
+   * Queue chunk (whole lines, the encoding of messages messages), blocking while
+   * max_pending_bytes are already queued. After a write error everything is
+   * discarded and counted in messages_dropped().
+   */
+  void write(std::string&& chunk, size_t messages);
+
+  /**
+   * Shutdown has begun: write() no longer waits for queue space (a chunk that does not
+   * fit is discarded and counted), and a pipe still full drain_timeout_ms later fails
+   * the writer, so stop() cannot hang on a stalled reader.
+   */
+  void begin_drain();
+
+  /** Write everything queued and join the writer thread. */
+  void stop();
+
+  uint64_t bytes_written() const { return bytes_written_.get(); }
+  /** writev calls made. */
+  uint64_t writes() const { return writes_.get(); }
+  /** Messages not written in full: the batch a write failed in, and every one after it. */
+  uint64_t messages_dropped() const { return messages_dropped_.get(); }
+  /** True once a write failed (e.g. EPIPE: the reader went away). */
+  bool failed() const;
+
+ private:
+  void run();
+  /** Write all of chunks; false on an error other than EINTR/EAGAIN, or a drain timeout. */
+  bool write_all(const std::vector<std::string>& chunks);
+
+  StdoutWriterConfig config_;
+  int fd_{-1};        // what is written to: config_.fd, or own_fd_
+  int own_fd_{-1};    // non-blocking open of a pipe, closed by stop()
+  std::vector<std::string> pending_;
+  size_t pending_bytes_{0};
+  size_t pending_messages_{0};
+  bool stopping_{false};
+  bool failed_{false};
+  bool draining_{false};
+  std::atomic<bool> drain_started_{false};
+  std::chrono::steady_clock::time_point drain_deadline_{};  // set before drain_started_
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_cv_;
+  std::condition_variable not_full_cv_;
+  Counter bytes_written_;
+  Counter writes_;
+  Counter messages_dropped_;
+  std::thread thread_;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_STDOUT_WRITER_HPP
@@ -0,0 +1,58 @@
+/**
+ * TCP Sniffer — Stream classification implementation.
+ */
+
+#include "stream_parser.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace tcp_sniffer {
+
+namespace {
+
+constexpr std::string_view kHttp2Preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+/** Longest method accepted as HTTP (registered methods are at most 17 characters). */
+constexpr size_t kMaxMethodLength = 20;
+
+/** data starts with token, or all of data is a prefix of it. */
+bool starts_with(const uint8_t* data, size_t len, std::string_view token) {
+  return std::memcmp(data, token.data(), std::min(len, token.size())) == 0;
+}
+
+/**
+ * A request line's method: upper-case letters (with '-' or '_') then a space. Any
+ * such token, not only the resync list, so WebDAV and other extension methods pass.
+ */
+bool method_token(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len && i < kMaxMethodLength &&
+         ((data[i] >= 'A' && data[i] <= 'Z') || data[i] == '-' || data[i] == '_')) {
+    ++i;
+  }
+  if (i == len) return i < kMaxMethodLength;  // the chunk ends inside the token
+  return i > 0 && data[i] == ' ';
+}
+
+/** TLS record header: content type 20–23, then legacy version 3.x (SSL 3.0 through TLS 1.3). */
+bool tls_record(const uint8_t* data, size_t len) {
+  if (data[0] < 0x14 || data[0] > 0x17) return false;
+  return len < 2 || (data[1] == 3 && (len < 3 || data[2] <= 4));
+}
+
+}  // namespace
+
+StreamProtocol classify_stream(const uint8_t* data, size_t len, bool client_to_server) {
+  if (len == 0) return StreamProtocol::kUnknown;
+  // "PRI" alone is also a method token: only a preface past it is HTTP/2.
+  if (client_to_server && len > 3 && starts_with(data, len, kHttp2Preface)) return StreamProtocol::kHttp2;
+  if (tls_record(data, len)) return StreamProtocol::kTls;
+  size_t skip = 0;
+  while (skip < len && (data[skip] == '\r' || data[skip] == '\n')) ++skip;
+  if (skip == len) return StreamProtocol::kHttp1;
+  bool http = client_to_server ? method_token(data + skip, len - skip) : starts_with(data + skip, len - skip, "HTTP/");
+  return http ? StreamProtocol::kHttp1 : StreamProtocol::kOther;
+}
+
+}  // namespace tcp_sniffer
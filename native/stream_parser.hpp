@@ -0,0 +1,52 @@
+/**
+ * TCP Sniffer — Stream classification and parser interface (A3).
+ * The first bytes of a connection decide its protocol; each direction of a connection
+ * with a parser for that protocol is then fed to a StreamParser. HTTP/1.x
+ * (HttpStreamParser) is built in; other protocols plug in through
+ * ReassemblyConfig::parser_factory. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_STREAM_PARSER_HPP
+#define TCP_SNIFFER_STREAM_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tcp_sniffer {
+
+enum class StreamProtocol : uint8_t {
+  kUnknown,  // no payload seen yet
+  kHttp1,
+  kHttp2,  // prior-knowledge preface (h2c, or gRPC without TLS)
+  kTls,
+  kOther,
+};
+
+/**
+ * Protocol from the first bytes of one direction of a stream: a request method token
+ * (client→server) or `HTTP/` (server→client), the HTTP/2 connection preface, or a TLS
+ * record header; kOther for anything else. Leading CR/LF is skipped as the HTTP
+ * parser does, and a chunk too short to tell counts as the protocol it is a prefix
+ * of. Looks only at the first few bytes; kUnknown only for len 0.
+ */
+StreamProtocol classify_stream(const uint8_t* data, size_t len, bool client_to_server);
+
+/** Consumer of one direction of a reassembled stream; emits what it parses through its own callback. */
+class StreamParser {
+ public:
+  virtual ~StreamParser() = default;
+  /** Next bytes of the stream, in order; ts_us is their capture time (0 = now). */
+  virtual void feed(const uint8_t* data, size_t len, uint64_t ts_us) = 0;
+  /** len bytes of the stream were lost (a skipped gap); the next feed continues after them. */
+  virtual void skip(uint64_t len) = 0;
+  /**
+   * The stream ended; emit what can still be emitted. aborted unless it was a FIN
+   * reached with every byte before it delivered (an RST, or data lost or still
+   * behind a hole): then nothing in progress is complete.
+   */
+  virtual void close(uint64_t ts_us, bool aborted) = 0;
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_STREAM_PARSER_HPP
@@ -0,0 +1,106 @@
+/**
+ * TCP Sniffer — Timer wheel implementation.
+ */
+
+#include "timer_wheel.hpp"
+#include <algorithm>
+
+namespace tcp_sniffer {
+
+TimerWheel::TimerWheel(uint64_t tick_ms, uint64_t now_ms)
+    : tick_ms_(tick_ms == 0 ? 1 : tick_ms), current_tick_(now_ms / tick_ms_) {
+  std::fill(std::begin(heads_), std::end(heads_), kNone);
+}
+
+void TimerWheel::link(uint32_t id, uint32_t slot) {
+  Node& n = nodes_[id];
+  n.slot = slot;
+  n.prev = kNone;
+  n.next = heads_[slot];
+  if (n.next != kNone) nodes_[n.next].prev = id;
+  heads_[slot] = id;
+}
+
+void TimerWheel::unlink(uint32_t id) {
+  Node& n = nodes_[id];
+  if (n.prev != kNone) nodes_[n.prev].next = n.next;
+  else heads_[n.slot] = n.next;
+  if (n.next != kNone) nodes_[n.next].prev = n.prev;
+  n.prev = n.next = n.slot = kNone;
+}
+
+void TimerWheel::place(uint32_t id, uint64_t earliest_tick) {
+  const uint64_t horizon = (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+  uint64_t expiry = nodes_[id].expiry_tick;
+  // Due timers go in the earliest slot still to be processed; far timers are clamped
+  // to the top level and re-placed (with their real expiry) when they cascade.
+  if (expiry < earliest_tick) expiry = earliest_tick;
+  if (expiry - current_tick_ > horizon) expiry = current_tick_ + horizon;
+  uint64_t diff = (expiry ^ current_tick_) | (kSlots - 1);
+  unsigned level = (63u - static_cast<unsigned>(__builtin_clzll(diff))) / kSlotBits;
+  if (level >= kLevels) level = kLevels - 1;
+  uint32_t slot = static_cast<uint32_t>(level * kSlots + ((expiry >> (level * kSlotBits)) & (kSlots - 1)));
+  link(id, slot);
+}
+
+void TimerWheel::schedule(uint32_t id, uint64_t expiry_ms) {
+  if (id >= nodes_.size()) nodes_.resize(static_cast<size_t>(id) + 1);
+  if (nodes_[id].slot != kNone) unlink(id);
+  else ++size_;
+  nodes_[id].expiry_tick = (expiry_ms + tick_ms_ - 1) / tick_ms_;
+  place(id, current_tick_ + 1);
+}
+
+void TimerWheel::cancel(uint32_t id) {
+  if (!scheduled(id)) return;
+  unlink(id);
+  --size_;
+}
+
+uint32_t TimerWheel::take_slot(uint32_t slot) {
+  uint32_t head = heads_[slot];
+  heads_[slot] = kNone;
+  return head;
+}
+
+void TimerWheel::advance(uint64_t now_ms, std::vector<uint32_t>& expired) {
+  uint64_t target = now_ms / tick_ms_;
+  if (target <= current_tick_) return;
+  if (size_ == 0) {
+    current_tick_ = target;
+    return;
+  }
+  while (current_tick_ < target) {
+    uint64_t t = ++current_tick_;
+    // Cascade from the top so entries can fall through several levels in one tick.
+    for (unsigned level = kLevels - 1; level >= 1; --level) {
+      if ((t & ((uint64_t{1} << (level * kSlotBits)) - 1)) != 0) continue;
+      uint32_t slot = static_cast<uint32_t>(level * kSlots + ((t >> (level * kSlotBits)) & (kSlots - 1)));
+      for (uint32_t id = take_slot(slot); id != kNone;) {
+        uint32_t next = nodes_[id].next;
+        nodes_[id].prev = nodes_[id].next = nodes_[id].slot = kNone;
+        place(id, t);  // level 0 slot for t is processed below, this tick
+        id = next;
+      }
+    }
+    uint32_t slot = static_cast<uint32_t>(t & (kSlots - 1));
+    for (uint32_t id = take_slot(slot); id != kNone;) {
+      Node& n = nodes_[id];
+      uint32_t next = n.next;
+      n.prev = n.next = n.slot = kNone;
+      if (n.expiry_tick <= t) {
+        --size_;
+        expired.push_back(id);
+      } else {
+        place(id, t + 1);
+      }
+      id = next;
+    }
+    if (size_ == 0) {
+      current_tick_ = target;
+      break;
+    }
+  }
+}
+
+}  // namespace tcp_sniffer
@@ -0,0 +1,70 @@
+/**
+ * TCP Sniffer — Hierarchical timer wheel (A2).
+ * Amortized O(1) schedule / cancel / expire for per-connection timeouts, keyed by
+ * ConnectionTable slot id. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_TIMER_WHEEL_HPP
+#define TCP_SNIFFER_TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tcp_sniffer {
+
+/**
+ * Four levels of 64 slots; level l slots span 64^l ticks. A timer is placed on the
+ * level of the highest 6-bit tick group in which its expiry differs from the current
+ * tick, and cascades down as lower groups roll over. Each id has at most one timer.
+ */
+class TimerWheel {
+ public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  /** tick_ms is the timer resolution; expiries are rounded up to a tick. */
+  explicit TimerWheel(uint64_t tick_ms, uint64_t now_ms);
+
+  /** Arm (or re-arm) the timer for id to fire at expiry_ms. */
+  void schedule(uint32_t id, uint64_t expiry_ms);
+
+  /** Disarm the timer for id, if any. */
+  void cancel(uint32_t id);
+
+  bool scheduled(uint32_t id) const { return id < nodes_.size() && nodes_[id].slot != kNone; }
+
+  /**
+   * Advance to now_ms and append the ids of expired timers to expired (they are
+   * disarmed). Cheap when no tick has elapsed; call once per packet.
+   */
+  void advance(uint64_t now_ms, std::vector<uint32_t>& expired);
+
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 6;
+  static constexpr unsigned kSlots = 1u << kSlotBits;
+
+  struct Node {
+    uint32_t prev{kNone};
+    uint32_t next{kNone};
+    uint32_t slot{kNone};  // index into heads_, kNone when disarmed
+    uint64_t expiry_tick{0};
+  };
+
+  void place(uint32_t id, uint64_t earliest_tick);
+  void link(uint32_t id, uint32_t slot);
+  void unlink(uint32_t id);
+  uint32_t take_slot(uint32_t slot);
+
+  uint64_t tick_ms_;
+  uint64_t current_tick_;
+  std::vector<Node> nodes_;
+  uint32_t heads_[kLevels * kSlots];
+  size_t size_{0};
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_TIMER_WHEEL_HPP
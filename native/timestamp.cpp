@@ -0,0 +1,55 @@
+/**
+ * TCP Sniffer — message timestamp implementation.
+ */
+
+#include "timestamp.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+namespace tcp_sniffer {
+
+namespace {
+
+/** "YYYY-MM-DDTHH:MM:SS." of the last second formatted on this thread. */
+struct SecondCache {
+  int64_t second{-1};
+  char prefix[32]{};
+  size_t len{0};
+};
+
+}  // namespace
+
+uint64_t unix_time_us() {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+std::string format_iso_timestamp(uint64_t unix_us) {
+  thread_local SecondCache cache;
+  int64_t second = static_cast<int64_t>(unix_us / 1000000);
+  unsigned ms = static_cast<unsigned>(unix_us / 1000 % 1000);
+  if (second != cache.second) {
+    time_t s = static_cast<time_t>(second);
+    struct tm tm_buf;
+#ifdef _WIN32
+    gmtime_s(&tm_buf, &s);
+#else
+    gmtime_r(&s, &tm_buf);
+#endif
+    int n = snprintf(cache.prefix, sizeof(cache.prefix), "%04d-%02d-%02dT%02d:%02d:%02d.", tm_buf.tm_year + 1900,
+                     tm_buf.tm_mon + 1, tm_buf.tm_mday, tm_buf.tm_hour, tm_buf.tm_min, tm_buf.tm_sec);
+    cache.len = n > 0 ? static_cast<size_t>(n) : 0;
+    cache.second = second;
+  }
+  std::string out;
+  out.reserve(cache.len + 4);
+  out.append(cache.prefix, cache.len);
+  out.push_back(static_cast<char>('0' + ms / 100));
+  out.push_back(static_cast<char>('0' + ms / 10 % 10));
+  out.push_back(static_cast<char>('0' + ms % 10));
+  out.push_back('Z');
+  return out;
+}
+
+}  // namespace tcp_sniffer
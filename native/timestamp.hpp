@@ -0,0 +1,27 @@
+/**
+ * TCP Sniffer — message timestamps (A3).
+ * Messages carry capture times as µs since the Unix epoch; the ISO 8601 form is
+ * produced only when a message is converted for JS. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_TIMESTAMP_HPP
+#define TCP_SNIFFER_TIMESTAMP_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace tcp_sniffer {
+
+/** Current wall-clock time in µs since the Unix epoch (for input without a capture time). */
+uint64_t unix_time_us();
+
+/**
+ * "YYYY-MM-DDTHH:MM:SS.mmmZ" for unix_us, matching Date.prototype.toISOString.
+ * The date and time of day are cached per thread for the last second formatted, so
+ * consecutive messages only format their milliseconds.
+ */
+std::string format_iso_timestamp(uint64_t unix_us);
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_TIMESTAMP_HPP
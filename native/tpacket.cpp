@@ -0,0 +1,203 @@
+/**
+ * TCP Sniffer — TPACKET_V3 ring implementation.
+ * Linux only.
+ */
+
+#include "tpacket.hpp"
+#include <pcap.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace tcp_sniffer {
+
+namespace {
+
+constexpr size_t kCacheLine = 64;
+
+std::string errno_message(const char* what) {
+  return std::string(what) + ": " + std::strerror(errno);
+}
+
+}  // namespace
+
+TpacketRing::~TpacketRing() {
+  close();
+}
+
+bool TpacketRing::open(const std::string& iface, const TpacketConfig& config, const bpf_program* filter,
+                       int fanout_arg, std::string* error) {
+  // SOCK_DGRAM: the kernel strips each device's link header (and VLAN tags), so frames
+  // from Ethernet, tun/WireGuard, PPP and every other device on "any" all start at IP.
+  fd_ = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+  if (fd_ < 0) {
+    *error = errno_message("socket(AF_PACKET)");
+    return false;
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+    *error = errno_message("setsockopt(PACKET_VERSION)");
+    close();
+    return false;
+  }
+
+  // Attach the filter before binding so no unfiltered packets reach the ring.
+  if (filter != nullptr) {
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(filter->bf_len);
+    prog.filter = reinterpret_cast<struct sock_filter*>(filter->bf_insns);  // same layout as bpf_insn
+    if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0) {
+      *error = errno_message("setsockopt(SO_ATTACH_FILTER)");
+      close();
+      return false;
+    }
+  }
+
+  // Frame size only bounds the snaplen here; V3 packs variable-length frames into blocks.
+  size_t frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + config.snaplen);
+  if (frame_size > config.block_size) frame_size = config.block_size;
+  struct tpacket_req3 req;
+  std::memset(&req, 0, sizeof(req));
+  req.tp_block_size = static_cast<unsigned int>(config.block_size);
+  req.tp_block_nr = static_cast<unsigned int>(config.block_count);
+  req.tp_frame_size = static_cast<unsigned int>(frame_size);
+  req.tp_frame_nr = static_cast<unsigned int>((config.block_size / frame_size) * config.block_count);
+  req.tp_retire_blk_tov = config.block_timeout_ms;
+  if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+    *error = errno_message("setsockopt(PACKET_RX_RING)");
+    close();
+    return false;
+  }
+
+  map_size_ = config.block_size * config.block_count;
+  void* map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    *error = errno_message("mmap(PACKET_RX_RING)");
+    map_size_ = 0;
+    close();
+    return false;
+  }
+  map_ = static_cast<uint8_t*>(map);
+  block_size_ = config.block_size;
+  block_count_ = config.block_count;
+
+  unsigned int ifindex = 0;  // 0 = all interfaces ("any")
+  if (iface != "any") {
+    ifindex = if_nametoindex(iface.c_str());
+    if (ifindex == 0) {
+      *error = "unknown interface: " + iface;
+      close();
+      return false;
+    }
+  }
+  struct sockaddr_ll addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = static_cast<int>(ifindex);
+  if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    *error = errno_message("bind(AF_PACKET)");
+    close();
+    return false;
+  }
+
+  if (ifindex != 0) {
+    struct packet_mreq mreq;
+    std::memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = static_cast<int>(ifindex);
+    mreq.mr_type = PACKET_MR_PROMISC;
+    // Best effort, like pcap_open_live(promisc=1).
+    setsockopt(fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+  }
+
+  if (fanout_arg != 0 &&
+      setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) != 0) {
+    *error = errno_message("setsockopt(PACKET_FANOUT)");
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool TpacketRing::run(const std::atomic<bool>& stop, TpacketHandler handler, void* user) {
+  size_t current = 0;
+  struct pollfd pfd;
+  pfd.fd = fd_;
+  pfd.events = POLLIN | POLLERR;
+  while (!stop.load(std::memory_order_relaxed)) {
+    auto* block = reinterpret_cast<struct tpacket_block_desc*>(map_ + current * block_size_);
+    if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+      pfd.revents = 0;
+      // Short poll timeout so stop() is noticed promptly on quiet links.
+      if (poll(&pfd, 1, 100) < 0 && errno != EINTR) return false;
+      continue;
+    }
+
+    // Walk the whole retired block, then hand it back to the kernel.
+    uint32_t num_pkts = block->hdr.bh1.num_pkts;
+    auto* pkt = reinterpret_cast<struct tpacket3_hdr*>(
+        reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+    for (uint32_t i = 0; i < num_pkts; ++i) {
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(pkt) + pkt->tp_mac;
+      auto* next = reinterpret_cast<struct tpacket3_hdr*>(reinterpret_cast<uint8_t*>(pkt) + pkt->tp_next_offset);
+      // Fetch the next frame's descriptor and its link, IP and TCP headers (about the
+      // first three cache lines from it) while this one is decoded, reassembled and parsed.
+      if (i + 1 < num_pkts) {
+        __builtin_prefetch(next);
+        __builtin_prefetch(reinterpret_cast<const uint8_t*>(next) + kCacheLine);
+        __builtin_prefetch(reinterpret_cast<const uint8_t*>(next) + 2 * kCacheLine);
+      }
+      handler(user, data, pkt->tp_snaplen, pkt->tp_sec, pkt->tp_nsec);
+      pkt = next;
+    }
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    current = (current + 1) % block_count_;
+  }
+  return true;
+}
+
+double TpacketRing::fill() const {
+  if (map_ == nullptr || block_count_ == 0) return 0;
+  size_t user = 0;
+  for (size_t i = 0; i < block_count_; ++i) {
+    auto* block = reinterpret_cast<struct tpacket_block_desc*>(map_ + i * block_size_);
+    if (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) ++user;
+  }
+  return static_cast<double>(user) / static_cast<double>(block_count_);
+}
+
+bool TpacketRing::stats(unsigned int* recv, unsigned int* drop) {
+  if (fd_ < 0) return false;
+  // PACKET_STATISTICS resets the kernel counters on every read, so accumulate.
+  struct tpacket_stats_v3 st;
+  socklen_t len = sizeof(st);
+  if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &st, &len) != 0) return false;
+  total_recv_ += st.tp_packets;
+  total_drop_ += st.tp_drops;
+  *recv = total_recv_;
+  *drop = total_drop_;
+  return true;
+}
+
+void TpacketRing::close() {
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+    map_size_ = 0;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+}  // namespace tcp_sniffer
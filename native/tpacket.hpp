@@ -0,0 +1,77 @@
+/**
+ * TCP Sniffer — AF_PACKET TPACKET_V3 ring capture (A1).
+ * Memory-mapped block ring: the kernel fills whole blocks of packets and the capture
+ * thread walks a block per wakeup instead of one syscall/callback per packet.
+ * See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_TPACKET_HPP
+#define TCP_SNIFFER_TPACKET_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct bpf_program;
+
+namespace tcp_sniffer {
+
+/** Ring geometry (from CaptureConfig). */
+struct TpacketConfig {
+  size_t block_size{1024 * 1024};  // bytes; power of two, multiple of the page size
+  size_t block_count{8};
+  unsigned block_timeout_ms{10};  // retire a partially filled block after this long; 0 = kernel default
+  size_t snaplen{65535};
+};
+
+/** Called for every packet in a retired block; data points into the ring at its IP header. */
+using TpacketHandler = void (*)(void* user, const uint8_t* data, size_t caplen, uint32_t ts_sec, uint32_t ts_nsec);
+
+/**
+ * One AF_PACKET socket with a TPACKET_V3 RX ring. Owned and driven by one capture
+ * thread; open() and close() must not race with run().
+ */
+class TpacketRing {
+ public:
+  TpacketRing() = default;
+  ~TpacketRing();
+  TpacketRing(const TpacketRing&) = delete;
+  TpacketRing& operator=(const TpacketRing&) = delete;
+
+  /**
+   * Open the socket, attach filter (may be null, compiled for DLT_RAW), map the ring,
+   * bind to iface ("any" binds to all interfaces) and join fanout group fanout_arg
+   * (0 = none).
+   * Returns false and sets error on failure.
+   */
+  bool open(const std::string& iface, const TpacketConfig& config, const bpf_program* filter,
+            int fanout_arg, std::string* error);
+
+  /** Process blocks until stop becomes true. Returns false on poll error. */
+  bool run(const std::atomic<bool>& stop, TpacketHandler handler, void* user);
+
+  /**
+   * Fraction of blocks filled by the kernel and not yet handed back (0–1): how far
+   * the capture thread is behind. Any thread may call it while the ring is open.
+   */
+  double fill() const;
+
+  /** Packets received / dropped since open (kernel counters, accumulated). */
+  bool stats(unsigned int* recv, unsigned int* drop);
+
+  void close();
+
+ private:
+  int fd_{-1};
+  uint8_t* map_{nullptr};
+  size_t map_size_{0};
+  size_t block_size_{0};
+  size_t block_count_{0};
+  unsigned int total_recv_{0};
+  unsigned int total_drop_{0};
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_TPACKET_HPP
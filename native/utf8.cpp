@@ -0,0 +1,235 @@
+/**
+ * TCP Sniffer — UTF-8 validation implementation.
+ * The AVX2 path is the lookup-table algorithm of Keiser and Lemire ("Validating UTF-8
+ * in less than one instruction per byte", 2021), as used by simdjson and simdutf.
+ */
+
+#include "utf8.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define TCP_SNIFFER_UTF8_X86 1
+#endif
+
+namespace tcp_sniffer {
+
+namespace {
+
+/** Length of the sequence introduced by lead byte c (1 for ASCII and for bytes that cannot lead). */
+inline size_t sequence_length(uint8_t c) {
+  if (c >= 0xf0) return 4;
+  if (c >= 0xe0) return 3;
+  if (c >= 0xc0) return 2;
+  return 1;
+}
+
+inline bool is_continuation(uint8_t c) {
+  return (c & 0xc0) == 0x80;
+}
+
+#ifdef TCP_SNIFFER_UTF8_X86
+
+// Error bits, each set by one of the three nibble lookups; a byte is in error when
+// all three agree.
+constexpr uint8_t kTooShort = 1 << 0;  // lead byte not followed by enough continuations
+constexpr uint8_t kTooLong = 1 << 1;   // continuation after ASCII
+constexpr uint8_t kOverlong3 = 1 << 2;
+constexpr uint8_t kTooLarge = 1 << 3;
+constexpr uint8_t kSurrogate = 1 << 4;
+constexpr uint8_t kOverlong2 = 1 << 5;
+constexpr uint8_t kTooLarge1000 = 1 << 6;
+constexpr uint8_t kOverlong4 = 1 << 6;
+constexpr uint8_t kTwoConts = 1 << 7;  // continuation after continuation (valid only in 3/4-byte sequences)
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+__attribute__((target("avx2"))) inline __m256i lookup16(__m256i index, const uint8_t (&table)[16]) {
+  __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+  return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), index);
+}
+
+__attribute__((target("avx2"))) inline __m256i high_nibbles(__m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+/** input shifted right by N bytes across the 32-byte boundary, pulling in the end of prev. */
+template <int N>
+__attribute__((target("avx2"))) inline __m256i prev_bytes(__m256i input, __m256i prev) {
+  return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2"))) inline __m256i special_cases(__m256i input, __m256i prev1) {
+  static const uint8_t byte1_high[16] = {
+      kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,  // 0xxx ASCII
+      kTwoConts, kTwoConts, kTwoConts, kTwoConts,                                            // 10xx continuation
+      kTooShort | kOverlong2,                                                                // 1100
+      kTooShort,                                                                             // 1101
+      kTooShort | kOverlong3 | kSurrogate,                                                   // 1110
+      kTooShort | kTooLarge | kTooLarge1000 | kOverlong4,                                    // 1111
+  };
+  static const uint8_t byte1_low[16] = {
+      kCarry | kOverlong3 | kOverlong2 | kOverlong4,   // ____0000
+      kCarry | kOverlong2,                           // ____0001
+      kCarry,
+      kCarry,
+      kCarry | kTooLarge,                            // ____0100
+      kCarry | kTooLarge | kTooLarge1000,            // ____0101 and up
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000 | kSurrogate,  // ____1101
+      kCarry | kTooLarge | kTooLarge1000,
+      kCarry | kTooLarge | kTooLarge1000,
+  };
+  static const uint8_t byte2_high[16] = {
+      kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,  // 0xxx
+      kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,           // 1000
+      kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,                            // 1001
+      kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,                            // 101x
+      kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+      kTooShort, kTooShort, kTooShort, kTooShort,                                              // 11xx
+  };
+  __m256i a = lookup16(high_nibbles(prev1), byte1_high);
+  __m256i b = lookup16(_mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)), byte1_low);
+  __m256i c = lookup16(high_nibbles(input), byte2_high);
+  return _mm256_and_si256(_mm256_and_si256(a, b), c);
+}
+
+/** Third and fourth bytes of 3/4-byte sequences: the only places two continuations may follow each other. */
+__attribute__((target("avx2"))) inline __m256i multibyte_lengths(__m256i input, __m256i prev, __m256i special) {
+  __m256i prev2 = prev_bytes<2>(input, prev);
+  __m256i prev3 = prev_bytes<3>(input, prev);
+  __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+  __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+  __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+  return _mm256_xor_si256(must23, special);
+}
+
+__attribute__((target("avx2"))) bool validate_utf8_avx2(const uint8_t* data, size_t len) {
+  // Non-zero in the last three bytes when a block ends inside a sequence.
+  const __m256i incomplete_max = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    if (_mm256_movemask_epi8(input) == 0) {
+      // ASCII block: only an error if the previous block left a sequence open.
+      error = _mm256_or_si256(error, prev_incomplete);
+      prev_incomplete = _mm256_setzero_si256();
+    } else {
+      __m256i special = special_cases(input, prev_bytes<1>(input, prev));
+      error = _mm256_or_si256(error, multibyte_lengths(input, prev, special));
+      prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+    }
+    prev = input;
+    if ((i & 1023) == 992 && !_mm256_testz_si256(error, error)) return false;
+  }
+  if (!_mm256_testz_si256(error, error)) return false;
+  if (i == len) return _mm256_testz_si256(prev_incomplete, prev_incomplete) != 0;
+  // Finish with the scalar loop from the start of the last character the blocks did
+  // not see complete; everything before it has been checked.
+  size_t start = i;
+  for (size_t back = 1; back <= 3 && back <= i; ++back) {
+    if (!is_continuation(data[i - back])) {
+      if (sequence_length(data[i - back]) > back) start = i - back;
+      break;
+    }
+  }
+  return validate_utf8_scalar(data + start, len - start);
+}
+
+using ValidateFn = bool (*)(const uint8_t*, size_t);
+
+ValidateFn select_validate() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? &validate_utf8_avx2 : &validate_utf8_scalar;
+}
+
+#endif  // TCP_SNIFFER_UTF8_X86
+
+}  // namespace
+
+bool validate_utf8_scalar(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    if (i + 8 <= len) {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      if ((word & 0x8080808080808080ull) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+    uint8_t c = data[i];
+    if (c < 0x80) {
+      i += 1;
+      continue;
+    }
+    size_t n = sequence_length(c);
+    if (c < 0xc2 || c > 0xf4 || i + n > len) return false;
+    // Second-byte ranges exclude overlongs (E0, F0), surrogates (ED) and > U+10FFFF (F4).
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xbf;
+    if (c == 0xe0) lo = 0xa0;
+    else if (c == 0xed) hi = 0x9f;
+    else if (c == 0xf0) lo = 0x90;
+    else if (c == 0xf4) hi = 0x8f;
+    if (data[i + 1] < lo || data[i + 1] > hi) return false;
+    for (size_t k = 2; k < n; ++k) {
+      if (!is_continuation(data[i + k])) return false;
+    }
+    i += n;
+  }
+  return true;
+}
+
+bool validate_utf8(const uint8_t* data, size_t len) {
+#ifdef TCP_SNIFFER_UTF8_X86
+  static const ValidateFn validate = select_validate();
+  return validate(data, len);
+#else
+  return validate_utf8_scalar(data, len);
+#endif
+}
+
+void Utf8Validator::update(const uint8_t* data, size_t len) {
+  if (!valid_ || len == 0) return;
+  if (pending_len_ > 0) {
+    size_t take = pending_need_ - pending_len_;
+    if (take > len) take = len;
+    std::memcpy(pending_ + pending_len_, data, take);
+    pending_len_ += take;
+    data += take;
+    len -= take;
+    if (pending_len_ < pending_need_) return;
+    valid_ = validate_utf8_scalar(pending_, pending_len_);
+    pending_len_ = 0;
+    if (!valid_) return;
+  }
+  // Hold back a character cut off by the end of this piece.
+  size_t cut = len;
+  size_t need = 0;
+  for (size_t back = 1; back <= 3 && back <= len; ++back) {
+    uint8_t c = data[len - back];
+    if (is_continuation(c)) continue;
+    need = sequence_length(c);
+    if (need > back) cut = len - back;
+    break;
+  }
+  valid_ = validate_utf8(data, cut);
+  if (valid_ && cut < len) {
+    pending_len_ = len - cut;
+    pending_need_ = need;
+    std::memcpy(pending_, data + cut, pending_len_);
+  }
+}
+
+}  // namespace tcp_sniffer
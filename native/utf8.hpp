@@ -0,0 +1,55 @@
+/**
+ * TCP Sniffer — UTF-8 validation (A3).
+ * Vectorized validator for HTTP bodies, with incremental state so a character split
+ * across segments or chunks is classified correctly. See docs/specs/CPP_ENGINE.md.
+ */
+
+#ifndef TCP_SNIFFER_UTF8_HPP
+#define TCP_SNIFFER_UTF8_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tcp_sniffer {
+
+/**
+ * True when data[0, len) is well-formed UTF-8 (RFC 3629: no overlongs, surrogates or
+ * code points above U+10FFFF) and ends on a character boundary.
+ * Uses AVX2 on x86-64 when the CPU has it (picked at runtime), a scalar loop with an
+ * 8-byte ASCII fast path otherwise.
+ */
+bool validate_utf8(const uint8_t* data, size_t len);
+
+/** Scalar reference for validate_utf8, checked against it and timed by native/bench/http_scan_bench.cpp. */
+bool validate_utf8_scalar(const uint8_t* data, size_t len);
+
+/**
+ * Validates a byte stream fed in pieces. Up to three bytes of a character left
+ * incomplete by one update are held and completed by the next.
+ */
+class Utf8Validator {
+ public:
+  void update(const uint8_t* data, size_t len);
+  void reset() {
+    pending_len_ = 0;
+    pending_need_ = 0;
+    valid_ = true;
+  }
+
+  /** False once an invalid sequence has been seen; later updates are ignored. */
+  bool valid() const { return valid_; }
+  /** Bytes of an incomplete character at the end of the input so far. */
+  size_t pending() const { return pending_len_; }
+  /** Valid so far and ending on a character boundary. */
+  bool complete() const { return valid_ && pending_len_ == 0; }
+
+ private:
+  uint8_t pending_[4]{};
+  size_t pending_len_{0};
+  size_t pending_need_{0};
+  bool valid_{true};
+};
+
+}  // namespace tcp_sniffer
+
+#endif  // TCP_SNIFFER_UTF8_HPP
@@ -0,0 +1,161 @@
+/**
+ * Binary message batch decoding (messageEncoding: 'binary').
+ */
+
+import { describe, it } from 'node:test';
+import assert from 'node:assert/strict';
+import { decodeExchangeBatch, decodeMessageBatch, MESSAGE_BATCH_MAGIC } from './binary-message.js';
+import type { HttpMessage } from './types.js';
+
+/** A record to encode: a message, its capture times and (on responses) a nested request. */
+interface RecordFixture {
+  message: HttpMessage;
+  startUs?: number;
+  endUs?: number;
+  request?: RecordFixture;
+}
+
+const u16 = (v: number): Buffer => {
+  const b = Buffer.alloc(2);
+  b.writeUInt16LE(v);
+  return b;
+};
+const u32 = (v: number): Buffer => {
+  const b = Buffer.alloc(4);
+  b.writeUInt32LE(v);
+  return b;
+};
+const u64 = (v: number): Buffer => {
+  const b = Buffer.alloc(8);
+  b.writeBigUInt64LE(BigInt(v));
+  return b;
+};
+const str = (s = ''): Buffer => {
+  const bytes = Buffer.from(s, 'utf8');
+  return Buffer.concat([u32(bytes.length), bytes]);
+};
+
+/** Mirror of native/message_codec.cpp, for building fixtures. */
+function encodeRecord({ message: m, startUs = m.timestampUs ?? 0, endUs = 0, request }: RecordFixture): Buffer {
+  const headers = Object.entries(m.headers);
+  const flags =
+    (m.direction === 'request' ? 1 : 0) | (m.bodyTruncated ? 2 : 0) | (request ? 4 : 0) | (m.incomplete ? 8 : 0);
+  const record = Buffer.concat([
+    Buffer.from([flags, 0]),
+    u16(m.receiver.port),
+    u16(m.destination.port),
+    u16(m.statusCode ?? 0),
+    u64(startUs),
+    u64(endUs),
+    u64(m.bodyLength ?? 0),
+    str(m.receiver.ip),
+    str(m.destination.ip),
+    str(m.method),
+    str(m.path),
+    str(m.bodyEncoding),
+    str(m.body),
+    ...(request ? [encodeRecord(request)] : []),
+    u32(headers.length),
+    ...headers.flatMap(([k, v]) => [str(k), str(v)]),
+  ]);
+  return Buffer.concat([u32(record.length), record]);
+}
+
+function encodeBatch(records: Array<HttpMessage | RecordFixture>): ArrayBuffer {
+  const parts: Buffer[] = [u32(MESSAGE_BATCH_MAGIC), u32(records.length)];
+  for (const r of records) parts.push(encodeRecord('message' in r ? r : { message: r }));
+  const all = Buffer.concat(parts);
+  return all.buffer.slice(all.byteOffset, all.byteOffset + all.length);
+}
+
+const request: HttpMessage = {
+  receiver: { ip: '10.0.0.1', port: 8080 },
+  destination: { ip: '10.0.0.2', port: 51234 },
+  direction: 'request',
+  method: 'POST',
+  path: '/api/ünïcode',
+  headers: { 'content-type': 'application/json', 'x-trace': 'abc' },
+  timestamp: '2025-01-01T00:00:00.000Z',
+  timestampUs: 1_735_689_600_000_000,
+  body: '{"ok":true}',
+  bodyLength: 11,
+};
+
+const response: HttpMessage = {
+  receiver: { ip: '10.0.0.1', port: 8080 },
+  destination: { ip: '10.0.0.2', port: 51234 },
+  direction: 'response',
+  statusCode: 404,
+  headers: {},
+  timestamp: '2025-01-01T00:00:00.001Z',
+  timestampUs: 1_735_689_600_001_500,
+  bodyLength: 2_000_000,
+  bodyTruncated: true,
+  incomplete: true,
+};
+
+describe('decodeMessageBatch', () => {
+  it('decodes a batch to the same shape as object delivery', () => {
+    const out = decodeMessageBatch(encodeBatch([request, response]));
+    assert.equal(out.length, 2);
+    assert.deepEqual({ ...out[0] }, request);
+    assert.deepEqual({ ...out[1] }, response);
+    assert.equal(JSON.stringify(out[0]), JSON.stringify(request));
+  });
+
+  it('formats timestamp from the capture time only when read', () => {
+    const [msg] = decodeMessageBatch(encodeBatch([response]));
+    assert.equal(typeof Object.getOwnPropertyDescriptor(msg, 'timestamp')?.get, 'function');
+    assert.equal(msg.timestampUs, 1_735_689_600_001_500);
+    assert.equal(msg.timestamp, '2025-01-01T00:00:00.001Z');
+  });
+
+  it('decodes headers lazily and caches them', () => {
+    const [msg] = decodeMessageBatch(encodeBatch([request]));
+    const desc = Object.getOwnPropertyDescriptor(msg, 'headers');
+    assert.equal(typeof desc?.get, 'function');
+    const headers = msg.headers;
+    assert.equal(headers['x-trace'], 'abc');
+    assert.equal(msg.headers, headers);
+    assert.equal(Object.getOwnPropertyDescriptor(msg, 'headers')?.get, undefined);
+  });
+
+  it('allows lazy fields to be overwritten before they are read', () => {
+    const [msg] = decodeMessageBatch(encodeBatch([request]));
+    msg.body = 'replaced';
+    assert.equal(msg.body, 'replaced');
+  });
+
+  it('rejects malformed buffers', () => {
+    assert.throws(() => decodeMessageBatch(new ArrayBuffer(4)), RangeError);
+    const good = encodeBatch([request]);
+    assert.throws(() => decodeMessageBatch(good.slice(0, good.byteLength - 3)), RangeError);
+  });
+});
+
+describe('decodeExchangeBatch', () => {
+  it('pairs a response with its nested request and computes latency', () => {
+    const [exchange, unanswered] = decodeExchangeBatch(
+      encodeBatch([
+        {
+          message: response,
+          endUs: 1_735_689_600_002_000,
+          request: { message: request, endUs: 1_735_689_600_000_100 },
+        },
+        { message: request, endUs: 1_735_689_600_000_200 },
+      ])
+    );
+    assert.deepEqual({ ...exchange.request }, request);
+    assert.deepEqual({ ...exchange.response }, response);
+    assert.deepEqual(exchange.receiver, request.receiver);
+    assert.deepEqual(exchange.timing, {
+      requestStartUs: 1_735_689_600_000_000,
+      requestEndUs: 1_735_689_600_000_100,
+      responseStartUs: 1_735_689_600_001_500,
+      responseEndUs: 1_735_689_600_002_000,
+      latencyUs: 1_400,
+    });
+    assert.equal(unanswered.response, undefined);
+    assert.deepEqual(unanswered.timing, { requestStartUs: 1_735_689_600_000_000, requestEndUs: 1_735_689_600_000_200 });
+  });
+});
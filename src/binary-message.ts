@@ -0,0 +1,211 @@
+/**
+ * Decoder for messageEncoding: 'binary' (docs/specs/TS_CPP_CONTRACT.md §2.1).
+ * The native engine delivers each batch as one ArrayBuffer. Scalar fields are read
+ * up front; headers and body are decoded from the buffer on first access, so
+ * consumers that never touch them never build those strings or objects.
+ */
+
+import type { ExchangeTiming, HttpExchange, HttpMessage } from './types.js';
+
+/** "TSB1" read as a little-endian u32. */
+export const MESSAGE_BATCH_MAGIC = 0x31425354;
+
+const FLAG_REQUEST = 0x01;
+const FLAG_BODY_TRUNCATED = 0x02;
+const FLAG_HAS_REQUEST = 0x04;
+const FLAG_INCOMPLETE = 0x08;
+
+/** One decoded record: the message, its capture times and (on responses) the nested request. */
+interface DecodedRecord {
+  message: HttpMessage;
+  startUs: number;
+  endUs: number;
+  request?: DecodedRecord;
+}
+
+/** Replaces a lazy accessor with a plain data property holding value. */
+function settle<K extends keyof HttpMessage>(target: HttpMessage, key: K, value: HttpMessage[K]): void {
+  Object.defineProperty(target, key, { value, writable: true, enumerable: true, configurable: true });
+}
+
+/**
+ * Own, enumerable accessor that decodes on first read. Being an own enumerable
+ * property, it is picked up by spread and JSON.stringify like any other field.
+ */
+function defineLazy<K extends keyof HttpMessage>(
+  target: HttpMessage,
+  key: K,
+  load: () => HttpMessage[K]
+): void {
+  Object.defineProperty(target, key, {
+    enumerable: true,
+    configurable: true,
+    get(): HttpMessage[K] {
+      const value = load();
+      settle(target, key, value);
+      return value;
+    },
+    set(value: HttpMessage[K]) {
+      settle(target, key, value);
+    },
+  });
+}
+
+class Reader {
+  constructor(
+    private readonly buf: Buffer,
+    public offset: number
+  ) {}
+
+  u8(): number {
+    const v = this.buf.readUInt8(this.offset);
+    this.offset += 1;
+    return v;
+  }
+
+  u16(): number {
+    const v = this.buf.readUInt16LE(this.offset);
+    this.offset += 2;
+    return v;
+  }
+
+  u32(): number {
+    const v = this.buf.readUInt32LE(this.offset);
+    this.offset += 4;
+    return v;
+  }
+
+  /** µs timestamps stay well below 2^53, so a Number holds them exactly. */
+  u64(): number {
+    const low = this.u32();
+    return low + this.u32() * 0x1_0000_0000;
+  }
+
+  /** Skips a string, returning [start, length]. */
+  span(): [number, number] {
+    const len = this.u32();
+    const start = this.offset;
+    this.offset += len;
+    if (this.offset > this.buf.length) throw new RangeError('binary message: string out of bounds');
+    return [start, len];
+  }
+
+  str(): string {
+    const [start, len] = this.span();
+    return len === 0 ? '' : this.buf.toString('utf8', start, start + len);
+  }
+}
+
+function decodeHeaders(buf: Buffer, offset: number): Record<string, string> {
+  const r = new Reader(buf, offset);
+  const count = r.u32();
+  const headers: Record<string, string> = {};
+  for (let i = 0; i < count; i++) {
+    const name = r.str();
+    headers[name] = r.str();
+  }
+  return headers;
+}
+
+function decodeRecord(buf: Buffer, offset: number, end: number): DecodedRecord {
+  const r = new Reader(buf, offset);
+  const flags = r.u8();
+  r.u8();
+  const receiverPort = r.u16();
+  const destinationPort = r.u16();
+  const statusCode = r.u16();
+  const startUs = r.u64();
+  const endUs = r.u64();
+  const bodyLength = r.u64();
+  const receiverIp = r.str();
+  const destinationIp = r.str();
+  const method = r.str();
+  const path = r.str();
+  const bodyEncoding = r.str();
+  const [bodyStart, bodyLen] = r.span();
+  let request: DecodedRecord | undefined;
+  if (flags & FLAG_HAS_REQUEST) {
+    const [nestedStart, nestedLen] = r.span();
+    request = decodeRecord(buf, nestedStart, nestedStart + nestedLen);
+  }
+  const headersAt = r.offset;
+  if (headersAt + 4 > end) throw new RangeError('binary message: record truncated');
+
+  const msg = {
+    receiver: { ip: receiverIp, port: receiverPort },
+    destination: { ip: destinationIp, port: destinationPort },
+    direction: flags & FLAG_REQUEST ? 'request' : 'response',
+  } as HttpMessage;
+  if (method !== '') msg.method = method;
+  if (path !== '') msg.path = path;
+  if (statusCode !== 0) msg.statusCode = statusCode;
+  defineLazy(msg, 'headers', () => decodeHeaders(buf, headersAt));
+  defineLazy(msg, 'timestamp', () => new Date(Math.floor(startUs / 1000)).toISOString());
+  msg.timestampUs = startUs;
+  if (bodyLen > 0) {
+    defineLazy(msg, 'body', () => buf.toString('utf8', bodyStart, bodyStart + bodyLen));
+  }
+  if (bodyLength !== 0) msg.bodyLength = bodyLength;
+  if (flags & FLAG_BODY_TRUNCATED) msg.bodyTruncated = true;
+  if (bodyEncoding !== '') msg.bodyEncoding = bodyEncoding;
+  if (flags & FLAG_INCOMPLETE) msg.incomplete = true;
+  return { message: msg, startUs, endUs, request };
+}
+
+function toExchange(record: DecodedRecord): HttpExchange {
+  const { receiver, destination } = record.message;
+  const request = record.message.direction === 'request' ? record : record.request;
+  const response = record.message.direction === 'response' ? record : undefined;
+  const timing: ExchangeTiming = {};
+  const exchange: HttpExchange = { receiver, destination, timing };
+  if (request) {
+    exchange.request = request.message;
+    timing.requestStartUs = request.startUs;
+    timing.requestEndUs = request.endUs;
+  }
+  if (response) {
+    exchange.response = response.message;
+    timing.responseStartUs = response.startUs;
+    timing.responseEndUs = response.endUs;
+  }
+  if (request && response) timing.latencyUs = response.startUs - request.endUs;
+  return exchange;
+}
+
+function decodeRecords(buffer: ArrayBuffer): DecodedRecord[] {
+  const buf = Buffer.from(buffer); // a view, not a copy
+  if (buf.length < 8 || buf.readUInt32LE(0) !== MESSAGE_BATCH_MAGIC) {
+    throw new RangeError('binary message: bad batch header');
+  }
+  const count = buf.readUInt32LE(4);
+  const records: DecodedRecord[] = [];
+  let offset = 8;
+  for (let i = 0; i < count; i++) {
+    if (offset + 4 > buf.length) throw new RangeError('binary message: batch truncated');
+    const len = buf.readUInt32LE(offset);
+    const start = offset + 4;
+    const end = start + len;
+    if (end > buf.length) throw new RangeError('binary message: batch truncated');
+    records.push(decodeRecord(buf, start, end));
+    offset = end;
+  }
+  return records;
+}
+
+/**
+ * Decodes one native message batch. Returned messages keep a reference to buffer
+ * until their headers and body have been read.
+ * @throws RangeError when the buffer is not a well-formed batch.
+ */
+export function decodeMessageBatch(buffer: ArrayBuffer): HttpMessage[] {
+  return decodeRecords(buffer).map((record) => record.message);
+}
+
+/**
+ * Decodes one native batch of exchange records (correlateExchanges): each record is
+ * a response with its request nested, or an unpaired request or response.
+ * @throws RangeError when the buffer is not a well-formed batch.
+ */
+export function decodeExchangeBatch(buffer: ArrayBuffer): HttpExchange[] {
+  return decodeRecords(buffer).map(toExchange);
+}
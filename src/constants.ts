@@ -10,13 +10,66 @@ export const EXIT_RUNTIME = 2;
 export const CONTRACT_DEFAULTS = {
   sampleRate: 1,
   maxBodySize: 1_048_576,
+  captureBody: 'full',
   maxConcurrentConnections: 10_000,
   connectionIdleTimeoutMs: 300_000,
+  maxOutOfOrderBytes: 262_144,
+  gapPolicy: 'skip',
+  gapTimeoutMs: 1000,
+  workerThreads: 1,
+  captureBackend: 'pcap',
+  ringBlockSize: 1_048_576,
+  ringBlockCount: 8,
+  ringBlockTimeoutMs: 10,
+  snaplen: 65_535,
+  kernelPrefilter: false,
+  messageBatchSize: 256,
+  messageBatchLatencyMs: 10,
+  messageQueueCapacity: 8192,
+  backpressurePolicy: 'drop',
+  loadShedding: false,
+  nativeStdout: false,
+  messageEncoding: 'object',
+  /** Applies when onHttpExchange is not set; with it, correlation defaults on. */
+  correlateExchanges: false,
+  redactHeaders: ['authorization', 'cookie'],
+  /** Empty keeps every header. */
+  includeHeaders: [],
   /** Empty string means C++ uses implementation default (e.g. first non-loopback). */
   interface: '',
+  /** Empty string means live capture on interface. */
+  pcapFile: '',
+} as const;
+
+/** Defaults for outputUrl delivery (TS only; not passed to the engine). */
+export const OUTPUT_DEFAULTS = {
+  outputBatchSize: 1,
+  outputBatchBytes: 1_048_576,
+  outputBatchLatencyMs: 100,
+  outputCompression: 'none',
+  outputMaxInFlight: 4,
+  outputMaxQueuedBatches: 64,
 } as const;
 
 export const MIN_PORT = 1;
 export const MAX_PORT = 65_535;
 export const MIN_SAMPLE_RATE = 0;
 export const MAX_SAMPLE_RATE = 1;
+/** Upper bound for workerThreads (sockets in one PACKET_FANOUT group). */
+export const MAX_WORKER_THREADS = 64;
+/** Accepted values for captureBackend. */
+export const CAPTURE_BACKENDS = ['pcap', 'tpacket'] as const;
+/** Smallest ring block (one page); ringBlockSize must also be a power of two. */
+export const MIN_RING_BLOCK_SIZE = 4096;
+export const MIN_SNAPLEN = 96;
+export const MAX_SNAPLEN = 262_144;
+/** Accepted captureBody values: 'none', 'full', or 'head:' followed by a positive byte count. */
+export const CAPTURE_BODY_PATTERN = /^(none|full|head:[1-9]\d*)$/;
+/** Accepted values for gapPolicy. */
+export const GAP_POLICIES = ['skip', 'wait'] as const;
+/** Accepted values for backpressurePolicy. */
+export const BACKPRESSURE_POLICIES = ['drop', 'block'] as const;
+/** Accepted values for messageEncoding. */
+export const MESSAGE_ENCODINGS = ['object', 'binary'] as const;
+/** Accepted values for outputCompression. */
+export const OUTPUT_COMPRESSIONS = ['none', 'gzip', 'zstd'] as const;
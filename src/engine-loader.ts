@@ -6,10 +6,14 @@
 import { createRequire } from 'module';
 import path from 'path';
 import { fileURLToPath } from 'url';
-import type { Engine, CaptureStats } from './engine.js';
+import type { Engine, EngineCallbacks, CaptureStats } from './engine.js';
+import { decodeExchangeBatch, decodeMessageBatch } from './binary-message.js';
 import { createMockEngine } from './engine-mock.js';
 import { logInfo, logWarn } from './logger.js';
-import type { EngineConfig, EngineError, HttpMessage } from './types.js';
+import type { EngineConfig, EngineError, EngineStats, HttpExchange, HttpMessage } from './types.js';
+
+/** What one native flush delivers: messages, exchange records (correlateExchanges) or a binary batch. */
+type NativeBatch = HttpMessage[] | HttpExchange[] | ArrayBuffer;
 
 const __dirname = path.dirname(fileURLToPath(import.meta.url));
 
@@ -20,24 +24,44 @@ function getAddonPath(): string {
 }
 
 /**
- * Wraps the raw addon (start(config, onMessage?), stop(), getLastError()) into the Engine interface.
+ * Wraps the raw addon (start(config, onBatch?), stop(), getLastError()) into the Engine interface.
+ * The addon delivers messages in batches: one array per native flush, or one ArrayBuffer
+ * with messageEncoding 'binary' (decoded lazily, see binary-message.ts). With
+ * correlateExchanges the elements are HttpExchange records. With pcapFile, the addon calls
+ * onEnd after the last batch of the file; start() resolves then (or when stop() ends it early).
  */
 function wrapNativeAddon(addon: {
-  start: (config: unknown, onMessage?: (msg: HttpMessage) => void) => boolean;
+  start: (config: unknown, onBatch?: (batch: NativeBatch) => void, onEnd?: () => void) => boolean;
   stop: () => Record<string, unknown> | void;
   getLastError: () => { code: string; message: string };
+  getStats?: () => EngineStats | undefined;
 }): Engine {
+  let endReplay: (() => void) | undefined;
+
   return {
-    async start(config: EngineConfig, callbacks: { onMessage: (msg: HttpMessage) => void; onError: (err: EngineError) => void }): Promise<void> {
+    filtersHeaders: true,
+    writesStdout: true,
+
+    async start(config: EngineConfig, callbacks: EngineCallbacks): Promise<void> {
       try {
-        const onMessage = (msg: HttpMessage): void => callbacks.onMessage(msg);
-        const ok = addon.start(config, onMessage);
+        const onBatch = (batch: NativeBatch): void => {
+          if (config.correlateExchanges) {
+            const exchanges = batch instanceof ArrayBuffer ? decodeExchangeBatch(batch) : (batch as HttpExchange[]);
+            for (const exchange of exchanges) callbacks.onExchange?.(exchange);
+            return;
+          }
+          const msgs = batch instanceof ArrayBuffer ? decodeMessageBatch(batch) : (batch as HttpMessage[]);
+          for (const msg of msgs) callbacks.onMessage(msg);
+        };
+        const replayed = config.pcapFile !== '' ? new Promise<void>((resolve) => (endReplay = resolve)) : undefined;
+        const ok = addon.start(config, onBatch, endReplay);
         if (!ok) {
           const err = addon.getLastError();
           const engineError: EngineError = { code: err?.code ?? 'UNRECOVERABLE', message: err?.message ?? 'Unknown error' };
           callbacks.onError(engineError);
           throw new Error(engineError.message);
         }
+        await replayed;
       } catch (e) {
         const message = e instanceof Error ? e.message : String(e);
         const code = (e as { code?: string })?.code ?? 'UNRECOVERABLE';
@@ -48,15 +72,28 @@ function wrapNativeAddon(addon: {
 
     async stop(): Promise<CaptureStats | void> {
       const result = addon.stop();
-      if (result && typeof result === 'object' && (typeof result.packetsReceived === 'number' || typeof result.packetsDropped === 'number')) {
+      endReplay?.();
+      endReplay = undefined;
+      if (
+        result &&
+        typeof result === 'object' &&
+        (typeof result.packetsReceived === 'number' ||
+          typeof result.packetsDropped === 'number' ||
+          typeof result.messagesDropped === 'number')
+      ) {
         return {
           packetsReceived: typeof result.packetsReceived === 'number' ? result.packetsReceived : undefined,
           packetsDropped: typeof result.packetsDropped === 'number' ? result.packetsDropped : undefined,
           packetsIfDropped: typeof result.packetsIfDropped === 'number' ? result.packetsIfDropped : undefined,
+          messagesDropped: typeof result.messagesDropped === 'number' ? result.messagesDropped : undefined,
         };
       }
       return undefined;
     },
+
+    getStats(): EngineStats | undefined {
+      return addon.getStats?.();
+    },
   };
 }
 
@@ -69,9 +106,10 @@ function loadNativeEngine(): Engine | null {
     const require = createRequire(import.meta.url);
     const addonPath = getAddonPath();
     const addon = require(addonPath) as {
-      start: (config: unknown, onMessage?: (msg: HttpMessage) => void) => boolean;
+      start: (config: unknown, onBatch?: (batch: NativeBatch) => void, onEnd?: () => void) => boolean;
       stop: () => Record<string, unknown> | void;
       getLastError: () => { code: string; message: string };
+      getStats?: () => EngineStats | undefined;
     };
     if (typeof addon?.start !== 'function' || typeof addon?.stop !== 'function') {
       logWarn('Native addon missing start/stop; using mock engine');
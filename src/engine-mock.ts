@@ -4,7 +4,7 @@
  */
 
 import type { Engine, EngineCallbacks } from './engine.js';
-import type { EngineConfig, HttpMessage } from './types.js';
+import type { EngineConfig, EngineStats, HttpMessage, LatencyHistogram } from './types.js';
 
 const FIXTURE_REQUEST: HttpMessage = {
   receiver: { ip: '10.0.0.1', port: 8080 },
@@ -27,32 +27,65 @@ const FIXTURE_RESPONSE: HttpMessage = {
   timestamp: new Date().toISOString(),
 };
 
+/** Copy of a fixture captured at unixUs (µs since the epoch). */
+function stamped(msg: HttpMessage, unixUs: number): HttpMessage {
+  return { ...msg, timestamp: new Date(Math.floor(unixUs / 1000)).toISOString(), timestampUs: unixUs };
+}
+
+function emptyHistogram(): LatencyHistogram {
+  return { count: 0, sum: 0, max: 0, p50: 0, p90: 0, p99: 0, p999: 0, buckets: [] };
+}
+
 function delayMs(ms: number): Promise<void> {
   return new Promise((resolve) => setTimeout(resolve, ms));
 }
 
 /**
  * Mock engine: on start, emits a few fixture messages after a short delay, then idles.
- * stop() resolves immediately (no in-flight messages to drain).
+ * With correlateExchanges it emits the same pair as one exchange instead.
+ * stop() resolves immediately (no in-flight messages to drain). getStats() counts the
+ * fixtures as parsed messages; everything else is zero.
  */
 export function createMockEngine(): Engine {
   let callbacks: EngineCallbacks | null = null;
   let running = false;
+  let messagesParsed = 0;
 
   return {
-    async start(_config: EngineConfig, cbs: EngineCallbacks): Promise<void> {
+    async start(config: EngineConfig, cbs: EngineCallbacks): Promise<void> {
       if (running) {
         throw new Error('Engine already started');
       }
       callbacks = cbs;
       running = true;
+      messagesParsed = 0;
       // Emit fixture messages after a brief delay so start() can resolve first
       await delayMs(10);
       if (!running || !callbacks) return;
-      callbacks.onMessage({ ...FIXTURE_REQUEST, timestamp: new Date().toISOString() });
+      if (config.correlateExchanges) {
+        messagesParsed += 2;
+        const nowUs = Date.now() * 1000;
+        callbacks.onExchange?.({
+          receiver: FIXTURE_REQUEST.receiver,
+          destination: FIXTURE_REQUEST.destination,
+          request: stamped(FIXTURE_REQUEST, nowUs),
+          response: stamped(FIXTURE_RESPONSE, nowUs + 5000),
+          timing: {
+            requestStartUs: nowUs,
+            requestEndUs: nowUs,
+            responseStartUs: nowUs + 5000,
+            responseEndUs: nowUs + 5000,
+            latencyUs: 5000,
+          },
+        });
+        return;
+      }
+      messagesParsed++;
+      callbacks.onMessage(stamped(FIXTURE_REQUEST, Date.now() * 1000));
       await delayMs(5);
       if (!running || !callbacks) return;
-      callbacks.onMessage({ ...FIXTURE_RESPONSE, timestamp: new Date().toISOString() });
+      messagesParsed++;
+      callbacks.onMessage(stamped(FIXTURE_RESPONSE, Date.now() * 1000));
     },
 
     async stop(): Promise<void> {
@@ -60,5 +93,35 @@ export function createMockEngine(): Engine {
       callbacks = null;
       await delayMs(0);
     },
+
+    getStats(): EngineStats {
+      return {
+        packetsDecoded: 0,
+        packetsRejected: 0,
+        segments: 0,
+        bytesReassembled: 0,
+        outOfOrderBytes: 0,
+        outOfOrderDrops: 0,
+        gaps: 0,
+        gapsSkipped: 0,
+        gapBytesSkipped: 0,
+        evictionsIdle: 0,
+        evictionsCap: 0,
+        closesFin: 0,
+        closesRst: 0,
+        connections: 0,
+        messagesParsed,
+        queueDepth: 0,
+        batchesInFlight: 0,
+        messagesDropped: 0,
+        segmentsShed: 0,
+        connectionsIgnored: 0,
+        segmentsIgnored: 0,
+        headersTooLarge: 0,
+        segmentNs: emptyHistogram(),
+        captureToParseUs: emptyHistogram(),
+        captureToDeliveryUs: emptyHistogram(),
+      };
+    },
   };
 }
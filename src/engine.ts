@@ -3,10 +3,12 @@
  * Real implementation will be N-API addon or subprocess; this module defines the interface.
  */
 
-import type { EngineConfig, EngineError, HttpMessage } from './types.js';
+import type { EngineConfig, EngineError, EngineStats, HttpExchange, HttpMessage } from './types.js';
 
 export interface EngineCallbacks {
   onMessage: (msg: HttpMessage) => void;
+  /** Receives exchange records instead of onMessage when config.correlateExchanges is set. */
+  onExchange?: (exchange: HttpExchange) => void;
   onError: (err: EngineError) => void;
 }
 
@@ -15,14 +17,26 @@ export interface CaptureStats {
   packetsReceived?: number;
   packetsDropped?: number;
   packetsIfDropped?: number;
+  /** Messages dropped by the native message queue under backpressure ('drop' policy). */
+  messagesDropped?: number;
 }
 
 /**
  * Engine interface: start (with config and callbacks), stop (drain then close).
  * C++ addon or subprocess implements this; mock implements it for B2.
  * stop() may return capture stats when the native engine provides them.
+ * With config.pcapFile, start() resolves once the file is read and its messages delivered.
  */
 export interface Engine {
+  /**
+   * True when the engine applies config.redactHeaders and config.includeHeaders itself
+   * (the native addon does so while parsing), so output skips its own pass.
+   */
+  readonly filtersHeaders?: boolean;
+  /** True when the engine writes config.nativeStdout output itself, so output skips stdout. */
+  readonly writesStdout?: boolean;
   start(config: EngineConfig, callbacks: EngineCallbacks): Promise<void>;
   stop(): Promise<CaptureStats | void>;
+  /** Live counters and latency histograms; synchronous and cheap enough to poll. */
+  getStats?(): EngineStats | undefined;
 }
@@ -27,6 +27,8 @@ function configFromEnv(): SnifferConfig {
     interface: process.env.INTERFACE !== undefined && process.env.INTERFACE !== '' ? process.env.INTERFACE : undefined,
     outputUrl: process.env.OUTPUT_URL !== undefined && process.env.OUTPUT_URL !== '' ? process.env.OUTPUT_URL : undefined,
     outputStdout: process.env.OUTPUT_STDOUT === 'true' || process.env.OUTPUT_STDOUT === '1',
+    nativeStdout: process.env.NATIVE_STDOUT === 'true' || process.env.NATIVE_STDOUT === '1',
+    pcapFile: process.env.PCAP_FILE !== undefined && process.env.PCAP_FILE !== '' ? process.env.PCAP_FILE : undefined,
   };
   return config;
 }
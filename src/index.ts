@@ -7,22 +7,45 @@ export { createSniffer } from './sniffer.js';
 export type { Sniffer } from './sniffer.js';
 
 export {
+  BACKPRESSURE_POLICIES,
+  CAPTURE_BACKENDS,
+  CAPTURE_BODY_PATTERN,
   CONTRACT_DEFAULTS,
+  GAP_POLICIES,
   MAX_PORT,
   MAX_SAMPLE_RATE,
+  MAX_WORKER_THREADS,
+  MESSAGE_ENCODINGS,
   MIN_PORT,
   MIN_SAMPLE_RATE,
+  OUTPUT_COMPRESSIONS,
+  OUTPUT_DEFAULTS,
 } from './constants.js';
 
 export type {
+  BackpressurePolicy,
+  CaptureBackend,
+  CaptureBodyMode,
   EngineConfig,
+  EngineStats,
   Endpoint,
   EngineError,
   EngineErrorCode,
+  ExchangeTiming,
+  GapPolicy,
   HttpDirection,
+  HttpExchange,
   HttpMessage,
+  LatencyHistogram,
+  LoadShedLevel,
+  LoadSheddingStats,
+  MessageEncoding,
+  OutputCompression,
+  OutputUrlStats,
   SnifferConfig,
 } from './types.js';
 export { ENGINE_ERROR_CODES } from './types.js';
 
+export { decodeExchangeBatch, decodeMessageBatch, MESSAGE_BATCH_MAGIC } from './binary-message.js';
+
 export { hasOutputConfigured, validateConfig, ValidationError } from './validation.js';
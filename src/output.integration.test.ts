@@ -7,6 +7,7 @@ import { describe, it, mock, beforeEach, afterEach } from 'node:test';
 import assert from 'node:assert/strict';
 import { deliverMessage } from './output.js';
 import type { HttpMessage } from './types.js';
+import { UrlBatcher } from './url-batcher.js';
 
 const fixtureMessage: HttpMessage = {
   receiver: { ip: '10.0.0.1', port: 8080 },
@@ -113,7 +114,7 @@ describe('Output pipeline integration', () => {
         const u = typeof url === 'string' ? url : url.toString();
         fetchCalls.push({
           url: u,
-          body: (init?.body as string) ?? '',
+          body: init?.body === undefined ? '' : String(init.body),
           method: init?.method ?? 'GET',
         });
         return new Response('', { status: 200 });
@@ -125,10 +126,7 @@ describe('Output pipeline integration', () => {
     });
 
     it('POSTs message body as JSON to outputUrl with correct shape', async () => {
-      deliverMessage(
-        { outputUrl: 'https://example.com/ingest' },
-        fixtureMessage
-      );
+      deliverMessage({ urlBatcher: new UrlBatcher({ outputUrl: 'https://example.com/ingest' }) }, fixtureMessage);
       await new Promise((r) => setTimeout(r, 50));
       assert.equal(fetchCalls.length, 1);
       assert.equal(fetchCalls[0].method, 'POST');
@@ -143,14 +141,11 @@ describe('Output pipeline integration', () => {
       globalThis.fetch = (async (url: string | URL, init?: RequestInit) => {
         attempt += 1;
         const u = typeof url === 'string' ? url : url.toString();
-        fetchCalls.push({ url: u, body: (init?.body as string) ?? '', method: init?.method ?? 'GET' });
+        fetchCalls.push({ url: u, body: init?.body === undefined ? '' : String(init.body), method: init?.method ?? 'GET' });
         return new Response('', { status: attempt < 3 ? 500 : 200 });
       }) as typeof fetch;
 
-      deliverMessage(
-        { outputUrl: 'https://example.com/ingest' },
-        fixtureMessage
-      );
+      deliverMessage({ urlBatcher: new UrlBatcher({ outputUrl: 'https://example.com/ingest' }) }, fixtureMessage);
       // Retry delays are 1s, 2s, 4s; wait for all retries
       await new Promise((r) => setTimeout(r, 7500));
       assert.equal(fetchCalls.length, 3, 'fetch should be called 3 times (500, 500, 200)');
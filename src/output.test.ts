@@ -6,10 +6,11 @@ import { describe, it, mock } from 'node:test';
 import assert from 'node:assert/strict';
 import {
   redactSensitiveHeaders,
+  deliverExchange,
   deliverMessage,
   DEFAULT_REDACT_HEADERS,
 } from './output.js';
-import type { HttpMessage } from './types.js';
+import type { HttpExchange, HttpMessage } from './types.js';
 
 const fixtureMessage: HttpMessage = {
   receiver: { ip: '10.0.0.1', port: 8080 },
@@ -54,6 +55,11 @@ describe('redactSensitiveHeaders', () => {
     assert.notEqual(out.headers, fixtureMessage.headers);
   });
 
+  it('keeps only includeHeaders names, still redacting among them', () => {
+    const out = redactSensitiveHeaders(fixtureMessage, ['cookie'], ['Content-Type', 'cookie']);
+    assert.deepEqual(out.headers, { 'content-type': 'application/json', cookie: '[REDACTED]' });
+  });
+
   it('leaves other fields unchanged', () => {
     const out = redactSensitiveHeaders(fixtureMessage, ['authorization']);
     assert.equal(out.receiver.ip, fixtureMessage.receiver.ip);
@@ -85,6 +91,12 @@ describe('deliverMessage with redaction', () => {
     assert.equal(delivered.headers['cookie'], 'session=abc123');
   });
 
+  it('delivers the message as is when there is nothing to filter', () => {
+    const onHttpMessage = mock.fn();
+    deliverMessage({ onHttpMessage, redactHeaders: [], includeHeaders: [] }, fixtureMessage);
+    assert.equal(onHttpMessage.mock.calls[0].arguments[0], fixtureMessage);
+  });
+
   it('delivers message redacting only custom header names', () => {
     const onHttpMessage = mock.fn();
     deliverMessage(
@@ -97,3 +109,33 @@ describe('deliverMessage with redaction', () => {
     assert.equal(delivered.headers['x-custom'], '[REDACTED]');
   });
 });
+
+describe('deliverExchange', () => {
+  const exchange: HttpExchange = {
+    receiver: fixtureMessage.receiver,
+    destination: fixtureMessage.destination,
+    request: fixtureMessage,
+    response: {
+      ...fixtureMessage,
+      direction: 'response',
+      method: undefined,
+      path: undefined,
+      statusCode: 200,
+      headers: { 'set-cookie': 'a=b', cookie: 'c=d' },
+    },
+    timing: { requestStartUs: 1, requestEndUs: 2, responseStartUs: 10, responseEndUs: 12, latencyUs: 8 },
+  };
+
+  it('redacts both sides and delivers the exchange and its messages in order', () => {
+    const onHttpExchange = mock.fn();
+    const onHttpMessage = mock.fn();
+    deliverExchange({ onHttpExchange, onHttpMessage }, exchange);
+    assert.equal(onHttpExchange.mock.calls.length, 1);
+    const delivered = onHttpExchange.mock.calls[0].arguments[0] as HttpExchange;
+    assert.equal(delivered.request?.headers['authorization'], '[REDACTED]');
+    assert.equal(delivered.response?.headers['cookie'], '[REDACTED]');
+    assert.deepEqual(delivered.timing, exchange.timing);
+    const directions = onHttpMessage.mock.calls.map((c) => (c.arguments[0] as HttpMessage).direction);
+    assert.deepEqual(directions, ['request', 'response']);
+  });
+});
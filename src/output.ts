@@ -1,44 +1,78 @@
 /**
- * Output pipeline per TS_API_AND_LIFECYCLE and B3: callback, outputUrl (retries), stdout JSON.
- * Callback errors are caught and logged; POST retries 3x with exponential backoff.
+ * Output pipeline per TS_API_AND_LIFECYCLE and B3: callback, outputUrl, stdout JSON.
+ * Callback errors are caught and logged. outputUrl records go through the UrlBatcher
+ * (url-batcher.ts), which owns batching, retries and the Bearer token.
  */
 
+import { CONTRACT_DEFAULTS } from './constants.js';
 import { logError } from './logger.js';
-import type { HttpMessage } from './types.js';
-
-const RETRY_DELAYS_MS = [1000, 2000, 4000];
-const OUTPUT_URL_AUTH_TOKEN = 'OUTPUT_URL_AUTH_TOKEN';
+import type { HttpExchange, HttpMessage } from './types.js';
+import type { UrlBatcher } from './url-batcher.js';
 
 /** Default headers to redact when redactHeaders is not set (authorization, cookie). */
-export const DEFAULT_REDACT_HEADERS = ['authorization', 'cookie'];
+export const DEFAULT_REDACT_HEADERS: string[] = [...CONTRACT_DEFAULTS.redactHeaders];
 
 export interface OutputConfig {
   onHttpMessage?: (msg: HttpMessage) => void;
-  outputUrl?: string;
+  onHttpExchange?: (exchange: HttpExchange) => void;
   outputStdout?: boolean;
   /** Header names to redact (case-insensitive). Default: authorization, cookie. Use [] to disable. */
   redactHeaders?: string[];
+  /** Header names to keep (case-insensitive); others are dropped. Default: all. */
+  includeHeaders?: string[];
+  /** outputUrl delivery (batched, bounded, retried); records are only POSTed through it. */
+  urlBatcher?: UrlBatcher;
 }
 
 /**
- * Returns a copy of the message with sensitive header values replaced by '[REDACTED]'.
+ * Returns a copy of the message with sensitive header values replaced by '[REDACTED]'
+ * and, when headerNamesToInclude is non-empty, only the listed headers kept.
  * Matches header names case-insensitively.
  */
 export function redactSensitiveHeaders(
   msg: HttpMessage,
-  headerNamesToRedact: string[]
+  headerNamesToRedact: string[],
+  headerNamesToInclude: string[] = []
 ): HttpMessage {
-  if (headerNamesToRedact.length === 0) {
+  if (headerNamesToRedact.length === 0 && headerNamesToInclude.length === 0) {
     return { ...msg, headers: { ...msg.headers } };
   }
   const lowerNames = new Set(headerNamesToRedact.map((h) => h.toLowerCase()));
+  const included = new Set(headerNamesToInclude.map((h) => h.toLowerCase()));
   const headers: Record<string, string> = {};
   for (const [k, v] of Object.entries(msg.headers)) {
-    headers[k] = lowerNames.has(k.toLowerCase()) ? '[REDACTED]' : v;
+    const name = k.toLowerCase();
+    if (included.size > 0 && !included.has(name)) continue;
+    headers[k] = lowerNames.has(name) ? '[REDACTED]' : v;
   }
   return { ...msg, headers };
 }
 
+/** Redacts both sides of an exchange (see redactSensitiveHeaders). */
+export function redactExchange(
+  exchange: HttpExchange,
+  headerNamesToRedact: string[],
+  headerNamesToInclude: string[] = []
+): HttpExchange {
+  const redacted: HttpExchange = { ...exchange };
+  if (exchange.request) {
+    redacted.request = redactSensitiveHeaders(exchange.request, headerNamesToRedact, headerNamesToInclude);
+  }
+  if (exchange.response) {
+    redacted.response = redactSensitiveHeaders(exchange.response, headerNamesToRedact, headerNamesToInclude);
+  }
+  return redacted;
+}
+
+function redactNames(config: OutputConfig): string[] {
+  return config.redactHeaders !== undefined ? config.redactHeaders : DEFAULT_REDACT_HEADERS;
+}
+
+/** False when there is nothing to redact or drop, so messages are delivered as they are. */
+function filtersHeaders(config: OutputConfig): boolean {
+  return redactNames(config).length > 0 || (config.includeHeaders?.length ?? 0) > 0;
+}
+
 /**
  * Invoke user callback; log and swallow errors so one bad callback doesn't kill the process.
  */
@@ -52,45 +86,21 @@ export function emitCallback(config: OutputConfig, msg: HttpMessage): void {
   }
 }
 
-/**
- * POST message to outputUrl. Retries up to 3 times with exponential backoff (1s, 2s, 4s).
- * On final failure: log and drop. Optional Bearer token from OUTPUT_URL_AUTH_TOKEN.
- */
-export async function postToUrl(config: OutputConfig, msg: HttpMessage): Promise<void> {
-  const url = config.outputUrl;
-  if (!url || url === '') return;
-
-  const body = JSON.stringify(msg);
-  const token = process.env[OUTPUT_URL_AUTH_TOKEN];
-  const headers: Record<string, string> = {
-    'Content-Type': 'application/json',
-    ...(token && { Authorization: `Bearer ${token}` }),
-  };
-
-  let lastErr: Error | undefined;
-  for (let i = 0; i <= RETRY_DELAYS_MS.length; i++) {
-    try {
-      const res = await fetch(url, {
-        method: 'POST',
-        headers,
-        body,
-      });
-      if (res.ok) return;
-      lastErr = new Error(`POST ${url} returned ${res.status} ${res.statusText}`);
-    } catch (e) {
-      lastErr = e instanceof Error ? e : new Error(String(e));
-    }
-    if (i < RETRY_DELAYS_MS.length) {
-      await new Promise((r) => setTimeout(r, RETRY_DELAYS_MS[i]));
-    }
+/** Invoke onHttpExchange; errors are logged and swallowed like emitCallback. */
+export function emitExchangeCallback(config: OutputConfig, exchange: HttpExchange): void {
+  if (typeof config.onHttpExchange !== 'function') return;
+  try {
+    config.onHttpExchange(exchange);
+  } catch (err) {
+    const message = err instanceof Error ? err.message : String(err);
+    logError('onHttpExchange callback threw', { error: message });
   }
-  logError('outputUrl POST failed after retries', { url, error: lastErr?.message });
 }
 
 /**
  * Write one JSON line to stdout (line-buffered). No trailing newline added if body already has one.
  */
-export function writeStdout(config: OutputConfig, msg: HttpMessage): void {
+export function writeStdout(config: OutputConfig, msg: HttpMessage | HttpExchange): void {
   if (config.outputStdout !== true) return;
   const line = JSON.stringify(msg) + '\n';
   process.stdout.write(line);
@@ -98,19 +108,28 @@ export function writeStdout(config: OutputConfig, msg: HttpMessage): void {
 
 /**
  * Deliver one message to all configured outputs: callback, outputUrl, stdout.
- * Sensitive headers are redacted before any output. Callback is synchronous; POST is fire-and-forget.
+ * Sensitive headers are redacted before any output. Callback is synchronous; POSTs are queued on the batcher.
  */
 export function deliverMessage(config: OutputConfig, msg: HttpMessage): void {
-  const namesToRedact =
-    config.redactHeaders !== undefined
-      ? config.redactHeaders
-      : DEFAULT_REDACT_HEADERS;
-  const redacted = redactSensitiveHeaders(msg, namesToRedact);
+  const redacted = filtersHeaders(config)
+    ? redactSensitiveHeaders(msg, redactNames(config), config.includeHeaders)
+    : msg;
   emitCallback(config, redacted);
   writeStdout(config, redacted);
-  if (config.outputUrl) {
-    postToUrl(config, redacted).catch(() => {
-      /* already logged in postToUrl */
-    });
-  }
+  config.urlBatcher?.add(redacted);
+}
+
+/**
+ * Deliver one exchange (correlateExchanges): onHttpMessage gets its request and then
+ * its response, onHttpExchange and the stdout/outputUrl outputs get the exchange record.
+ */
+export function deliverExchange(config: OutputConfig, exchange: HttpExchange): void {
+  const redacted = filtersHeaders(config)
+    ? redactExchange(exchange, redactNames(config), config.includeHeaders)
+    : exchange;
+  if (redacted.request) emitCallback(config, redacted.request);
+  if (redacted.response) emitCallback(config, redacted.response);
+  emitExchangeCallback(config, redacted);
+  writeStdout(config, redacted);
+  config.urlBatcher?.add(redacted);
 }
@@ -0,0 +1,352 @@
+/**
+ * Native pcapFile replay: writes small capture files and runs them through the built
+ * addon. Skipped when the addon is not built (the rest of the suite runs on the mock).
+ */
+
+import { describe, it } from 'node:test';
+import assert from 'node:assert/strict';
+import { spawnSync } from 'node:child_process';
+import { existsSync, mkdtempSync, rmSync, writeFileSync } from 'node:fs';
+import { createRequire } from 'node:module';
+import os from 'node:os';
+import path from 'node:path';
+import { fileURLToPath } from 'node:url';
+import { validateConfig } from './validation.js';
+import type { HttpExchange, HttpMessage, SnifferConfig } from './types.js';
+
+const __dirname = path.dirname(fileURLToPath(import.meta.url));
+const addonPath = path.resolve(__dirname, '..', 'build', 'Release', 'tcp_sniffer_native.node');
+
+interface Addon {
+  start: (config: unknown, onBatch?: (batch: unknown[]) => void, onEnd?: () => void) => boolean;
+  stop: () => unknown;
+}
+
+interface Packet {
+  tsUs: number;
+  src: [string, number];
+  dst: [string, number];
+  seq: number;
+  ack?: number;
+  flags: number;
+  payload: string;
+}
+
+const FIN = 0x01;
+const SYN = 0x02;
+const ACK = 0x10;
+const PSH_ACK = 0x18;
+const SYN_ACK = SYN | ACK;
+const FIN_ACK = FIN | ACK;
+const T0 = 1_700_000_000_000_000;
+const CLIENT: [string, number] = ['10.0.0.1', 40000];
+const SERVER: [string, number] = ['10.0.0.2', 8080];
+
+function ipv4(addr: string): Buffer {
+  return Buffer.from(addr.split('.').map(Number));
+}
+
+/** Classic pcap (microsecond timestamps, Ethernet) of IPv4/TCP packets; checksums are left 0. */
+function pcapFile(packets: Packet[]): Buffer {
+  const header = Buffer.alloc(24);
+  header.writeUInt32LE(0xa1b2c3d4, 0);
+  header.writeUInt16LE(2, 4);
+  header.writeUInt16LE(4, 6);
+  header.writeUInt32LE(65535, 16);
+  header.writeUInt32LE(1, 20);
+  const records = packets.map((p) => {
+    const payload = Buffer.from(p.payload, 'latin1');
+    const frame = Buffer.alloc(14 + 20 + 20 + payload.length);
+    frame.writeUInt16BE(0x0800, 12);
+    const ip = 14;
+    frame[ip] = 0x45;
+    frame.writeUInt16BE(20 + 20 + payload.length, ip + 2);
+    frame[ip + 8] = 64;
+    frame[ip + 9] = 6;
+    ipv4(p.src[0]).copy(frame, ip + 12);
+    ipv4(p.dst[0]).copy(frame, ip + 16);
+    const tcp = ip + 20;
+    frame.writeUInt16BE(p.src[1], tcp);
+    frame.writeUInt16BE(p.dst[1], tcp + 2);
+    frame.writeUInt32BE(p.seq, tcp + 4);
+    frame.writeUInt32BE(p.ack ?? 0, tcp + 8);
+    frame[tcp + 12] = 5 << 4;
+    frame[tcp + 13] = p.flags;
+    frame.writeUInt16BE(65535, tcp + 14);
+    payload.copy(frame, tcp + 20);
+    const record = Buffer.alloc(16);
+    record.writeUInt32LE(Math.floor(p.tsUs / 1e6), 0);
+    record.writeUInt32LE(p.tsUs % 1e6, 4);
+    record.writeUInt32LE(frame.length, 8);
+    record.writeUInt32LE(frame.length, 12);
+    return Buffer.concat([record, frame]);
+  });
+  return Buffer.concat([header, ...records]);
+}
+
+/**
+ * One client-server connection, built packet by packet with running sequence numbers
+ * (mod 2^32) and acks. Packets not passed to keep() are never written: lost to capture.
+ */
+class Flow {
+  readonly packets: Packet[] = [];
+  private tsUs = T0;
+  private clientSeq: number;
+  private serverSeq: number;
+
+  constructor(clientIsn = 1000, serverIsn = 5000) {
+    this.clientSeq = (clientIsn + 1) >>> 0;
+    this.serverSeq = (serverIsn + 1) >>> 0;
+    this.keep({ tsUs: this.tick(0), src: CLIENT, dst: SERVER, seq: clientIsn >>> 0, flags: SYN, payload: '' });
+    this.keep({
+      tsUs: this.tick(100),
+      src: SERVER,
+      dst: CLIENT,
+      seq: serverIsn >>> 0,
+      ack: this.clientSeq,
+      flags: SYN_ACK,
+      payload: '',
+    });
+  }
+
+  /** Next client segment, afterUs after the previous one; advances the client sequence. */
+  client(payload: string, afterUs = 100, flags = PSH_ACK): Packet {
+    const p = { tsUs: this.tick(afterUs), src: CLIENT, dst: SERVER, seq: this.clientSeq, ack: this.serverSeq, flags, payload };
+    this.clientSeq = (this.clientSeq + payload.length) >>> 0;
+    return p;
+  }
+
+  server(payload: string, afterUs = 100, flags = PSH_ACK): Packet {
+    const p = { tsUs: this.tick(afterUs), src: SERVER, dst: CLIENT, seq: this.serverSeq, ack: this.clientSeq, flags, payload };
+    this.serverSeq = (this.serverSeq + payload.length) >>> 0;
+    return p;
+  }
+
+  /** p sent again (reordered or retransmitted) afterUs after the previous packet. */
+  resend(p: Packet, afterUs = 100): Packet {
+    return { ...p, tsUs: this.tick(afterUs) };
+  }
+
+  keep(...packets: Packet[]): this {
+    this.packets.push(...packets);
+    return this;
+  }
+
+  private tick(afterUs: number): number {
+    this.tsUs += afterUs;
+    return this.tsUs;
+  }
+}
+
+function get(path: string): string {
+  return `GET ${path} HTTP/1.1\r\nHost: x\r\n\r\n`;
+}
+
+function ok(status: number, body = ''): string {
+  return `HTTP/1.1 ${status} OK\r\nContent-Length: ${body.length}\r\n\r\n${body}`;
+}
+
+/** Runs fn on a temporary capture file of packets, removed afterwards. */
+async function withCaptureFile<T>(packets: Packet[], fn: (file: string) => T | Promise<T>): Promise<T> {
+  const dir = mkdtempSync(path.join(os.tmpdir(), 'tcp-sniffer-'));
+  const file = path.join(dir, 'replay.pcap');
+  writeFileSync(file, pcapFile(packets));
+  try {
+    return await fn(file);
+  } finally {
+    rmSync(dir, { recursive: true, force: true });
+  }
+}
+
+/** Writes packets to a capture file, replays it and resolves with every record delivered before onEnd. */
+function replayPackets<T = HttpMessage>(packets: Packet[], config: Partial<SnifferConfig> = {}): Promise<T[]> {
+  const addon = createRequire(import.meta.url)(addonPath) as Addon;
+  return withCaptureFile(packets, async (file) => (await replay(addon, file, config)) as T[]);
+}
+
+/**
+ * Replays packets with nativeStdout in a child process (stdout here is the test
+ * runner's) and resolves with the lines the engine wrote.
+ */
+function nativeStdoutLines(packets: Packet[], config: Partial<SnifferConfig> = {}): Promise<string[]> {
+  return withCaptureFile(packets, (file) => {
+    const engineConfig = validateConfig({ ports: [8080], pcapFile: file, outputStdout: true, nativeStdout: true, ...config });
+    const script = [
+      "import { createRequire } from 'node:module';",
+      `const addon = createRequire(import.meta.url)(${JSON.stringify(addonPath)});`,
+      'addon.start(JSON.parse(process.argv[1]), () => {}, () => addon.stop());',
+    ].join('\n');
+    const child = spawnSync(process.execPath, ['--input-type=module', '-e', script, JSON.stringify(engineConfig)]);
+    assert.equal(child.status, 0, child.stderr.toString());
+    return child.stdout.toString('utf8').split('\n').filter((line) => line !== '');
+  });
+}
+
+/** Runs file through the addon and resolves with every record delivered before onEnd. */
+function replay(addon: Addon, file: string, overrides: Partial<SnifferConfig> = {}): Promise<unknown[]> {
+  const received: unknown[] = [];
+  const config = validateConfig({ ports: [8080], pcapFile: file, onHttpMessage: () => {}, ...overrides });
+  return new Promise((resolve, reject) => {
+    const ok = addon.start(config, (batch) => received.push(...batch), () => {
+      addon.stop();
+      resolve(received);
+    });
+    if (!ok) reject(new Error('addon start failed'));
+  });
+}
+
+describe('pcapFile replay (native addon)', { skip: !existsSync(addonPath) && 'native addon not built' }, () => {
+  it('emits a response the file ends inside, without FIN or RST, as incomplete', async () => {
+    const flow = new Flow();
+    // HTTP/1.0 without Content-Length: the body runs until a close the capture never saw.
+    flow.keep(flow.client('GET /report HTTP/1.0\r\nHost: x\r\n\r\n'));
+    flow.keep(flow.server('HTTP/1.0 200 OK\r\n\r\npartial', 500));
+    const messages = await replayPackets(flow.packets);
+    assert.ok(messages.some((m) => m.direction === 'request' && m.path === '/report'));
+    const response = messages.find((m) => m.direction === 'response');
+    assert.ok(response, 'response emitted at the end of the file');
+    assert.equal(response.statusCode, 200);
+    assert.equal(response.incomplete, true);
+  });
+
+  it('delivers every message of a file larger than the queue, whatever backpressurePolicy says', async () => {
+    const flow = new Flow();
+    const count = 2000;
+    for (let i = 0; i < count; i++) flow.keep(flow.client(get(`/${i}`)));
+    const messages = await replayPackets(flow.packets, {
+      messageQueueCapacity: 16,
+      messageBatchSize: 16,
+      backpressurePolicy: 'drop',
+    });
+    assert.equal(messages.length, count);
+    assert.equal(messages[count - 1].path, `/${count - 1}`);
+  });
+
+  it('writes nativeStdout lines byte for byte as JSON.stringify of the object-mode records', async () => {
+    const utf8 = (s: string) => Buffer.from(s, 'utf8').toString('latin1');
+    const flow = new Flow();
+    const request =
+      'GET /q?a=%22b%22&c=\\ HTTP/1.1\r\nHost: x\r\n' +
+      'X-Note: say "hi" \\ back\x01\x1f\x7f\tend\r\n' +
+      // Invalid UTF-8 (a bad lead, a cut sequence, a surrogate) around a valid character.
+      `X-Bin: \xff\xfe ok \xe2\x82 \xed\xa0\x80 ${utf8('😀')}\r\n` +
+      'X-Dup: 1\r\nAccept: */*\r\nX-Dup: 2\r\nAuthorization: secret\r\n\r\n';
+    flow.keep(flow.client(request), flow.server(ok(200, utf8('line1\nline2\t\x01"q"\\ é€😀'))));
+    flow.keep(flow.client(get('/unanswered')));
+    for (const correlateExchanges of [false, true]) {
+      const records = await replayPackets<unknown>(flow.packets, { correlateExchanges });
+      assert.equal(records.length, correlateExchanges ? 2 : 3);
+      assert.deepEqual(
+        await nativeStdoutLines(flow.packets, { correlateExchanges }),
+        records.map((r) => JSON.stringify(r))
+      );
+    }
+  });
+
+  it('pairs exchanges after a request lost in a hole by the server ack, not by arrival order', async () => {
+    const flow = new Flow();
+    flow.keep(flow.client(get('/a')), flow.server(ok(200)));
+    flow.client(get('/b')); // lost: /c waits behind the hole
+    flow.keep(flow.server(ok(201)), flow.client(get('/c')), flow.server(ok(202)));
+    // gapTimeoutMs (1 s) later the hole is skipped and /c parsed, after its response went out.
+    flow.keep(flow.client(get('/d'), 2_000_000), flow.server(ok(203)));
+    flow.keep(flow.client(get('/e')), flow.server(ok(204)));
+    const exchanges = await replayPackets<HttpExchange>(flow.packets, { correlateExchanges: true });
+    const pairs = exchanges.map((e) => `${e.request?.path ?? '-'} ${e.response?.statusCode ?? '-'}`);
+    assert.deepEqual(pairs.sort(), ['- 201', '- 202', '/a 200', '/c -', '/d 203', '/e 204']);
+  });
+
+  it('frames 304 and HEAD responses without a body whatever their Content-Length says', async () => {
+    const flow = new Flow();
+    flow.keep(flow.client(get('/a')), flow.server('HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\n\r\n'));
+    flow.keep(flow.client(get('/b')), flow.server(ok(200, 'hello')));
+    flow.keep(flow.client('HEAD /c HTTP/1.1\r\nHost: x\r\n\r\n'), flow.server('HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n'));
+    flow.keep(flow.client(get('/d')), flow.server(ok(200, 'ok')));
+    const messages = await replayPackets(flow.packets);
+    assert.deepEqual(
+      messages.filter((m) => m.direction === 'request').map((m) => m.path),
+      ['/a', '/b', '/c', '/d']
+    );
+    const responses = messages.filter((m) => m.direction === 'response');
+    assert.deepEqual(
+      responses.map((m) => [m.statusCode, m.body ?? '']),
+      [
+        [304, ''],
+        [200, 'hello'],
+        [200, ''],
+        [200, 'ok'],
+      ]
+    );
+  });
+
+  it('reassembles reordered and retransmitted segments across a sequence number wrap', async () => {
+    // Initial sequence numbers 16 and 32 below 2^32: the later segments carry wrapped ones.
+    const flow = new Flow(0xfffffff0, 0xffffffe0);
+    const request = get('/wrap');
+    const req1 = flow.client(request.slice(0, 20));
+    const req2 = flow.client(request.slice(20));
+    flow.keep(flow.resend(req2), flow.resend(req1), flow.resend(req1));
+    const response = ok(200, 'x'.repeat(40));
+    const res1 = flow.server(response.slice(0, 20));
+    const res2 = flow.server(response.slice(20, 40));
+    const res3 = flow.server(response.slice(40));
+    flow.keep(flow.resend(res2), flow.resend(res3), flow.resend(res1), flow.resend(res2));
+    flow.keep(flow.client(get('/next')), flow.server(ok(200, 'ok')));
+    const messages = await replayPackets(flow.packets);
+    assert.deepEqual(
+      messages.filter((m) => m.direction === 'request').map((m) => m.path),
+      ['/wrap', '/next']
+    );
+    const responses = messages.filter((m) => m.direction === 'response');
+    assert.deepEqual(
+      responses.map((m) => m.body),
+      ['x'.repeat(40), 'ok']
+    );
+    assert.ok(responses.every((m) => !m.incomplete));
+  });
+
+  it('resyncs at the next request line once a hole inside a request is skipped', async () => {
+    const flow = new Flow();
+    flow.keep(flow.client(get('/a')));
+    const request = 'GET /b HTTP/1.1\r\nHost: x\r\nAccept: */*\r\n\r\n';
+    flow.client(request.slice(0, 12)); // lost: the rest of /b is not a message start
+    flow.keep(flow.client(request.slice(12)), flow.client(get('/c')));
+    // gapTimeoutMs (1 s) later the hole is skipped and the buffered bytes parsed.
+    flow.keep(flow.client(get('/d'), 2_000_000));
+    const messages = await replayPackets(flow.packets);
+    assert.deepEqual(
+      messages.map((m) => m.path),
+      ['/a', '/c', '/d']
+    );
+  });
+
+  it('drops a retransmit arriving after FIN in both directions instead of parsing it again', async () => {
+    const flow = new Flow();
+    const request = flow.client(get('/a'));
+    const response = flow.server(ok(200, 'ok'));
+    flow.keep(request, response, flow.client('', 100, FIN_ACK), flow.server('', 100, FIN_ACK));
+    flow.keep(flow.resend(request, 500_000), flow.resend(response));
+    const messages = await replayPackets(flow.packets);
+    assert.deepEqual(
+      messages.map((m) => (m.direction === 'request' ? m.path : m.body)),
+      ['/a', 'ok']
+    );
+  });
+
+  it('stops framing by HEAD once the response to the HEAD is lost in a hole', async () => {
+    const flow = new Flow();
+    flow.keep(flow.client('HEAD /a HTTP/1.1\r\nHost: x\r\n\r\n' + get('/b')));
+    flow.server('HTTP/1.1 200 OK\r\nContent-Length: 50\r\n\r\n'); // lost
+    flow.keep(flow.server(ok(200, 'ok')));
+    flow.keep(flow.client(get('/c'), 2_000_000), flow.server(ok(200, 'abc')));
+    const messages = await replayPackets(flow.packets);
+    assert.deepEqual(
+      messages.filter((m) => m.direction === 'request').map((m) => m.path),
+      ['/a', '/b', '/c']
+    );
+    assert.deepEqual(
+      messages.filter((m) => m.direction === 'response').map((m) => m.body),
+      ['ok', 'abc']
+    );
+  });
+});
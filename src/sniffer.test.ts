@@ -9,7 +9,7 @@ import { spawn } from 'node:child_process';
 import path from 'node:path';
 import { fileURLToPath } from 'node:url';
 import { createSniffer } from './sniffer.js';
-import type { HttpMessage } from './types.js';
+import type { HttpExchange, HttpMessage } from './types.js';
 
 const __dirname = path.dirname(fileURLToPath(import.meta.url));
 
@@ -32,6 +32,17 @@ describe('Sniffer lifecycle', () => {
     assert.equal(sniffer.isRunning(), false);
   });
 
+  it('getStats() reports live engine stats only while running', async () => {
+    const sniffer = createSniffer({ ports: [8080], onHttpMessage: () => {} });
+    assert.equal(sniffer.getStats(), undefined);
+    await sniffer.start();
+    const stats = sniffer.getStats();
+    assert.equal(stats?.messagesParsed, 2);
+    assert.equal(stats?.segmentNs.count, 0);
+    await sniffer.stop();
+    assert.equal(sniffer.getStats(), undefined);
+  });
+
   it('stop() when not running is safe', async () => {
     const sniffer = createSniffer({ ports: [8080], onHttpMessage: () => {} });
     await sniffer.stop();
@@ -39,6 +50,15 @@ describe('Sniffer lifecycle', () => {
     assert.equal(sniffer.isRunning(), false);
   });
 
+  it('with pcapFile, start() resolves after the replay and leaves the sniffer stopped', async () => {
+    const received: HttpMessage[] = [];
+    const sniffer = createSniffer({ ports: [8080], pcapFile: '/tmp/incident.pcap', onHttpMessage: (msg) => received.push(msg) });
+    await sniffer.start();
+    assert.equal(sniffer.isRunning(), false);
+    assert.ok(received.length >= 1, 'messages delivered before start() resolved');
+    await sniffer.stop();
+  });
+
   it('start() rejects when config is invalid', async () => {
     const sniffer = createSniffer({ ports: [] as unknown as number[], onHttpMessage: () => {} });
     await assert.rejects(sniffer.start(), /ports/);
@@ -64,6 +84,21 @@ describe('Output pipeline (mock engine)', () => {
     assert.deepEqual(first.receiver, { ip: '10.0.0.1', port: 8080 });
   });
 
+  it('delivers exchanges to onHttpExchange when correlating', async () => {
+    const received: HttpExchange[] = [];
+    const sniffer = createSniffer({
+      ports: [8080],
+      onHttpExchange: (exchange) => received.push(exchange),
+    });
+    await sniffer.start();
+    await new Promise((r) => setTimeout(r, 50));
+    await sniffer.stop();
+    assert.equal(received.length, 1);
+    assert.equal(received[0].request?.method, 'GET');
+    assert.equal(received[0].response?.statusCode, 200);
+    assert.equal(typeof received[0].timing.latencyUs, 'number');
+  });
+
   it('delivers messages to stdout when outputStdout is true', async () => {
     const lines: string[] = [];
     const origWrite = process.stdout.write.bind(process.stdout);
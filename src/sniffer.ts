@@ -1,31 +1,37 @@
 /**
  * Sniffer instance and createSniffer — Stream B (B1–B5).
- * Public API: createSniffer(config), sniffer.start(), sniffer.stop(), sniffer.isRunning().
+ * Public API: createSniffer(config), sniffer.start(), sniffer.stop(), sniffer.isRunning(), sniffer.getStats().
+ * With pcapFile, start() replays the file and resolves after stopping at its end.
  */
 
 import { getEngine } from './engine-loader.js';
 import type { Engine } from './engine.js';
 import { EXIT_RUNTIME } from './constants.js';
 import { logError, logInfo, logWarn } from './logger.js';
-import { deliverMessage } from './output.js';
+import { deliverExchange, deliverMessage } from './output.js';
+import type { OutputConfig } from './output.js';
 import { ENGINE_ERROR_CODES } from './types.js';
-import type { EngineError, SnifferConfig } from './types.js';
+import type { EngineError, EngineStats, SnifferConfig } from './types.js';
+import { UrlBatcher } from './url-batcher.js';
 import { validateConfig, hasOutputConfigured } from './validation.js';
 
 export interface Sniffer {
   start(): Promise<void>;
   stop(): Promise<void>;
   isRunning(): boolean;
+  /** Live engine stats while running (e.g. for a metrics exporter); undefined when stopped or unsupported. */
+  getStats(): EngineStats | undefined;
 }
 
 /**
  * Creates a sniffer instance. Config is validated on start(), not on create.
- * At least one of outputUrl, outputStdout, or onHttpMessage should be set; otherwise a warning is logged at start().
+ * At least one of outputUrl, outputStdout, onHttpMessage or onHttpExchange should be set; otherwise a warning is logged at start().
  */
 export function createSniffer(config: SnifferConfig): Sniffer {
   const engine: Engine = getEngine();
   let running = false;
   let signalHandlersAttached = false;
+  let urlBatcher: UrlBatcher | undefined;
 
   const onSignal = (): void => {
     logInfo('Received signal, stopping sniffer');
@@ -53,16 +59,28 @@ export function createSniffer(config: SnifferConfig): Sniffer {
       }
       const engineConfig = validateConfig(config);
       if (!hasOutputConfigured(config)) {
-        logWarn('No output configured (outputUrl, outputStdout, or onHttpMessage); messages will not be delivered');
+        logWarn('No output configured (outputUrl, outputStdout, onHttpMessage, or onHttpExchange); messages will not be delivered');
       }
       logInfo('Starting sniffer', {
         interface: engineConfig.interface || '(default)',
         ports: engineConfig.ports,
       });
+      urlBatcher = config.outputUrl ? new UrlBatcher({ ...config, outputUrl: config.outputUrl }) : undefined;
+      // A filtering engine already dropped and redacted headers; don't copy every message again.
+      const outputConfig: OutputConfig = {
+        ...config,
+        ...(engine.filtersHeaders && { redactHeaders: [], includeHeaders: [] }),
+        ...(engineConfig.nativeStdout && engine.writesStdout && { outputStdout: false }),
+        urlBatcher,
+      };
+      // A file replay is running until engine.start resolves, so a signal can end it early.
+      const replay = engineConfig.pcapFile !== '';
+      running = replay;
       attachSignalHandlers();
       try {
         await engine.start(engineConfig, {
-          onMessage: (msg) => deliverMessage(config, msg),
+          onMessage: (msg) => deliverMessage(outputConfig, msg),
+          onExchange: (exchange) => deliverExchange(outputConfig, exchange),
           onError: (err: EngineError) => {
             logError('Engine reported fatal error', { code: err.code, message: err.message });
             if (
@@ -74,8 +92,15 @@ export function createSniffer(config: SnifferConfig): Sniffer {
             }
           },
         });
+        if (replay) {
+          // The file is exhausted: stop (drain, stats) unless a signal already did.
+          await sniffer.stop();
+          return;
+        }
         running = true;
       } catch (e) {
+        running = false;
+        urlBatcher = undefined;
         detachSignalHandlers();
         const message = e instanceof Error ? e.message : String(e);
         logInfo('Sniffer start failed', { error: message });
@@ -91,13 +116,25 @@ export function createSniffer(config: SnifferConfig): Sniffer {
       running = false;
       logInfo('Stopping sniffer, draining in-flight messages');
       const stats = await engine.stop();
-      if (stats && (typeof stats.packetsReceived === 'number' || typeof stats.packetsDropped === 'number')) {
+      if (
+        stats &&
+        (typeof stats.packetsReceived === 'number' ||
+          typeof stats.packetsDropped === 'number' ||
+          typeof stats.messagesDropped === 'number')
+      ) {
         logInfo('Capture stats', {
           packetsReceived: stats.packetsReceived,
           packetsDropped: stats.packetsDropped,
           packetsIfDropped: stats.packetsIfDropped,
+          messagesDropped: stats.messagesDropped,
         });
       }
+      // The engine has drained into the batcher; send what it holds.
+      if (urlBatcher) {
+        await urlBatcher.close();
+        logInfo('Output stats', { ...urlBatcher.stats() });
+        urlBatcher = undefined;
+      }
       detachSignalHandlers();
       logInfo('Sniffer stopped');
     },
@@ -105,6 +142,11 @@ export function createSniffer(config: SnifferConfig): Sniffer {
     isRunning(): boolean {
       return running;
     },
+
+    getStats(): EngineStats | undefined {
+      const stats = running ? engine.getStats?.() : undefined;
+      return stats && urlBatcher ? { ...stats, output: urlBatcher.stats() } : stats;
+    },
   };
 
   return sniffer;
@@ -5,19 +5,125 @@
 
 // --- Config passed TS → C++ (contract §1) ---
 
+/** Packet source: libpcap, or an AF_PACKET TPACKET_V3 memory-mapped ring (Linux). */
+export type CaptureBackend = 'pcap' | 'tpacket';
+
+/** How batches cross the N-API boundary: arrays of objects, or one length-prefixed ArrayBuffer. */
+export type MessageEncoding = 'object' | 'binary';
+
+/** A hole in a TCP stream: skip it after gapTimeoutMs or a full out-of-order budget, or wait for it. */
+export type GapPolicy = 'skip' | 'wait';
+
+/**
+ * How much of each body to keep: all of it (up to maxBodySize), the first N bytes, or
+ * none. Bodies are framed and counted (bodyLength) either way.
+ */
+export type CaptureBodyMode = 'none' | 'full' | `head:${number}`;
+
+/** What the native message queue does when full: drop (and count) new messages, or stall capture. */
+export type BackpressurePolicy = 'drop' | 'block';
+
+/** Content-Encoding of outputUrl request bodies ('zstd' needs Node 22.15+). */
+export type OutputCompression = 'none' | 'gzip' | 'zstd';
+
 /** User-facing config for createSniffer(); may omit optional fields. */
 export interface SnifferConfig {
   interface?: string;
+  /**
+   * Read packets from this capture file (pcap or pcapng) instead of an interface, as fast
+   * as the pipeline allows. start() resolves once the file is exhausted and every message
+   * has been delivered. Default '' (live capture).
+   */
+  pcapFile?: string;
   ports: number[];
   outputUrl?: string;
+  /**
+   * Records per outputUrl POST. 1 (default) POSTs each record as one JSON object;
+   * larger values POST NDJSON batches.
+   */
+  outputBatchSize?: number;
+  /** Max uncompressed bytes per outputUrl POST. Default 1 MiB. */
+  outputBatchBytes?: number;
+  /** Max ms a record waits for its batch to fill. Default 100. */
+  outputBatchLatencyMs?: number;
+  /** Compression of outputUrl bodies. Default 'none'. */
+  outputCompression?: OutputCompression;
+  /** Concurrent outputUrl POSTs. Default 4. */
+  outputMaxInFlight?: number;
+  /** Batches waiting to be sent or retried; past it the oldest are dropped and counted. Default 64. */
+  outputMaxQueuedBatches?: number;
   outputStdout?: boolean;
+  /**
+   * With outputStdout, the native engine serializes messages (or exchanges) to NDJSON and
+   * writes them to stdout from its own thread; JS writes nothing to stdout. When stdout is
+   * the only output, messages are not handed to JS at all. A blocked pipe backs up the
+   * native queue (backpressurePolicy). Default false.
+   */
+  nativeStdout?: boolean;
   sampleRate?: number;
   maxBodySize?: number;
+  /** Body capture for every port without a captureBodyByPort entry. Default 'full'. */
+  captureBody?: CaptureBodyMode;
+  /** Per receiver port override of captureBody (keys must be in ports), e.g. { 443: 'none' }. */
+  captureBodyByPort?: Record<number, CaptureBodyMode>;
   maxConcurrentConnections?: number;
   connectionIdleTimeoutMs?: number;
+  /** Out-of-order bytes buffered per connection direction while waiting for a missing segment. Default 256 KiB. */
+  maxOutOfOrderBytes?: number;
+  /**
+   * 'skip' gives up on a missing segment after gapTimeoutMs, or once maxOutOfOrderBytes
+   * are buffered behind it, and resynchronizes the parser; 'wait' holds the stream
+   * until the segment arrives or the connection is evicted. Default 'skip'.
+   */
+  gapPolicy?: GapPolicy;
+  /** Age in ms at which a hole is skipped under gapPolicy 'skip'. Default 1000. */
+  gapTimeoutMs?: number;
+  /** Capture worker threads (PACKET_FANOUT_HASH sockets, one reassembly shard each). Default 1. */
+  workerThreads?: number;
+  /** Packet source. Default 'pcap'. */
+  captureBackend?: CaptureBackend;
+  /** Ring block size in bytes (power of two, >= 4096). With 'pcap', blockSize * blockCount is the kernel buffer. Default 1 MiB. */
+  ringBlockSize?: number;
+  /** Ring blocks per worker. Default 8. */
+  ringBlockCount?: number;
+  /** Max ms a partially filled block waits before delivery ('pcap': read timeout, 0 = immediate mode). Default 10. */
+  ringBlockTimeoutMs?: number;
+  /** Bytes captured per packet. Default 65535. */
+  snaplen?: number;
+  /**
+   * Extend the kernel BPF filter to drop IPv4 segments without payload or SYN/FIN/RST
+   * (pure ACKs) and to apply sampleRate, so they never reach userspace. Default false.
+   */
+  kernelPrefilter?: boolean;
+  /** Max messages per native → JS delivery. Default 256. */
+  messageBatchSize?: number;
+  /** Max ms a message waits for its batch to fill. Default 10. */
+  messageBatchLatencyMs?: number;
+  /** Native queue capacity in messages (>= messageBatchSize). Default 8192. */
+  messageQueueCapacity?: number;
+  /** Behaviour when the native queue is full. Default 'drop'. */
+  backpressurePolicy?: BackpressurePolicy;
+  /**
+   * Under sustained overload (native queue or capture ring filling, or workers busy),
+   * stop keeping bodies, then sample fewer new flows, then refuse new connections;
+   * tracked connections are kept. Live capture only. Default false.
+   */
+  loadShedding?: boolean;
+  /** 'binary' serializes each batch natively and decodes headers/body lazily in JS. Default 'object'. */
+  messageEncoding?: MessageEncoding;
+  /**
+   * Pair each response with its request natively and deliver HttpExchange records (with
+   * capture-time latency) to onHttpExchange and the stdout/outputUrl outputs. Default:
+   * true when onHttpExchange is set, false otherwise.
+   */
+  correlateExchanges?: boolean;
   onHttpMessage?: (msg: HttpMessage) => void;
+  /** Receives each exchange; requires correlateExchanges (the default when this is set). */
+  onHttpExchange?: (exchange: HttpExchange) => void;
   /** Header names to redact (case-insensitive). Default: ['authorization', 'cookie']. Use [] to disable. */
   redactHeaders?: string[];
+  /** Header names to keep (case-insensitive); others are dropped. Default: all headers. */
+  includeHeaders?: string[];
 }
 
 /**
@@ -26,11 +132,40 @@ export interface SnifferConfig {
  */
 export interface EngineConfig {
   interface: string;
+  /** Empty for live capture on interface. */
+  pcapFile: string;
   ports: number[];
   sampleRate: number;
   maxBodySize: number;
+  captureBody: CaptureBodyMode;
+  captureBodyByPort: Record<number, CaptureBodyMode>;
   maxConcurrentConnections: number;
   connectionIdleTimeoutMs: number;
+  maxOutOfOrderBytes: number;
+  gapPolicy: GapPolicy;
+  gapTimeoutMs: number;
+  workerThreads: number;
+  captureBackend: CaptureBackend;
+  ringBlockSize: number;
+  ringBlockCount: number;
+  ringBlockTimeoutMs: number;
+  snaplen: number;
+  kernelPrefilter: boolean;
+  messageBatchSize: number;
+  messageBatchLatencyMs: number;
+  messageQueueCapacity: number;
+  backpressurePolicy: BackpressurePolicy;
+  loadShedding: boolean;
+  /** outputStdout with nativeStdout: the engine writes NDJSON to stdout itself. */
+  nativeStdout: boolean;
+  /** False when nativeStdout is the only output, so batches need not be delivered to JS. */
+  messagesToJs: boolean;
+  messageEncoding: MessageEncoding;
+  correlateExchanges: boolean;
+  /** Lowercased; the native engine redacts these while parsing. */
+  redactHeaders: string[];
+  /** Lowercased; empty keeps every header. */
+  includeHeaders: string[];
 }
 
 // --- Message shape C++ → TS (contract §2) ---
@@ -47,13 +182,150 @@ export interface HttpMessage {
   destination: Endpoint;
   direction: HttpDirection;
   headers: Record<string, string>;
+  /** ISO 8601 UTC capture time of the message's first byte. */
   timestamp: string;
+  /** The same capture time in µs since the Unix epoch (absent from sources without one). */
+  timestampUs?: number;
   method?: string;
   path?: string;
   statusCode?: number;
   body?: string;
   bodyTruncated?: boolean;
   bodyEncoding?: string;
+  /** Body bytes on the wire (de-chunked), including any not kept under captureBody/maxBodySize. */
+  bodyLength?: number;
+  /** Part of the message was lost in a skipped reassembly gap; body is omitted. */
+  incomplete?: boolean;
+}
+
+// --- Exchange shape C++ → TS (contract §2.2, correlateExchanges) ---
+
+/** Capture times (µs since the Unix epoch) of an exchange, from packet timestamps. */
+export interface ExchangeTiming {
+  /** First byte of the request. */
+  requestStartUs?: number;
+  /** Segment that completed the request. */
+  requestEndUs?: number;
+  /** First byte of the response. */
+  responseStartUs?: number;
+  /** Segment that completed the response. */
+  responseEndUs?: number;
+  /** responseStartUs - requestEndUs: server time to first byte. Present when both sides are. */
+  latencyUs?: number;
+}
+
+/**
+ * A request and the response that answered it, paired natively in pipelining order.
+ * request is absent for a response whose request was not captured; response is absent
+ * for a request still unanswered when its connection was evicted or capture stopped.
+ */
+export interface HttpExchange {
+  receiver: Endpoint;
+  destination: Endpoint;
+  request?: HttpMessage;
+  response?: HttpMessage;
+  timing: ExchangeTiming;
+}
+
+// --- Live stats C++ → TS (contract §3, getStats) ---
+
+/** Latency histogram (log-linear buckets, each within 1/16 of its upper bound). */
+export interface LatencyHistogram {
+  count: number;
+  sum: number;
+  max: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  p999: number;
+  /** [upperBound, count] for each non-empty bucket, ascending. */
+  buckets: Array<[number, number]>;
+}
+
+/** Load shedding stage, cumulative: each level also applies the ones before it. */
+export type LoadShedLevel = 'none' | 'noBodies' | 'reducedSampling' | 'noNewConnections';
+
+/** Current load shedding level and the lag signals (0–1) it was last evaluated on. */
+export interface LoadSheddingStats {
+  level: LoadShedLevel;
+  /** Level changes since start(); each is also logged by the native engine. */
+  transitions: number;
+  /** Native message queue fill. */
+  queueFill: number;
+  /** Fullest capture ring ('tpacket' backend; 0 otherwise). */
+  ringFill: number;
+  /** Busiest worker's share of time spent reassembling and parsing. */
+  busy: number;
+}
+
+/** outputUrl delivery counters since start(), added to getStats() by the sniffer. */
+export interface OutputUrlStats {
+  messagesSent: number;
+  batchesSent: number;
+  /** Request body bytes sent (after compression). */
+  bytesSent: number;
+  retries: number;
+  /** Records dropped after the last retry or because the batch queue was full. */
+  messagesDropped: number;
+  batchesDropped: number;
+  /** Gauge: batches waiting to be sent or retried. */
+  queuedBatches: number;
+  /** Gauge: POSTs in progress. */
+  inFlight: number;
+}
+
+/**
+ * Live engine counters since start(), summed over workers. Counters only grow while
+ * capture runs; connections, queueDepth and batchesInFlight are gauges.
+ */
+export interface EngineStats {
+  /** Packets decoded to a TCP segment and rejected (not IP/TCP, non-first fragments, truncated). */
+  packetsDecoded: number;
+  packetsRejected: number;
+  /** Segments reassembled (after sampling) and the in-order bytes handed to the parsers. */
+  segments: number;
+  bytesReassembled: number;
+  /** Bytes copied into out-of-order buffers; segments dropped over the budget (gapPolicy 'wait'). */
+  outOfOrderBytes: number;
+  outOfOrderDrops: number;
+  /** Holes opened in a stream; holes skipped (gapPolicy 'skip') and the bytes lost to them. */
+  gaps: number;
+  gapsSkipped: number;
+  gapBytesSkipped: number;
+  evictionsIdle: number;
+  evictionsCap: number;
+  /** Connections torn down after FIN in both directions / on RST. */
+  closesFin: number;
+  closesRst: number;
+  connections: number;
+  /** Requests and responses parsed (before correlation into exchanges). */
+  messagesParsed: number;
+  /** Messages in the native queue, and batches handed to JS but not yet processed. */
+  queueDepth: number;
+  batchesInFlight: number;
+  messagesDropped: number;
+  /** Segments of new flows refused by load shedding. */
+  segmentsShed: number;
+  /** Connections whose first bytes were not HTTP (TLS, HTTP/2 preface, other) or that switched protocols, and their segments dropped unparsed. */
+  connectionsIgnored: number;
+  segmentsIgnored: number;
+  /** Header blocks still unterminated after 64 KiB, dropped unparsed; also chunk-size lines over 1 KiB and trailers over 64 KiB (message emitted incomplete). */
+  headersTooLarge: number;
+  /** Present with loadShedding during live capture. */
+  loadShedding?: LoadSheddingStats;
+  /** Present when outputUrl is set. */
+  output?: OutputUrlStats;
+  /** With nativeStdout: bytes written to stdout and the writev calls that wrote them. */
+  stdoutBytes?: number;
+  stdoutWrites?: number;
+  /** With nativeStdout: messages not written in full after a stdout write error (e.g. EPIPE). */
+  stdoutDropped?: number;
+  /** Reassembly and parsing time per segment, ns. */
+  segmentNs: LatencyHistogram;
+  /** Capture time of a message's completing segment to the message being parsed, µs. */
+  captureToParseUs: LatencyHistogram;
+  /** Capture time of a message's completing segment to its batch being handed to JS, µs. */
+  captureToDeliveryUs: LatencyHistogram;
 }
 
 // --- Error reporting C++ → TS (contract §4) ---
@@ -0,0 +1,168 @@
+/**
+ * Batched outputUrl delivery: batching, compression, in-flight bound and drop accounting.
+ */
+
+import { describe, it, beforeEach, afterEach } from 'node:test';
+import assert from 'node:assert/strict';
+import { gunzipSync } from 'node:zlib';
+import { UrlBatcher } from './url-batcher.js';
+import type { HttpMessage } from './types.js';
+
+const OUTPUT_URL = 'https://example.com/ingest';
+
+function message(path: string): HttpMessage {
+  return {
+    receiver: { ip: '10.0.0.1', port: 8080 },
+    destination: { ip: '10.0.0.2', port: 443 },
+    direction: 'request',
+    headers: { host: 'example.com' },
+    timestamp: '2025-01-01T12:00:00.000Z',
+    method: 'GET',
+    path,
+    body: '',
+  };
+}
+
+interface FetchCall {
+  headers: Record<string, string>;
+  body: Buffer;
+}
+
+describe('UrlBatcher', () => {
+  let calls: FetchCall[];
+  let respond: (call: FetchCall) => Promise<Response>;
+  let originalFetch: typeof globalThis.fetch;
+
+  beforeEach(() => {
+    calls = [];
+    respond = async () => new Response('', { status: 200 });
+    originalFetch = globalThis.fetch;
+    globalThis.fetch = (async (_url: string | URL, init?: RequestInit) => {
+      const call = { headers: init?.headers as Record<string, string>, body: init?.body as Buffer };
+      calls.push(call);
+      return respond(call);
+    }) as typeof fetch;
+  });
+
+  afterEach(() => {
+    globalThis.fetch = originalFetch;
+  });
+
+  it('sends a single JSON object per POST with the default batch size of 1', async () => {
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL });
+    batcher.add(message('/a'));
+    await batcher.close();
+    assert.equal(calls.length, 1);
+    assert.equal(calls[0].headers['Content-Type'], 'application/json');
+    assert.equal((JSON.parse(calls[0].body.toString()) as HttpMessage).path, '/a');
+  });
+
+  it('sends NDJSON batches of outputBatchSize records', async () => {
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputBatchSize: 3 });
+    for (let i = 0; i < 7; i++) batcher.add(message(`/${i}`));
+    await batcher.close();
+    assert.equal(calls.length, 3);
+    assert.equal(calls[0].headers['Content-Type'], 'application/x-ndjson');
+    const lines = calls.map((c) => c.body.toString().trimEnd().split('\n'));
+    assert.deepEqual(
+      lines.map((l) => l.length),
+      [3, 3, 1]
+    );
+    assert.equal((JSON.parse(lines[1][0]) as HttpMessage).path, '/3');
+    const stats = batcher.stats();
+    assert.equal(stats.messagesSent, 7);
+    assert.equal(stats.batchesSent, 3);
+    assert.equal(stats.messagesDropped, 0);
+  });
+
+  it('seals a batch when outputBatchBytes would be exceeded', async () => {
+    const size = Buffer.byteLength(JSON.stringify(message('/0'))) + 1;
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputBatchSize: 100, outputBatchBytes: size * 2 });
+    for (let i = 0; i < 5; i++) batcher.add(message(`/${i}`));
+    await batcher.close();
+    assert.deepEqual(
+      calls.map((c) => c.body.toString().trimEnd().split('\n').length),
+      [2, 2, 1]
+    );
+  });
+
+  it('sends a partial batch after outputBatchLatencyMs', async () => {
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputBatchSize: 100, outputBatchLatencyMs: 20 });
+    batcher.add(message('/a'));
+    batcher.add(message('/b'));
+    assert.equal(calls.length, 0);
+    await new Promise((r) => setTimeout(r, 60));
+    assert.equal(calls.length, 1);
+    assert.equal(calls[0].body.toString().trimEnd().split('\n').length, 2);
+    await batcher.close();
+  });
+
+  it('gzips the body and sets Content-Encoding', async () => {
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputBatchSize: 2, outputCompression: 'gzip' });
+    batcher.add(message('/a'));
+    batcher.add(message('/b'));
+    await batcher.close();
+    assert.equal(calls.length, 1);
+    assert.equal(calls[0].headers['Content-Encoding'], 'gzip');
+    const lines = gunzipSync(calls[0].body).toString().trimEnd().split('\n');
+    assert.deepEqual(
+      lines.map((l) => (JSON.parse(l) as HttpMessage).path),
+      ['/a', '/b']
+    );
+    assert.equal(batcher.stats().bytesSent, calls[0].body.length);
+  });
+
+  it('keeps at most outputMaxInFlight POSTs outstanding', async () => {
+    const pending: Array<() => void> = [];
+    respond = () =>
+      new Promise<Response>((resolve) => pending.push(() => resolve(new Response('', { status: 200 }))));
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputMaxInFlight: 2 });
+    for (let i = 0; i < 5; i++) batcher.add(message(`/${i}`));
+    await new Promise((r) => setTimeout(r, 10));
+    assert.equal(calls.length, 2);
+    assert.equal(batcher.stats().inFlight, 2);
+    assert.equal(batcher.stats().queuedBatches, 3);
+    const closed = batcher.close();
+    while (calls.length < 5 || pending.length > 0) {
+      pending.splice(0).forEach((resolve) => resolve());
+      await new Promise((r) => setTimeout(r, 5));
+    }
+    await closed;
+    assert.equal(batcher.stats().messagesSent, 5);
+    assert.equal(batcher.stats().inFlight, 0);
+  });
+
+  it('drops the oldest batch past outputMaxQueuedBatches and counts it', async () => {
+    const pending: Array<() => void> = [];
+    respond = () =>
+      new Promise<Response>((resolve) => pending.push(() => resolve(new Response('', { status: 200 }))));
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL, outputMaxInFlight: 1, outputMaxQueuedBatches: 2 });
+    for (let i = 0; i < 5; i++) batcher.add(message(`/${i}`));
+    // /0 is in flight, /1 and /2 were shed for /3 and /4.
+    assert.equal(batcher.stats().messagesDropped, 2);
+    assert.equal(batcher.stats().batchesDropped, 2);
+    const closed = batcher.close();
+    while (calls.length < 3 || pending.length > 0) {
+      pending.splice(0).forEach((resolve) => resolve());
+      await new Promise((r) => setTimeout(r, 5));
+    }
+    await closed;
+    assert.deepEqual(
+      calls.map((c) => (JSON.parse(c.body.toString()) as HttpMessage).path),
+      ['/0', '/3', '/4']
+    );
+  });
+
+  it('schedules a retry on failure and drops it on close after one last attempt', async () => {
+    respond = async () => new Response('', { status: 503 });
+    const batcher = new UrlBatcher({ outputUrl: OUTPUT_URL });
+    batcher.add(message('/a'));
+    await new Promise((r) => setTimeout(r, 10));
+    assert.equal(batcher.stats().retries, 1);
+    assert.equal(batcher.stats().queuedBatches, 1);
+    await batcher.close();
+    assert.equal(calls.length, 2);
+    assert.equal(batcher.stats().messagesDropped, 1);
+    assert.equal(batcher.stats().queuedBatches, 0);
+  });
+});
@@ -0,0 +1,227 @@
+/**
+ * Batched outputUrl delivery (B3). Records are serialized as they arrive and POSTed in
+ * batches of up to outputBatchSize records / outputBatchBytes bytes, or after
+ * outputBatchLatencyMs, optionally compressed. At most outputMaxInFlight POSTs run at
+ * once; batches waiting to be sent or retried are bounded by outputMaxQueuedBatches,
+ * and the oldest are dropped (and counted) past it.
+ */
+
+import { promisify } from 'node:util';
+import * as zlib from 'node:zlib';
+import { OUTPUT_DEFAULTS } from './constants.js';
+import { logError, logWarn } from './logger.js';
+import type { HttpExchange, HttpMessage, OutputCompression, OutputUrlStats } from './types.js';
+
+/** Backoff before each retry of a failed batch; dropped after the last. */
+export const RETRY_DELAYS_MS = [1000, 2000, 4000];
+/** A POST that takes longer fails (and is retried), so a hung request cannot hold its slot. */
+const REQUEST_TIMEOUT_MS = 30_000;
+/** Environment variable holding an optional Bearer token for outputUrl POSTs. */
+export const OUTPUT_URL_AUTH_TOKEN = 'OUTPUT_URL_AUTH_TOKEN';
+
+const gzip = promisify(zlib.gzip);
+// zlib.zstdCompress exists from Node 22.15 / 23.8.
+const zstdCompress = (zlib as { zstdCompress?: typeof zlib.gzip }).zstdCompress;
+const zstd = zstdCompress !== undefined ? promisify(zstdCompress) : undefined;
+
+/** True when outputCompression 'zstd' is available in this Node version. */
+export function supportsZstd(): boolean {
+  return zstd !== undefined;
+}
+
+export interface UrlBatcherOptions {
+  outputUrl: string;
+  outputBatchSize?: number;
+  outputBatchBytes?: number;
+  outputBatchLatencyMs?: number;
+  outputCompression?: OutputCompression;
+  outputMaxInFlight?: number;
+  outputMaxQueuedBatches?: number;
+}
+
+interface Batch {
+  lines: string[];
+  bytes: number;
+  /** Encoded (and compressed) once, reused by retries. */
+  body?: Buffer;
+  attempts: number;
+  dueAt: number;
+}
+
+export class UrlBatcher {
+  private readonly url: string;
+  private readonly maxRecords: number;
+  private readonly maxBytes: number;
+  private readonly latencyMs: number;
+  private readonly compression: OutputCompression;
+  private readonly maxInFlight: number;
+  private readonly maxQueued: number;
+  private readonly headers: Record<string, string>;
+
+  private current: Batch = newBatch();
+  private latencyTimer: NodeJS.Timeout | undefined;
+  /** Sealed batches in send order; retries wait here until their dueAt. */
+  private queue: Batch[] = [];
+  private retryTimer: NodeJS.Timeout | undefined;
+  private inFlight = 0;
+  private closing = false;
+  private idleWaiters: Array<() => void> = [];
+  private readonly counters: OutputUrlStats = {
+    messagesSent: 0,
+    batchesSent: 0,
+    bytesSent: 0,
+    retries: 0,
+    messagesDropped: 0,
+    batchesDropped: 0,
+    queuedBatches: 0,
+    inFlight: 0,
+  };
+
+  constructor(options: UrlBatcherOptions) {
+    this.url = options.outputUrl;
+    this.maxRecords = options.outputBatchSize ?? OUTPUT_DEFAULTS.outputBatchSize;
+    this.maxBytes = options.outputBatchBytes ?? OUTPUT_DEFAULTS.outputBatchBytes;
+    this.latencyMs = options.outputBatchLatencyMs ?? OUTPUT_DEFAULTS.outputBatchLatencyMs;
+    this.compression = options.outputCompression ?? OUTPUT_DEFAULTS.outputCompression;
+    this.maxInFlight = options.outputMaxInFlight ?? OUTPUT_DEFAULTS.outputMaxInFlight;
+    this.maxQueued = options.outputMaxQueuedBatches ?? OUTPUT_DEFAULTS.outputMaxQueuedBatches;
+    const token = process.env[OUTPUT_URL_AUTH_TOKEN];
+    this.headers = {
+      // One record per POST keeps the single-object body of unbatched delivery.
+      'Content-Type': this.maxRecords === 1 ? 'application/json' : 'application/x-ndjson',
+      ...(this.compression !== 'none' && { 'Content-Encoding': this.compression }),
+      ...(token && { Authorization: `Bearer ${token}` }),
+    };
+  }
+
+  /** Queue one record; sends once the batch is full or outputBatchLatencyMs after its first record. */
+  add(record: HttpMessage | HttpExchange): void {
+    if (this.closing) return;
+    const line = JSON.stringify(record);
+    const bytes = Buffer.byteLength(line) + 1;
+    if (this.current.lines.length > 0 && this.current.bytes + bytes > this.maxBytes) this.seal();
+    this.current.lines.push(line);
+    this.current.bytes += bytes;
+    if (this.current.lines.length >= this.maxRecords || this.current.bytes >= this.maxBytes) {
+      this.seal();
+    } else if (this.latencyTimer === undefined) {
+      this.latencyTimer = setTimeout(() => this.seal(), this.latencyMs);
+      this.latencyTimer.unref();
+    }
+  }
+
+  /**
+   * Send what is buffered and wait for every queued batch to be delivered or dropped.
+   * Batches waiting for a retry get one immediate last attempt.
+   */
+  async close(): Promise<void> {
+    this.closing = true;
+    this.seal();
+    for (const batch of this.queue) batch.dueAt = 0;
+    this.pump();
+    if (this.queue.length > 0 || this.inFlight > 0) {
+      await new Promise<void>((resolve) => this.idleWaiters.push(resolve));
+    }
+    clearTimeout(this.retryTimer);
+  }
+
+  stats(): OutputUrlStats {
+    return { ...this.counters, queuedBatches: this.queue.length, inFlight: this.inFlight };
+  }
+
+  private seal(): void {
+    clearTimeout(this.latencyTimer);
+    this.latencyTimer = undefined;
+    if (this.current.lines.length === 0) return;
+    this.enqueue(this.current);
+    this.current = newBatch();
+    this.pump();
+  }
+
+  private enqueue(batch: Batch): void {
+    this.queue.push(batch);
+    if (this.queue.length <= this.maxQueued) return;
+    // Shed the oldest: a batch already being retried before one not yet tried.
+    let victim = this.queue.findIndex((b) => b.attempts > 0);
+    if (victim < 0) victim = 0;
+    const [dropped] = this.queue.splice(victim, 1);
+    this.drop(dropped, 'outputUrl queue full, dropped oldest batch');
+  }
+
+  private drop(batch: Batch, reason: string, error?: string): void {
+    this.counters.batchesDropped++;
+    this.counters.messagesDropped += batch.lines.length;
+    const extra = { url: this.url, messages: batch.lines.length, ...(error !== undefined && { error }) };
+    if (error !== undefined) logError(reason, extra);
+    else logWarn(reason, extra);
+  }
+
+  /** Start sends while there is a free slot and a batch is due; arm the retry timer otherwise. */
+  private pump(): void {
+    const now = Date.now();
+    while (this.inFlight < this.maxInFlight) {
+      const next = this.queue.findIndex((b) => b.dueAt <= now);
+      if (next < 0) break;
+      const [batch] = this.queue.splice(next, 1);
+      this.inFlight++;
+      void this.send(batch);
+    }
+    clearTimeout(this.retryTimer);
+    this.retryTimer = undefined;
+    if (this.inFlight < this.maxInFlight && this.queue.length > 0) {
+      const dueAt = Math.min(...this.queue.map((b) => b.dueAt));
+      this.retryTimer = setTimeout(() => this.pump(), Math.max(0, dueAt - now));
+      this.retryTimer.unref();
+    }
+    if (this.queue.length === 0 && this.inFlight === 0) {
+      for (const resolve of this.idleWaiters.splice(0)) resolve();
+    }
+  }
+
+  private async send(batch: Batch): Promise<void> {
+    let error: string | undefined;
+    try {
+      batch.body ??= await this.encode(batch.lines);
+      const res = await fetch(this.url, {
+        method: 'POST',
+        headers: this.headers,
+        body: batch.body,
+        signal: AbortSignal.timeout(REQUEST_TIMEOUT_MS),
+      });
+      if (res.ok) {
+        this.counters.batchesSent++;
+        this.counters.messagesSent += batch.lines.length;
+        this.counters.bytesSent += batch.body.length;
+      } else {
+        error = `POST ${this.url} returned ${res.status} ${res.statusText}`;
+      }
+    } catch (e) {
+      error = e instanceof Error ? e.message : String(e);
+    }
+    this.inFlight--;
+    if (error !== undefined) this.retryOrDrop(batch, error);
+    this.pump();
+  }
+
+  private retryOrDrop(batch: Batch, error: string): void {
+    if (batch.attempts >= RETRY_DELAYS_MS.length || this.closing) {
+      this.drop(batch, 'outputUrl POST failed after retries', error);
+      return;
+    }
+    batch.dueAt = Date.now() + RETRY_DELAYS_MS[batch.attempts];
+    batch.attempts++;
+    this.counters.retries++;
+    this.enqueue(batch);
+  }
+
+  private async encode(lines: string[]): Promise<Buffer> {
+    const raw = Buffer.from(this.maxRecords === 1 ? lines[0] : lines.join('\n') + '\n');
+    if (this.compression === 'gzip') return gzip(raw);
+    if (this.compression === 'zstd' && zstd !== undefined) return zstd(raw);
+    return raw;
+  }
+}
+
+function newBatch(): Batch {
+  return { lines: [], bytes: 0, attempts: 0, dueAt: 0 };
+}
@@ -13,10 +13,34 @@ describe('validateConfig', () => {
     assert.equal(engine.ports.length, 1);
     assert.equal(engine.ports[0], 8080);
     assert.equal(engine.interface, CONTRACT_DEFAULTS.interface);
+    assert.equal(engine.pcapFile, CONTRACT_DEFAULTS.pcapFile);
     assert.equal(engine.sampleRate, CONTRACT_DEFAULTS.sampleRate);
     assert.equal(engine.maxBodySize, CONTRACT_DEFAULTS.maxBodySize);
+    assert.equal(engine.captureBody, CONTRACT_DEFAULTS.captureBody);
+    assert.deepEqual(engine.captureBodyByPort, {});
     assert.equal(engine.maxConcurrentConnections, CONTRACT_DEFAULTS.maxConcurrentConnections);
     assert.equal(engine.connectionIdleTimeoutMs, CONTRACT_DEFAULTS.connectionIdleTimeoutMs);
+    assert.equal(engine.maxOutOfOrderBytes, CONTRACT_DEFAULTS.maxOutOfOrderBytes);
+    assert.equal(engine.gapPolicy, CONTRACT_DEFAULTS.gapPolicy);
+    assert.equal(engine.gapTimeoutMs, CONTRACT_DEFAULTS.gapTimeoutMs);
+    assert.equal(engine.workerThreads, CONTRACT_DEFAULTS.workerThreads);
+    assert.equal(engine.captureBackend, CONTRACT_DEFAULTS.captureBackend);
+    assert.equal(engine.ringBlockSize, CONTRACT_DEFAULTS.ringBlockSize);
+    assert.equal(engine.ringBlockCount, CONTRACT_DEFAULTS.ringBlockCount);
+    assert.equal(engine.ringBlockTimeoutMs, CONTRACT_DEFAULTS.ringBlockTimeoutMs);
+    assert.equal(engine.snaplen, CONTRACT_DEFAULTS.snaplen);
+    assert.equal(engine.kernelPrefilter, CONTRACT_DEFAULTS.kernelPrefilter);
+    assert.equal(engine.messageBatchSize, CONTRACT_DEFAULTS.messageBatchSize);
+    assert.equal(engine.messageBatchLatencyMs, CONTRACT_DEFAULTS.messageBatchLatencyMs);
+    assert.equal(engine.messageQueueCapacity, CONTRACT_DEFAULTS.messageQueueCapacity);
+    assert.equal(engine.backpressurePolicy, CONTRACT_DEFAULTS.backpressurePolicy);
+    assert.equal(engine.loadShedding, CONTRACT_DEFAULTS.loadShedding);
+    assert.equal(engine.nativeStdout, CONTRACT_DEFAULTS.nativeStdout);
+    assert.equal(engine.messagesToJs, true);
+    assert.equal(engine.messageEncoding, CONTRACT_DEFAULTS.messageEncoding);
+    assert.equal(engine.correlateExchanges, CONTRACT_DEFAULTS.correlateExchanges);
+    assert.deepEqual(engine.redactHeaders, CONTRACT_DEFAULTS.redactHeaders);
+    assert.deepEqual(engine.includeHeaders, []);
   });
 
   it('accepts full valid config and preserves provided values', () => {
@@ -25,15 +49,61 @@ describe('validateConfig', () => {
       ports: [80, 443],
       sampleRate: 0.1,
       maxBodySize: 4096,
+      captureBody: 'head:512',
+      captureBodyByPort: { 443: 'none' },
       maxConcurrentConnections: 5000,
       connectionIdleTimeoutMs: 60_000,
+      maxOutOfOrderBytes: 0,
+      gapPolicy: 'wait',
+      gapTimeoutMs: 250,
+      workerThreads: 4,
+      captureBackend: 'tpacket',
+      ringBlockSize: 4_194_304,
+      ringBlockCount: 16,
+      ringBlockTimeoutMs: 0,
+      snaplen: 1514,
+      kernelPrefilter: true,
+      messageBatchSize: 64,
+      messageBatchLatencyMs: 0,
+      messageQueueCapacity: 1024,
+      backpressurePolicy: 'block',
+      loadShedding: true,
+      outputStdout: true,
+      nativeStdout: true,
+      messageEncoding: 'binary',
+      correlateExchanges: true,
+      redactHeaders: ['X-Api-Key'],
+      includeHeaders: ['Host', 'x-api-key'],
     });
     assert.equal(engine.interface, 'eth0');
     assert.deepEqual(engine.ports, [80, 443]);
     assert.equal(engine.sampleRate, 0.1);
     assert.equal(engine.maxBodySize, 4096);
+    assert.equal(engine.captureBody, 'head:512');
+    assert.deepEqual(engine.captureBodyByPort, { 443: 'none' });
     assert.equal(engine.maxConcurrentConnections, 5000);
     assert.equal(engine.connectionIdleTimeoutMs, 60_000);
+    assert.equal(engine.maxOutOfOrderBytes, 0);
+    assert.equal(engine.gapPolicy, 'wait');
+    assert.equal(engine.gapTimeoutMs, 250);
+    assert.equal(engine.workerThreads, 4);
+    assert.equal(engine.captureBackend, 'tpacket');
+    assert.equal(engine.ringBlockSize, 4_194_304);
+    assert.equal(engine.ringBlockCount, 16);
+    assert.equal(engine.ringBlockTimeoutMs, 0);
+    assert.equal(engine.snaplen, 1514);
+    assert.equal(engine.kernelPrefilter, true);
+    assert.equal(engine.messageBatchSize, 64);
+    assert.equal(engine.messageBatchLatencyMs, 0);
+    assert.equal(engine.messageQueueCapacity, 1024);
+    assert.equal(engine.backpressurePolicy, 'block');
+    assert.equal(engine.loadShedding, true);
+    assert.equal(engine.nativeStdout, true);
+    assert.equal(engine.messagesToJs, false);
+    assert.equal(engine.messageEncoding, 'binary');
+    assert.equal(engine.correlateExchanges, true);
+    assert.deepEqual(engine.redactHeaders, ['x-api-key']);
+    assert.deepEqual(engine.includeHeaders, ['host', 'x-api-key']);
   });
 
   it('rejects missing ports', () => {
@@ -72,6 +142,179 @@ describe('validateConfig', () => {
     );
   });
 
+  it('rejects invalid body capture settings', () => {
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ captureBody: 'head:0' as 'full' }, 'captureBody'],
+      [{ captureBody: 'headers' as 'full' }, 'captureBody'],
+      [{ captureBodyByPort: { 9090: 'none' } }, 'captureBodyByPort'],
+      [{ captureBodyByPort: { 8080: 'head:-1' as 'full' } }, 'captureBodyByPort'],
+      [{ captureBodyByPort: ['none'] as unknown as Record<number, 'none'> }, 'captureBodyByPort'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('rejects invalid header lists', () => {
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ redactHeaders: 'cookie' as unknown as string[] }, 'redactHeaders'],
+      [{ includeHeaders: ['host', ''] }, 'includeHeaders'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('rejects invalid maxOutOfOrderBytes', () => {
+    for (const maxOutOfOrderBytes of [-1, 1.5]) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], maxOutOfOrderBytes }),
+        (err: Error) => err instanceof ValidationError && err.field === 'maxOutOfOrderBytes'
+      );
+    }
+  });
+
+  it('rejects invalid gap policy settings', () => {
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ gapPolicy: 'drop' as unknown as 'skip' }, 'gapPolicy'],
+      [{ gapTimeoutMs: -1 }, 'gapTimeoutMs'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('rejects invalid workerThreads', () => {
+    assert.throws(
+      () => validateConfig({ ports: [8080], workerThreads: 0 }),
+      (err: Error) => err instanceof ValidationError && err.field === 'workerThreads'
+    );
+    assert.throws(
+      () => validateConfig({ ports: [8080], workerThreads: 2.5 }),
+      (err: Error) => err instanceof ValidationError && err.field === 'workerThreads'
+    );
+  });
+
+  it('rejects invalid capture backend and ring settings', () => {
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ captureBackend: 'afxdp' as unknown as 'pcap' }, 'captureBackend'],
+      [{ ringBlockSize: 1000 }, 'ringBlockSize'],
+      [{ ringBlockSize: 6144 }, 'ringBlockSize'],
+      [{ ringBlockCount: 0 }, 'ringBlockCount'],
+      [{ ringBlockTimeoutMs: -1 }, 'ringBlockTimeoutMs'],
+      [{ snaplen: 10 }, 'snaplen'],
+      [{ kernelPrefilter: 1 as unknown as boolean }, 'kernelPrefilter'],
+      [{ loadShedding: 'on' as unknown as boolean }, 'loadShedding'],
+      [{ nativeStdout: 1 as unknown as boolean }, 'nativeStdout'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('accepts pcapFile with the pcap backend and rejects it otherwise', () => {
+    const engine = validateConfig({ ports: [8080], pcapFile: '/tmp/incident.pcapng', workerThreads: 4 });
+    assert.equal(engine.pcapFile, '/tmp/incident.pcapng');
+    assert.equal(engine.workerThreads, 4);
+    assert.equal(engine.backpressurePolicy, 'block');
+    assert.equal(
+      validateConfig({ ports: [8080], pcapFile: '/tmp/incident.pcap', backpressurePolicy: 'drop' }).backpressurePolicy,
+      'block'
+    );
+    assert.throws(
+      () => validateConfig({ ports: [8080], pcapFile: '/tmp/incident.pcap', captureBackend: 'tpacket' }),
+      (err: Error) => err instanceof ValidationError && err.field === 'pcapFile'
+    );
+    assert.throws(
+      () => validateConfig({ ports: [8080], pcapFile: 7 as unknown as string }),
+      (err: Error) => err instanceof ValidationError && err.field === 'pcapFile'
+    );
+  });
+
+  it('rejects invalid message batching settings', () => {
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ messageBatchSize: 0 }, 'messageBatchSize'],
+      [{ messageBatchLatencyMs: 1.5 }, 'messageBatchLatencyMs'],
+      [{ messageBatchSize: 512, messageQueueCapacity: 256 }, 'messageQueueCapacity'],
+      [{ backpressurePolicy: 'spill' as unknown as 'drop' }, 'backpressurePolicy'],
+      [{ messageEncoding: 'msgpack' as unknown as 'binary' }, 'messageEncoding'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('accepts outputUrl batching settings and rejects invalid ones', () => {
+    validateConfig({
+      ports: [8080],
+      outputUrl: 'http://localhost:3000',
+      outputBatchSize: 500,
+      outputBatchBytes: 262_144,
+      outputBatchLatencyMs: 0,
+      outputCompression: 'gzip',
+      outputMaxInFlight: 8,
+      outputMaxQueuedBatches: 16,
+    });
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ outputBatchSize: 0 }, 'outputBatchSize'],
+      [{ outputBatchBytes: 1.5 }, 'outputBatchBytes'],
+      [{ outputBatchLatencyMs: -1 }, 'outputBatchLatencyMs'],
+      [{ outputCompression: 'brotli' as unknown as 'gzip' }, 'outputCompression'],
+      [{ outputMaxInFlight: 0 }, 'outputMaxInFlight'],
+      [{ outputMaxQueuedBatches: -4 }, 'outputMaxQueuedBatches'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('passes nativeStdout only with outputStdout and skips JS delivery when it is the only output', () => {
+    assert.equal(validateConfig({ ports: [8080], nativeStdout: true }).nativeStdout, false);
+    const stdoutOnly = validateConfig({ ports: [8080], outputStdout: true, nativeStdout: true });
+    assert.equal(stdoutOnly.nativeStdout, true);
+    assert.equal(stdoutOnly.messagesToJs, false);
+    const withCallback = validateConfig({ ports: [8080], outputStdout: true, nativeStdout: true, onHttpMessage: () => {} });
+    assert.equal(withCallback.nativeStdout, true);
+    assert.equal(withCallback.messagesToJs, true);
+  });
+
+  it('enables correlateExchanges by default only when onHttpExchange is set', () => {
+    assert.equal(validateConfig({ ports: [8080], onHttpExchange: () => {} }).correlateExchanges, true);
+    const cases: Array<[Partial<Parameters<typeof validateConfig>[0]>, string]> = [
+      [{ correlateExchanges: 'yes' as unknown as boolean }, 'correlateExchanges'],
+      [{ correlateExchanges: false, onHttpExchange: () => {} }, 'onHttpExchange'],
+    ];
+    for (const [extra, field] of cases) {
+      assert.throws(
+        () => validateConfig({ ports: [8080], ...extra }),
+        (err: Error) => err instanceof ValidationError && err.field === field
+      );
+    }
+  });
+
+  it('defaults messageQueueCapacity to at least messageBatchSize', () => {
+    const engine = validateConfig({ ports: [8080], messageBatchSize: 10_000 });
+    assert.equal(engine.messageQueueCapacity, 10_000);
+  });
+
   it('rejects non-object config', () => {
     assert.throws(
       () => validateConfig(null as unknown as Parameters<typeof validateConfig>[0]),
@@ -186,4 +429,7 @@ describe('hasOutputConfigured', () => {
       true
     );
   });
+  it('returns true when onHttpExchange is set', () => {
+    assert.equal(hasOutputConfigured({ ports: [8080], onHttpExchange: () => {} }), true);
+  });
 });
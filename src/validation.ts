@@ -4,13 +4,24 @@
  */
 
 import {
+  BACKPRESSURE_POLICIES,
+  CAPTURE_BACKENDS,
+  CAPTURE_BODY_PATTERN,
   CONTRACT_DEFAULTS,
+  GAP_POLICIES,
   MAX_PORT,
   MAX_SAMPLE_RATE,
+  MAX_SNAPLEN,
+  MAX_WORKER_THREADS,
+  MESSAGE_ENCODINGS,
   MIN_PORT,
+  MIN_RING_BLOCK_SIZE,
   MIN_SAMPLE_RATE,
+  MIN_SNAPLEN,
+  OUTPUT_COMPRESSIONS,
 } from './constants.js';
-import type { EngineConfig, SnifferConfig } from './types.js';
+import type { CaptureBodyMode, EngineConfig, SnifferConfig } from './types.js';
+import { supportsZstd } from './url-batcher.js';
 
 export class ValidationError extends Error {
   constructor(
@@ -80,6 +91,40 @@ export function validateConfig(config: SnifferConfig): EngineConfig {
     'maxBodySize'
   );
 
+  // captureBody: if present, 'none', 'full' or 'head:<N>'
+  const captureBody = config.captureBody !== undefined ? config.captureBody : CONTRACT_DEFAULTS.captureBody;
+  assert(
+    typeof captureBody === 'string' && CAPTURE_BODY_PATTERN.test(captureBody),
+    "captureBody must be 'none', 'full' or 'head:<bytes>'",
+    'captureBody'
+  );
+
+  // captureBodyByPort: if present, object mapping configured ports to captureBody modes
+  const captureBodyByPort: Record<number, CaptureBodyMode> = {};
+  if (config.captureBodyByPort !== undefined) {
+    assert(
+      config.captureBodyByPort !== null &&
+        typeof config.captureBodyByPort === 'object' &&
+        !Array.isArray(config.captureBodyByPort),
+      'captureBodyByPort must be an object',
+      'captureBodyByPort'
+    );
+    for (const [key, mode] of Object.entries(config.captureBodyByPort)) {
+      const port = Number(key);
+      assert(
+        config.ports.includes(port),
+        `captureBodyByPort key ${key} must be one of ports`,
+        'captureBodyByPort'
+      );
+      assert(
+        typeof mode === 'string' && CAPTURE_BODY_PATTERN.test(mode),
+        `captureBodyByPort[${key}] must be 'none', 'full' or 'head:<bytes>'`,
+        'captureBodyByPort'
+      );
+      captureBodyByPort[port] = mode;
+    }
+  }
+
   // maxConcurrentConnections: if present, positive integer
   const maxConcurrentConnections =
     config.maxConcurrentConnections !== undefined
@@ -106,6 +151,192 @@ export function validateConfig(config: SnifferConfig): EngineConfig {
     'connectionIdleTimeoutMs'
   );
 
+  // maxOutOfOrderBytes: if present, non-negative integer (0 = never buffer ahead of a gap)
+  const maxOutOfOrderBytes =
+    config.maxOutOfOrderBytes !== undefined ? config.maxOutOfOrderBytes : CONTRACT_DEFAULTS.maxOutOfOrderBytes;
+  assert(
+    typeof maxOutOfOrderBytes === 'number' && Number.isInteger(maxOutOfOrderBytes) && maxOutOfOrderBytes >= 0,
+    'maxOutOfOrderBytes must be a non-negative integer',
+    'maxOutOfOrderBytes'
+  );
+
+  // gapPolicy: if present, one of GAP_POLICIES
+  const gapPolicy = config.gapPolicy !== undefined ? config.gapPolicy : CONTRACT_DEFAULTS.gapPolicy;
+  assert(
+    (GAP_POLICIES as readonly string[]).includes(gapPolicy),
+    `gapPolicy must be one of: ${GAP_POLICIES.join(', ')}`,
+    'gapPolicy'
+  );
+
+  // gapTimeoutMs: if present, non-negative integer (0 = skip a hole on the connection's next segment)
+  const gapTimeoutMs = config.gapTimeoutMs !== undefined ? config.gapTimeoutMs : CONTRACT_DEFAULTS.gapTimeoutMs;
+  assert(
+    typeof gapTimeoutMs === 'number' && Number.isInteger(gapTimeoutMs) && gapTimeoutMs >= 0,
+    'gapTimeoutMs must be a non-negative integer',
+    'gapTimeoutMs'
+  );
+
+  // workerThreads: if present, integer in [1, MAX_WORKER_THREADS]
+  const workerThreads =
+    config.workerThreads !== undefined ? config.workerThreads : CONTRACT_DEFAULTS.workerThreads;
+  assert(
+    typeof workerThreads === 'number' &&
+      Number.isInteger(workerThreads) &&
+      workerThreads >= 1 &&
+      workerThreads <= MAX_WORKER_THREADS,
+    `workerThreads must be an integer between 1 and ${MAX_WORKER_THREADS}`,
+    'workerThreads'
+  );
+
+  // captureBackend: if present, one of CAPTURE_BACKENDS
+  const captureBackend =
+    config.captureBackend !== undefined ? config.captureBackend : CONTRACT_DEFAULTS.captureBackend;
+  assert(
+    (CAPTURE_BACKENDS as readonly string[]).includes(captureBackend),
+    `captureBackend must be one of: ${CAPTURE_BACKENDS.join(', ')}`,
+    'captureBackend'
+  );
+
+  // ringBlockSize: if present, power of two >= MIN_RING_BLOCK_SIZE
+  const ringBlockSize =
+    config.ringBlockSize !== undefined ? config.ringBlockSize : CONTRACT_DEFAULTS.ringBlockSize;
+  assert(
+    typeof ringBlockSize === 'number' &&
+      Number.isInteger(ringBlockSize) &&
+      ringBlockSize >= MIN_RING_BLOCK_SIZE &&
+      ringBlockSize <= 2 ** 31 &&
+      (ringBlockSize & (ringBlockSize - 1)) === 0,
+    `ringBlockSize must be a power of two >= ${MIN_RING_BLOCK_SIZE}`,
+    'ringBlockSize'
+  );
+
+  // ringBlockCount: if present, positive integer
+  const ringBlockCount =
+    config.ringBlockCount !== undefined ? config.ringBlockCount : CONTRACT_DEFAULTS.ringBlockCount;
+  assert(
+    typeof ringBlockCount === 'number' && Number.isInteger(ringBlockCount) && ringBlockCount > 0,
+    'ringBlockCount must be a positive integer',
+    'ringBlockCount'
+  );
+
+  // ringBlockTimeoutMs: if present, non-negative integer
+  const ringBlockTimeoutMs =
+    config.ringBlockTimeoutMs !== undefined
+      ? config.ringBlockTimeoutMs
+      : CONTRACT_DEFAULTS.ringBlockTimeoutMs;
+  assert(
+    typeof ringBlockTimeoutMs === 'number' &&
+      Number.isInteger(ringBlockTimeoutMs) &&
+      ringBlockTimeoutMs >= 0,
+    'ringBlockTimeoutMs must be a non-negative integer',
+    'ringBlockTimeoutMs'
+  );
+
+  // snaplen: if present, integer in [MIN_SNAPLEN, MAX_SNAPLEN]
+  const snaplen = config.snaplen !== undefined ? config.snaplen : CONTRACT_DEFAULTS.snaplen;
+  assert(
+    typeof snaplen === 'number' &&
+      Number.isInteger(snaplen) &&
+      snaplen >= MIN_SNAPLEN &&
+      snaplen <= MAX_SNAPLEN,
+    `snaplen must be an integer between ${MIN_SNAPLEN} and ${MAX_SNAPLEN}`,
+    'snaplen'
+  );
+
+  // kernelPrefilter: if present, boolean
+  const kernelPrefilter =
+    config.kernelPrefilter !== undefined ? config.kernelPrefilter : CONTRACT_DEFAULTS.kernelPrefilter;
+  assert(typeof kernelPrefilter === 'boolean', 'kernelPrefilter must be a boolean', 'kernelPrefilter');
+
+  // messageBatchSize: if present, positive integer
+  const messageBatchSize =
+    config.messageBatchSize !== undefined ? config.messageBatchSize : CONTRACT_DEFAULTS.messageBatchSize;
+  assert(
+    typeof messageBatchSize === 'number' && Number.isInteger(messageBatchSize) && messageBatchSize > 0,
+    'messageBatchSize must be a positive integer',
+    'messageBatchSize'
+  );
+
+  // messageBatchLatencyMs: if present, non-negative integer
+  const messageBatchLatencyMs =
+    config.messageBatchLatencyMs !== undefined
+      ? config.messageBatchLatencyMs
+      : CONTRACT_DEFAULTS.messageBatchLatencyMs;
+  assert(
+    typeof messageBatchLatencyMs === 'number' &&
+      Number.isInteger(messageBatchLatencyMs) &&
+      messageBatchLatencyMs >= 0,
+    'messageBatchLatencyMs must be a non-negative integer',
+    'messageBatchLatencyMs'
+  );
+
+  // messageQueueCapacity: if present, integer >= messageBatchSize
+  const messageQueueCapacity =
+    config.messageQueueCapacity !== undefined
+      ? config.messageQueueCapacity
+      : Math.max(CONTRACT_DEFAULTS.messageQueueCapacity, messageBatchSize);
+  assert(
+    typeof messageQueueCapacity === 'number' &&
+      Number.isInteger(messageQueueCapacity) &&
+      messageQueueCapacity >= messageBatchSize,
+    'messageQueueCapacity must be an integer >= messageBatchSize',
+    'messageQueueCapacity'
+  );
+
+  // backpressurePolicy: if present, one of BACKPRESSURE_POLICIES
+  const backpressurePolicy =
+    config.backpressurePolicy !== undefined
+      ? config.backpressurePolicy
+      : CONTRACT_DEFAULTS.backpressurePolicy;
+  assert(
+    (BACKPRESSURE_POLICIES as readonly string[]).includes(backpressurePolicy),
+    `backpressurePolicy must be one of: ${BACKPRESSURE_POLICIES.join(', ')}`,
+    'backpressurePolicy'
+  );
+
+  // loadShedding: if present, boolean
+  const loadShedding = config.loadShedding !== undefined ? config.loadShedding : CONTRACT_DEFAULTS.loadShedding;
+  assert(typeof loadShedding === 'boolean', 'loadShedding must be a boolean', 'loadShedding');
+
+  // nativeStdout: if present, boolean; only takes effect with outputStdout
+  const nativeStdout = config.nativeStdout !== undefined ? config.nativeStdout : CONTRACT_DEFAULTS.nativeStdout;
+  assert(typeof nativeStdout === 'boolean', 'nativeStdout must be a boolean', 'nativeStdout');
+  const engineWritesStdout = nativeStdout && config.outputStdout === true;
+  const messagesToJs =
+    !engineWritesStdout ||
+    (config.outputUrl != null && config.outputUrl !== '') ||
+    typeof config.onHttpMessage === 'function' ||
+    typeof config.onHttpExchange === 'function';
+
+  // messageEncoding: if present, one of MESSAGE_ENCODINGS
+  const messageEncoding =
+    config.messageEncoding !== undefined ? config.messageEncoding : CONTRACT_DEFAULTS.messageEncoding;
+  assert(
+    (MESSAGE_ENCODINGS as readonly string[]).includes(messageEncoding),
+    `messageEncoding must be one of: ${MESSAGE_ENCODINGS.join(', ')}`,
+    'messageEncoding'
+  );
+
+  // correlateExchanges: if present, boolean; defaults on when onHttpExchange is set, which needs it
+  const correlateExchanges =
+    config.correlateExchanges !== undefined
+      ? config.correlateExchanges
+      : typeof config.onHttpExchange === 'function' || CONTRACT_DEFAULTS.correlateExchanges;
+  assert(
+    typeof correlateExchanges === 'boolean',
+    'correlateExchanges must be a boolean',
+    'correlateExchanges'
+  );
+  assert(
+    correlateExchanges || config.onHttpExchange === undefined,
+    'onHttpExchange requires correlateExchanges',
+    'onHttpExchange'
+  );
+
+  // redactHeaders / includeHeaders: if present, arrays of non-empty strings (lowercased for C++)
+  const redactHeaders = headerNames(config.redactHeaders, CONTRACT_DEFAULTS.redactHeaders, 'redactHeaders');
+  const includeHeaders = headerNames(config.includeHeaders, CONTRACT_DEFAULTS.includeHeaders, 'includeHeaders');
+
   // interface: if present, non-empty string (C++ may still fail if it doesn't exist)
   const iface =
     config.interface !== undefined ? config.interface : CONTRACT_DEFAULTS.interface;
@@ -115,6 +346,15 @@ export function validateConfig(config: SnifferConfig): EngineConfig {
     'interface'
   );
 
+  // pcapFile: if present, a string; a file is read through libpcap, so not with the ring backend
+  const pcapFile = config.pcapFile !== undefined ? config.pcapFile : CONTRACT_DEFAULTS.pcapFile;
+  assert(typeof pcapFile === 'string', 'pcapFile must be a string (use empty string for live capture)', 'pcapFile');
+  assert(
+    pcapFile === '' || captureBackend === 'pcap',
+    "pcapFile requires captureBackend 'pcap'",
+    'pcapFile'
+  );
+
   // outputUrl: in production, must use HTTPS (non-production allows http for local/dev)
   if (config.outputUrl != null && config.outputUrl !== '' && isProduction()) {
     try {
@@ -135,16 +375,76 @@ export function validateConfig(config: SnifferConfig): EngineConfig {
     }
   }
 
+  // outputUrl batching (applied by the TS output stage, not passed to the engine)
+  for (const field of ['outputBatchSize', 'outputBatchBytes', 'outputMaxInFlight', 'outputMaxQueuedBatches'] as const) {
+    const value = config[field];
+    assert(value === undefined || (Number.isInteger(value) && value > 0), `${field} must be a positive integer`, field);
+  }
+  assert(
+    config.outputBatchLatencyMs === undefined ||
+      (Number.isInteger(config.outputBatchLatencyMs) && config.outputBatchLatencyMs >= 0),
+    'outputBatchLatencyMs must be a non-negative integer',
+    'outputBatchLatencyMs'
+  );
+  if (config.outputCompression !== undefined) {
+    assert(
+      (OUTPUT_COMPRESSIONS as readonly string[]).includes(config.outputCompression),
+      `outputCompression must be one of: ${OUTPUT_COMPRESSIONS.join(', ')}`,
+      'outputCompression'
+    );
+    assert(
+      config.outputCompression !== 'zstd' || supportsZstd(),
+      "outputCompression 'zstd' requires Node.js 22.15 or later",
+      'outputCompression'
+    );
+  }
+
   return {
     interface: iface,
+    pcapFile,
     ports: [...config.ports],
     sampleRate,
     maxBodySize,
+    captureBody,
+    captureBodyByPort,
     maxConcurrentConnections,
     connectionIdleTimeoutMs,
+    maxOutOfOrderBytes,
+    gapPolicy,
+    gapTimeoutMs,
+    workerThreads,
+    captureBackend,
+    ringBlockSize,
+    ringBlockCount,
+    ringBlockTimeoutMs,
+    snaplen,
+    kernelPrefilter,
+    messageBatchSize,
+    messageBatchLatencyMs,
+    messageQueueCapacity,
+    // A file replay always blocks: dropping would lose messages with no live traffic to protect.
+    backpressurePolicy: pcapFile !== '' ? 'block' : backpressurePolicy,
+    loadShedding,
+    nativeStdout: engineWritesStdout,
+    messagesToJs,
+    messageEncoding,
+    correlateExchanges,
+    redactHeaders,
+    includeHeaders,
   };
 }
 
+/** Lowercased copy of a header-name list, or of its default when absent. */
+function headerNames(names: string[] | undefined, defaults: readonly string[], field: string): string[] {
+  const list = names !== undefined ? names : defaults;
+  assert(
+    Array.isArray(list) && list.every((n) => typeof n === 'string' && n !== ''),
+    `${field} must be an array of non-empty strings`,
+    field
+  );
+  return list.map((n) => n.toLowerCase());
+}
+
 /**
  * Returns true if at least one output is configured (for startup warning when none set).
  */
@@ -152,6 +452,7 @@ export function hasOutputConfigured(config: SnifferConfig): boolean {
   return (
     (config.outputUrl != null && config.outputUrl !== '') ||
     config.outputStdout === true ||
-    typeof config.onHttpMessage === 'function'
+    typeof config.onHttpMessage === 'function' ||
+    typeof config.onHttpExchange === 'function'
   );
 }